@@ -6,7 +6,7 @@
             "include_dirs": [
                 "<!@(node -p \"require('node-addon-api').include\")",
             ],
-            "dependencies": [ "deps/libbpf.gyp:libbpf" ],
+            "dependencies": [ "deps/libbpf.gyp:libbpf", "deps/elfutils.gyp:libelf" ],
 
             # Enable exceptions
             "cflags!": [ "-fno-exceptions" ],
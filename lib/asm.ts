@@ -0,0 +1,192 @@
+/**
+ * Minimal eBPF assembler, mirroring the instruction macros in
+ * the kernel's `include/linux/filter.h`. It's used to build the
+ * programs shipped with this module, and can be used to write
+ * small programs without a compiler.
+ * 
+ * Keep synchronized with `deps/libbpf/include/uapi/linux/bpf.h`.
+ */
+
+import { INSN_SIZE } from './program'
+
+/** Registers (R10 is the read-only frame pointer) */
+export enum Reg { R0, R1, R2, R3, R4, R5, R6, R7, R8, R9, R10 }
+
+/** Instruction classes */
+export enum InsnClass { LD = 0x00, LDX = 0x01, ST = 0x02, STX = 0x03, ALU = 0x04, JMP = 0x05, JMP32 = 0x06, ALU64 = 0x07 }
+
+/** Memory access sizes */
+export enum Size { W = 0x00, H = 0x08, B = 0x10, DW = 0x18 }
+
+/** ALU operations */
+export enum AluOp {
+    ADD = 0x00, SUB = 0x10, MUL = 0x20, DIV = 0x30, OR = 0x40, AND = 0x50, LSH = 0x60,
+    RSH = 0x70, NEG = 0x80, MOD = 0x90, XOR = 0xa0, MOV = 0xb0, ARSH = 0xc0,
+}
+
+/** Jump operations */
+export enum JmpOp {
+    JA = 0x00, JEQ = 0x10, JGT = 0x20, JGE = 0x30, JSET = 0x40, JNE = 0x50, JSGT = 0x60,
+    JSGE = 0x70, CALL = 0x80, EXIT = 0x90, JLT = 0xa0, JLE = 0xb0, JSLT = 0xc0, JSLE = 0xd0,
+}
+
+const BPF_K = 0x00, BPF_X = 0x08
+const BPF_IMM = 0x00, BPF_MEM = 0x60, BPF_ATOMIC = 0xc0
+const BPF_PSEUDO_MAP_FD = 1
+
+/** IDs of some commonly used helpers, see `bpf_helper_defs.h` */
+export enum Helper {
+    MAP_LOOKUP_ELEM = 1,
+    MAP_UPDATE_ELEM = 2,
+    MAP_DELETE_ELEM = 3,
+    KTIME_GET_NS = 5,
+    TRACE_PRINTK = 6,
+    GET_SMP_PROCESSOR_ID = 8,
+    TAIL_CALL = 12,
+    GET_CURRENT_PID_TGID = 14,
+    GET_CURRENT_UID_GID = 15,
+    GET_CURRENT_COMM = 16,
+    PERF_EVENT_OUTPUT = 25,
+    GET_STACKID = 27,
+    REDIRECT_MAP = 51,
+    SK_REDIRECT_MAP = 52,
+    MSG_REDIRECT_MAP = 60,
+    GET_STACK = 67,
+    MSG_REDIRECT_HASH = 71,
+    SK_REDIRECT_HASH = 72,
+    GET_CURRENT_CGROUP_ID = 80,
+    SK_SELECT_REUSEPORT = 82,
+    PROBE_READ_USER = 112,
+    PROBE_READ_KERNEL = 113,
+    SEQ_WRITE = 127,
+}
+
+/**
+ * Builds a program one instruction at a time. Jumps refer
+ * to labels, which are resolved by [[build]].
+ */
+export class Assembler {
+    private readonly insns: Buffer[] = []
+    private readonly labels = new Map<string, number>()
+    private readonly fixups: { index: number, label: string }[] = []
+
+    /** Amount of instructions emitted so far */
+    get length(): number {
+        return this.insns.length
+    }
+
+    /** Emit a raw instruction */
+    insn(code: number, dst: number, src: number, off: number, imm: number): this {
+        const buf = Buffer.alloc(INSN_SIZE)
+        buf.writeUInt8(code, 0)
+        buf.writeUInt8((dst & 0xf) | ((src & 0xf) << 4), 1)
+        buf.writeInt16LE(off, 2)
+        buf.writeInt32LE(imm | 0, 4)
+        this.insns.push(buf)
+        return this
+    }
+
+    /** Define a label at the current position */
+    label(name: string): this {
+        if (this.labels.has(name))
+            throw new Error(`Label ${name} defined twice`)
+        this.labels.set(name, this.insns.length)
+        return this
+    }
+
+    // ALU
+
+    /** `dst = imm` (64-bit) */
+    movImm(dst: Reg, imm: number): this {
+        return this.aluImm(AluOp.MOV, dst, imm)
+    }
+    /** `dst = src` (64-bit) */
+    movReg(dst: Reg, src: Reg): this {
+        return this.aluReg(AluOp.MOV, dst, src)
+    }
+    /** `dst op= imm` (64-bit) */
+    aluImm(op: AluOp, dst: Reg, imm: number): this {
+        return this.insn(InsnClass.ALU64 | op | BPF_K, dst, 0, 0, imm)
+    }
+    /** `dst op= src` (64-bit) */
+    aluReg(op: AluOp, dst: Reg, src: Reg): this {
+        return this.insn(InsnClass.ALU64 | op | BPF_X, dst, src, 0, 0)
+    }
+    /** `dst op= imm` (32-bit, upper half is zeroed) */
+    alu32Imm(op: AluOp, dst: Reg, imm: number): this {
+        return this.insn(InsnClass.ALU | op | BPF_K, dst, 0, 0, imm)
+    }
+    /** `dst op= src` (32-bit, upper half is zeroed) */
+    alu32Reg(op: AluOp, dst: Reg, src: Reg): this {
+        return this.insn(InsnClass.ALU | op | BPF_X, dst, src, 0, 0)
+    }
+    /** `dst = imm64` (takes two instruction slots) */
+    ldImm64(dst: Reg, imm: bigint): this {
+        const lo = Number(BigInt.asIntN(32, imm)), hi = Number(BigInt.asIntN(32, imm >> BigInt(32)))
+        this.insn(InsnClass.LD | Size.DW | BPF_IMM, dst, 0, 0, lo)
+        return this.insn(0, 0, 0, 0, hi)
+    }
+    /** `dst = map` (takes two instruction slots) */
+    ldMapFd(dst: Reg, fd: number): this {
+        this.insn(InsnClass.LD | Size.DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, fd)
+        return this.insn(0, 0, 0, 0, 0)
+    }
+
+    // Memory
+
+    /** `dst = *(size *)(src + off)` */
+    ldxMem(size: Size, dst: Reg, src: Reg, off: number): this {
+        return this.insn(InsnClass.LDX | size | BPF_MEM, dst, src, off, 0)
+    }
+    /** `*(size *)(dst + off) = src` */
+    stxMem(size: Size, dst: Reg, src: Reg, off: number): this {
+        return this.insn(InsnClass.STX | size | BPF_MEM, dst, src, off, 0)
+    }
+    /** `*(size *)(dst + off) = imm` */
+    stMem(size: Size, dst: Reg, off: number, imm: number): this {
+        return this.insn(InsnClass.ST | size | BPF_MEM, dst, 0, off, imm)
+    }
+    /** `lock *(size *)(dst + off) += src` (only `W` and `DW`) */
+    atomicAdd(size: Size, dst: Reg, src: Reg, off: number): this {
+        return this.insn(InsnClass.STX | size | BPF_ATOMIC, dst, src, off, AluOp.ADD)
+    }
+
+    // Jumps
+
+    /** `if (dst op imm) goto label` (`JA` jumps unconditionally) */
+    jmpImm(op: JmpOp, dst: Reg, imm: number, label: string): this {
+        this.fixups.push({ index: this.insns.length, label })
+        return this.insn(InsnClass.JMP | op | BPF_K, dst, 0, 0, imm)
+    }
+    /** `if (dst op src) goto label` */
+    jmpReg(op: JmpOp, dst: Reg, src: Reg, label: string): this {
+        this.fixups.push({ index: this.insns.length, label })
+        return this.insn(InsnClass.JMP | op | BPF_X, dst, src, 0, 0)
+    }
+    /** `goto label` */
+    ja(label: string): this {
+        return this.jmpImm(JmpOp.JA, 0, 0, label)
+    }
+    /** Call a helper (arguments in R1-R5, result in R0, R1-R5 are clobbered) */
+    call(helper: Helper | number): this {
+        return this.insn(InsnClass.JMP | JmpOp.CALL, 0, 0, 0, helper)
+    }
+    /** Return R0 */
+    exit(): this {
+        return this.insn(InsnClass.JMP | JmpOp.EXIT, 0, 0, 0, 0)
+    }
+
+    /**
+     * Resolve jumps and return the program bytecode, to be
+     * passed to [[loadProgram]].
+     */
+    build(): Buffer {
+        for (const { index, label } of this.fixups) {
+            const target = this.labels.get(label)
+            if (target === undefined)
+                throw new Error(`Undefined label ${label}`)
+            this.insns[index].writeInt16LE(target - (index + 1), 2)
+        }
+        return Buffer.concat(this.insns)
+    }
+}
@@ -0,0 +1,368 @@
+import { native, FD } from './util'
+import { checkStatus, BPFError } from './exception'
+
+/** Path of the kernel's own BTF (needs `CONFIG_DEBUG_INFO_BTF`) */
+export const VMLINUX_BTF_PATH = '/sys/kernel/btf/vmlinux'
+
+/** BTF type kinds (`BTF_KIND_*`) */
+export enum BtfKind {
+    UNKN = 0,
+    INT = 1,
+    PTR = 2,
+    ARRAY = 3,
+    STRUCT = 4,
+    UNION = 5,
+    ENUM = 6,
+    FWD = 7,
+    TYPEDEF = 8,
+    VOLATILE = 9,
+    CONST = 10,
+    RESTRICT = 11,
+    FUNC = 12,
+    FUNC_PROTO = 13,
+    VAR = 14,
+    DATASEC = 15,
+    FLOAT = 16,
+}
+
+/** Encoding flags of `INT` types (`BTF_INT_*`) */
+export enum BtfIntEncoding {
+    SIGNED = 1 << 0,
+    CHAR = 1 << 1,
+    BOOL = 1 << 2,
+}
+
+/** Member of a `STRUCT` or `UNION` type */
+export interface BtfMember {
+    /** Name (empty for anonymous members) */
+    name: string
+    type: number
+    /** Offset from the start of the struct, in bits */
+    bitOffset: number
+    /** Size in bits if it's a bitfield, 0 otherwise */
+    bitSize: number
+}
+
+/**
+ * A BTF type, as returned by [[Btf.getType]]. Fields other than
+ * `id`, `kind` and `name` are present depending on the kind.
+ */
+export interface BtfType {
+    id: number
+    kind: BtfKind
+    /** Name (empty for anonymous types) */
+    name: string
+    /** For `INT`, `STRUCT`, `UNION`, `ENUM`, `DATASEC` and `FLOAT`: size in bytes */
+    size?: number
+    /**
+     * For `PTR`, `TYPEDEF`, `VOLATILE`, `CONST`, `RESTRICT`, `VAR`
+     * and `FUNC`: referenced type. For `FUNC_PROTO`: return type.
+     */
+    type?: number
+    /** For `FWD`: whether it's a union (otherwise it's a struct) */
+    kindFlag?: boolean
+    /** For `INT` */
+    int?: { encoding: BtfIntEncoding, offset: number, bits: number }
+    /** For `ARRAY` */
+    array?: { type: number, indexType: number, length: number }
+    /** For `STRUCT` and `UNION` */
+    members?: BtfMember[]
+    /** For `ENUM` */
+    values?: { name: string, value: number }[]
+    /** For `FUNC_PROTO` */
+    params?: { name: string, type: number }[]
+    /** For `FUNC` and `VAR` */
+    linkage?: number
+    /** For `DATASEC` */
+    vars?: { type: number, offset: number, size: number }[]
+}
+
+/** Location of a (possibly nested) field, see [[Btf.fieldLayout]] */
+export interface FieldLayout {
+    /** Field path, with nested fields separated by dots */
+    name: string
+    /** Type of the field */
+    type: number
+    /** Offset from the start of the outer struct, in bytes (rounded down for bitfields) */
+    offset: number
+    /** Size in bytes (of the underlying type, for bitfields) */
+    size: number
+    /** Offset from the start of the outer struct, in bits */
+    bitOffset: number
+    /** Size in bits if it's a bitfield, 0 otherwise */
+    bitSize: number
+}
+
+/** Layout of a `STRUCT` or `UNION`, see [[Btf.structLayout]] */
+export interface StructLayout {
+    id: number
+    kind: BtfKind.STRUCT | BtfKind.UNION
+    name: string
+    size: number
+    /** Members, with the ones of anonymous members inlined */
+    fields: FieldLayout[]
+}
+
+const DEFAULT_LOG_SIZE = 1 << 16
+
+const SIZED_KINDS = new Set([ BtfKind.INT, BtfKind.STRUCT, BtfKind.UNION, BtfKind.ENUM, BtfKind.DATASEC, BtfKind.FLOAT ])
+
+let vmlinux: Btf | undefined
+
+/**
+ * BTF type information, parsed from a raw BTF blob (such as
+ * [[VMLINUX_BTF_PATH]]) or from the `.BTF` section of an ELF file.
+ * 
+ * Loading reads the file and makes a single pass over it (libbpf
+ * keeps its own copy of the data), even for vmlinux BTF
+ * (100k+ types): the index used to find types by name is built
+ * on the first lookup, and types and struct layouts are only
+ * converted (and cached) when asked for. Use [[Btf.vmlinux]] to
+ * share the kernel's BTF across the process.
+ */
+export class Btf {
+    /** @hidden Native instance, to be passed to other native calls */
+    readonly native: any
+    /** Path the BTF was loaded from (`undefined` if loaded by ID) */
+    readonly path?: string
+    /** Kernel ID of the BTF object, if it was loaded by ID */
+    readonly id?: number
+    private readonly types = new Map<number, BtfType>()
+    private readonly layouts = new Map<number, StructLayout>()
+
+    /**
+     * Load BTF from a file, or from the kernel.
+     * 
+     * @param source Raw BTF or ELF file (default: [[VMLINUX_BTF_PATH]]),
+     * or ID of a BTF object loaded in the kernel, such as the `btfId`
+     * of a map or program (since Linux 4.18)
+     */
+    constructor(source: string | { id: number } = VMLINUX_BTF_PATH) {
+        this.native = new native.Btf()
+        if (typeof source === 'string') {
+            checkStatus('btf__new', this.native.load(source))
+            this.path = source
+        } else {
+            checkStatus('btf__get_from_id', this.native.loadFromId(source.id))
+            this.id = source.id
+        }
+    }
+
+    /**
+     * Kernel BTF, loaded on the first call and shared afterwards.
+     */
+    static vmlinux(): Btf {
+        if (vmlinux === undefined)
+            vmlinux = new Btf(VMLINUX_BTF_PATH)
+        return vmlinux
+    }
+
+    /** Number of types (IDs go from 1 to this, 0 is `void`) */
+    get length(): number {
+        return this.native.count
+    }
+
+    /**
+     * Find a type by name.
+     * 
+     * @param name Type name
+     * @param kind Only consider types of this kind
+     * @returns Lowest ID of a matching type, or `undefined` if none
+     */
+    findType(name: string, kind?: BtfKind): number | undefined {
+        const id: number = this.native.find(name, kind)
+        return id < 0 ? undefined : id
+    }
+
+    /**
+     * Get a type by ID.
+     * 
+     * @param id Type ID
+     * @returns Type description (cached, don't modify it)
+     */
+    getType(id: number): BtfType {
+        let type = this.types.get(id)
+        if (type !== undefined)
+            return type
+        const [ kind, name, sizeOrType, kindFlag, details ] = this.native.getType(id)
+        type = { id, kind, name }
+        if (SIZED_KINDS.has(kind))
+            type.size = sizeOrType
+        else if (kind !== BtfKind.UNKN && kind !== BtfKind.ARRAY && kind !== BtfKind.FWD)
+            type.type = sizeOrType
+        if (kind === BtfKind.FWD)
+            type.kindFlag = kindFlag
+        if (kind === BtfKind.INT)
+            type.int = { encoding: details[0], offset: details[1], bits: details[2] }
+        else if (kind === BtfKind.ARRAY)
+            type.array = { type: details[0], indexType: details[1], length: details[2] }
+        else if (kind === BtfKind.STRUCT || kind === BtfKind.UNION)
+            type.members = (details as any[]).map(([ name, type, bitOffset, bitSize ]) => ({ name, type, bitOffset, bitSize }))
+        else if (kind === BtfKind.ENUM)
+            type.values = (details as any[]).map(([ name, value ]) => ({ name, value }))
+        else if (kind === BtfKind.FUNC_PROTO)
+            type.params = (details as any[]).map(([ name, type ]) => ({ name, type }))
+        else if (kind === BtfKind.FUNC || kind === BtfKind.VAR)
+            type.linkage = details
+        else if (kind === BtfKind.DATASEC)
+            type.vars = (details as any[]).map(([ type, offset, size ]) => ({ type, offset, size }))
+        this.types.set(id, type)
+        return type
+    }
+
+    /**
+     * Get the C declarations of a type and the types it depends
+     * on (through libbpf's `btf_dump`), as a header would have them.
+     * 
+     * @param id Type ID
+     * @returns C source
+     */
+    dumpC(id: number): string {
+        const ret: string | number = this.native.dumpC(id)
+        if (typeof ret === 'number')
+            checkStatus('btf_dump__dump_type', ret)
+        return ret as string
+    }
+
+    /**
+     * Skip typedefs and modifiers (`const`, `volatile`, `restrict`).
+     * 
+     * @param id Type ID
+     * @returns ID of the underlying type
+     */
+    resolveType(id: number): number {
+        const ret: number = this.native.resolveType(id)
+        checkStatus('btf__resolve_type', ret)
+        return ret
+    }
+
+    /**
+     * Get the size of a type, in bytes.
+     * 
+     * @param id Type ID
+     */
+    sizeOf(id: number): number {
+        const ret: number = this.native.resolveSize(id)
+        checkStatus('btf__resolve_size', ret)
+        return ret
+    }
+
+    /**
+     * Get the layout of a struct or union: offset and size of every
+     * member, with the members of anonymous structs and unions
+     * inlined (as the C compiler lets you access them).
+     * 
+     * @param type Type ID, or struct name (a union name also works
+     * if there's no struct with that name)
+     * @returns Layout (cached, don't modify it)
+     */
+    structLayout(type: number | string): StructLayout {
+        const id = typeof type === 'number' ? this.resolveType(type) : this.findComposite(type)
+        let layout = this.layouts.get(id)
+        if (layout !== undefined)
+            return layout
+        const t = this.getType(id)
+        if (t.kind !== BtfKind.STRUCT && t.kind !== BtfKind.UNION)
+            throw new Error(`Type ${id} (${t.name}) isn't a struct or union`)
+        const fields: FieldLayout[] = []
+        this.collectFields(t, 0, fields)
+        layout = { id, kind: t.kind, name: t.name, size: t.size!, fields }
+        this.layouts.set(id, layout)
+        return layout
+    }
+
+    /**
+     * Locate a (possibly nested) field of a struct or union, e.g.
+     * to read it from a program, CO-RE style.
+     * 
+     * @param type Type ID or struct name
+     * @param path Field path, with nested fields separated by dots
+     * (e.g. `mm.exe_file`); pointers aren't followed
+     * @returns Field layout (its `name` is the full path)
+     */
+    fieldLayout(type: number | string, path: string): FieldLayout {
+        let bitOffset = 0
+        let field: FieldLayout | undefined
+        for (const name of path.split('.')) {
+            const layout = this.structLayout(field === undefined ? type : field.type)
+            const next = layout.fields.find(x => x.name === name)
+            if (next === undefined)
+                throw new Error(`${layout.name || 'Anonymous type'} has no field ${name}`)
+            bitOffset += next.bitOffset
+            field = next
+        }
+        return {
+            ...field!,
+            name: path,
+            offset: Math.floor(bitOffset / 8),
+            bitOffset,
+        }
+    }
+
+    private findComposite(name: string): number {
+        const id = this.findType(name, BtfKind.STRUCT) ?? this.findType(name, BtfKind.UNION)
+        if (id === undefined)
+            throw new Error(`No struct or union named ${name}`)
+        return id
+    }
+
+    private collectFields(t: BtfType, base: number, fields: FieldLayout[]) {
+        for (const m of t.members!) {
+            const bitOffset = base + m.bitOffset
+            const resolved = this.getType(this.resolveType(m.type))
+            const composite = resolved.kind === BtfKind.STRUCT || resolved.kind === BtfKind.UNION
+            if (!m.name && composite) {
+                this.collectFields(resolved, bitOffset, fields)
+                continue
+            }
+            fields.push({
+                name: m.name,
+                type: m.type,
+                offset: Math.floor(bitOffset / 8),
+                size: this.sizeOf(m.type),
+                bitOffset,
+                bitSize: m.bitSize,
+            })
+        }
+    }
+}
+
+/**
+ * Reference to a BTF object loaded into the kernel, see [[loadBtf]].
+ * The object is freed when the last reference to it is closed
+ * (maps and programs created with it also hold references).
+ */
+export interface BtfRef {
+    /** FD owned by this object, same semantics as [[MapRef.fd]] */
+    readonly fd: FD
+    /** Closes the FD early. Calling it a second time does nothing. */
+    close(): void
+}
+
+/**
+ * Load a raw BTF blob into the kernel, e.g. to create maps with
+ * typed keys and values (see [[MapDef.btf]]), which is needed for
+ * values holding a `struct bpf_spin_lock`.
+ * 
+ * If the kernel rejects the BTF, the thrown [[BPFError]]
+ * includes the verifier log in its `log` field.
+ * 
+ * Since Linux 4.18.
+ * 
+ * @param data Raw BTF (not an ELF file)
+ * @param options `logSize`: size of the verifier log buffer, in bytes
+ * @returns Reference to the loaded BTF
+ */
+export function loadBtf(data: Uint8Array, options?: { logSize?: number }): BtfRef {
+    const logBuf = Buffer.allocUnsafe(options?.logSize || DEFAULT_LOG_SIZE)
+    const status: number = native.loadBtf(data, logBuf)
+    if (status < 0) {
+        const error = new BPFError(-status, 'bpf_load_btf')
+        const end = logBuf.indexOf(0)
+        const log = logBuf.toString('utf8', 0, end === -1 ? logBuf.length : end)
+        if (log)
+            error.log = log
+        throw error
+    }
+    return new native.FDRef(status)
+}
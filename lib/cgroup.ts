@@ -0,0 +1,129 @@
+import * as fs from 'fs'
+import { native, FD } from './util'
+import { checkStatus } from './exception'
+import { AttachType, AttachFlags } from './constants'
+import { ProgramRef } from './program'
+import { LinkRef, createLinkRef } from './link'
+
+/**
+ * A cgroup, as the path of its directory in the cgroup v2
+ * hierarchy (i.e. `/sys/fs/cgroup/system.slice/foo.service`)
+ * or an open file descriptor of that directory.
+ */
+export type CgroupLike = string | FD
+
+function withCgroup<T>(cgroup: CgroupLike, fn: (fd: FD) => T): T {
+    if (typeof cgroup === 'number')
+        return fn(cgroup)
+    const fd = fs.openSync(cgroup, fs.constants.O_RDONLY | fs.constants.O_DIRECTORY)
+    try {
+        return fn(fd)
+    } finally {
+        fs.closeSync(fd)
+    }
+}
+
+export interface CgroupAttachOptions {
+    /** Attach flags, see [[AttachFlags]] */
+    flags?: number
+    /**
+     * Atomically replace this program (which must be attached
+     * with `ALLOW_MULTI`) instead of appending (since Linux 5.6)
+     */
+    replace?: ProgramRef
+}
+
+/**
+ * Attach a program to a cgroup. It applies to the processes
+ * (or sockets) in the cgroup and its descendants, until it's
+ * detached through [[detachCgroup]]: the attachment doesn't
+ * depend on any FD being kept open.
+ * 
+ * By default, only one program can be attached per cgroup and
+ * attach type (attaching replaces it) and descendant cgroups can't
+ * attach their own. Pass `ALLOW_MULTI` to have programs of all
+ * ancestors run, and to attach more than one program per cgroup.
+ * 
+ * Since Linux 4.10.
+ * 
+ * @param cgroup Target cgroup
+ * @param prog Program to attach
+ * @param attachType Attach type (i.e. `CGROUP_INET_INGRESS`)
+ * @param options Attach options
+ */
+export function attachCgroup(
+    cgroup: CgroupLike,
+    prog: ProgramRef,
+    attachType: AttachType,
+    options?: CgroupAttachOptions,
+): void {
+    let flags = options?.flags || 0
+    let replaceProgFd: FD | undefined
+    if (options?.replace !== undefined) {
+        flags |= AttachFlags.REPLACE
+        replaceProgFd = options.replace.fd
+    }
+    const status = withCgroup(cgroup, fd =>
+        native.progAttach(prog.fd, fd, attachType, { flags, replaceProgFd }))
+    checkStatus('bpf_prog_attach', status)
+}
+
+/**
+ * Detach a program from a cgroup.
+ * 
+ * @param cgroup Target cgroup
+ * @param attachType Attach type
+ * @param prog Program to detach (required if attached
+ * with `ALLOW_MULTI`, otherwise the current one is detached)
+ */
+export function detachCgroup(cgroup: CgroupLike, attachType: AttachType, prog?: ProgramRef): void {
+    const status = withCgroup(cgroup, fd =>
+        native.progDetach(fd, attachType, prog?.fd))
+    checkStatus(prog ? 'bpf_prog_detach2' : 'bpf_prog_detach', status)
+}
+
+export interface CgroupQueryResult {
+    /** Flags the programs were attached with, see [[AttachFlags]] */
+    attachFlags: number
+    /** IDs of the programs, in execution order (see [[openProgram]]) */
+    progIds: number[]
+}
+
+/**
+ * Query the programs attached to a cgroup.
+ * 
+ * Since Linux 4.15.
+ * 
+ * @param cgroup Target cgroup
+ * @param attachType Attach type
+ * @param flags Query flags, see [[QueryFlags]]. Pass `EFFECTIVE`
+ * to list the programs that actually run for the cgroup,
+ * including the ones inherited from its ancestors
+ */
+export function queryCgroup(cgroup: CgroupLike, attachType: AttachType, flags: number = 0): CgroupQueryResult {
+    const [ status, attachFlags, ids, count ] = withCgroup(cgroup, fd =>
+        native.progQuery(fd, attachType, flags))
+    checkStatus('bpf_prog_query', status)
+    return { attachFlags, progIds: Array.from((ids as Uint32Array).subarray(0, count)) }
+}
+
+/**
+ * Attach a program to a cgroup through a `bpf_link`. Unlike
+ * [[attachCgroup]], the program stays attached only while the
+ * link is open, so it's detached automatically if the process
+ * dies. It always behaves as if attached with `ALLOW_MULTI`,
+ * and can be replaced atomically through [[updateLink]].
+ * 
+ * Since Linux 5.7.
+ * 
+ * @param cgroup Target cgroup
+ * @param prog Program to attach
+ * @param attachType Attach type
+ * @returns [[LinkRef]] for the attachment
+ */
+export function attachCgroupLink(cgroup: CgroupLike, prog: ProgramRef, attachType: AttachType): LinkRef {
+    const status = withCgroup(cgroup, fd =>
+        native.linkCreate(prog.fd, fd, attachType, {}))
+    checkStatus('bpf_link_create', status)
+    return createLinkRef(status)
+}
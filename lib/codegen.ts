@@ -0,0 +1,348 @@
+import { Btf, BtfKind, BtfIntEncoding, BtfType, FieldLayout } from './btf'
+import { MapRef } from './map/common'
+
+export interface CodegenOptions {
+    /**
+     * Include the C declarations of each type in its doc comment, see
+     * [[Btf.dumpC]]. These include the types it depends on, which can be
+     * thousands of lines for kernel types (default: false)
+     */
+    declarations?: boolean
+}
+
+const PRELUDE: { [name: string]: string } = {
+    readString: `
+function readString(buf: Buffer, offset: number, length: number): string {
+    const data = buf.subarray(offset, offset + length)
+    const end = data.indexOf(0)
+    return data.toString('utf8', 0, end === -1 ? length : end)
+}
+`,
+    writeString: `
+function writeString(buf: Buffer, offset: number, length: number, value: string) {
+    buf.fill(0, offset, offset + length)
+    buf.write(value, offset, length)
+}
+`,
+    readBits: `
+function readBits(buf: Buffer, offset: number, bytes: number, shift: number, bits: number, signed: boolean): number {
+    const value = Math.floor(buf.readUIntLE(offset, bytes) / 2 ** shift) % 2 ** bits
+    return signed && value >= 2 ** (bits - 1) ? value - 2 ** bits : value
+}
+`,
+    writeBits: `
+function writeBits(buf: Buffer, offset: number, bytes: number, shift: number, bits: number, value: number) {
+    const old = buf.readUIntLE(offset, bytes)
+    const mask = 2 ** bits
+    const field = (Math.floor(old / 2 ** shift) % mask) * 2 ** shift
+    buf.writeUIntLE(old - field + (((value % mask) + mask) % mask) * 2 ** shift, offset, bytes)
+}
+`,
+}
+
+const pascalCase = (name: string) =>
+    name.split('_').filter(x => x).map(x => x[0].toUpperCase() + x.substr(1)).join('')
+
+const constantCase = (name: string) =>
+    name.replace(/([a-z0-9])([A-Z])/g, '$1_$2').toUpperCase()
+
+const docComment = (lines: string[], indent: string = '') =>
+    [ `${indent}/**`, ...lines.map(x => `${indent} * ${x}`), `${indent} */` ]
+
+class Generator {
+    private readonly names = new Map<number, string>()
+    private readonly used = new Set<string>()
+    private readonly queue: number[] = []
+    private readonly helpers = new Set<string>()
+    private depth = 0
+
+    constructor(readonly btf: Btf, readonly options: CodegenOptions) {}
+
+    private resolve(id: number): BtfType {
+        return this.btf.getType(this.btf.resolveType(id))
+    }
+
+    private isChar(t: BtfType): boolean {
+        return t.kind === BtfKind.INT && t.size === 1 &&
+            (!!(t.int!.encoding & BtfIntEncoding.CHAR) || /^(unsigned |signed )?char$/.test(t.name))
+    }
+
+    private isSigned(t: BtfType): boolean {
+        if (t.kind === BtfKind.ENUM)
+            return t.values!.some(x => x.value < 0)
+        return t.kind === BtfKind.INT && !!(t.int!.encoding & BtfIntEncoding.SIGNED)
+    }
+
+    /** TS name of a struct, union or enum, queuing it for generation */
+    name(id: number): string {
+        let name = this.names.get(id)
+        if (name === undefined) {
+            const t = this.btf.getType(id)
+            name = pascalCase(t.name) || `Anon${id}`
+            while (this.used.has(name))
+                name += BtfKind[t.kind][0] + BtfKind[t.kind].substr(1).toLowerCase()
+            this.used.add(name)
+            this.names.set(id, name)
+            this.queue.push(id)
+        }
+        return name
+    }
+
+    private tsType(id: number): string {
+        const t = this.resolve(id)
+        switch (t.kind) {
+        case BtfKind.INT:
+            if (t.int!.encoding & BtfIntEncoding.BOOL)
+                return 'boolean'
+            return t.size! > 8 ? 'Buffer' : t.size === 8 ? 'bigint' : 'number'
+        case BtfKind.ENUM:
+            return t.name ? this.name(t.id) : 'number'
+        case BtfKind.PTR:
+            return 'bigint'
+        case BtfKind.FLOAT:
+            return t.size! > 8 ? 'Buffer' : 'number'
+        case BtfKind.ARRAY:
+            if (this.isChar(this.resolve(t.array!.type)))
+                return 'string'
+            return `${this.tsType(t.array!.type)}[]`
+        case BtfKind.STRUCT:
+        case BtfKind.UNION:
+            return this.name(t.id)
+        }
+        throw new Error(`Unsupported type ${t.id} (${BtfKind[t.kind]} ${t.name})`)
+    }
+
+    private intAccessor(size: number, signed: boolean): string | undefined {
+        const sign = signed ? 'Int' : 'UInt'
+        return ({ 1: `${sign}8`, 2: `${sign}16LE`, 4: `${sign}32LE`, 8: `Big${sign}64LE` } as { [size: number]: string })[size]
+    }
+
+    private read(id: number, off: string): string {
+        const t = this.resolve(id)
+        const size = this.btf.sizeOf(t.id)
+        switch (t.kind) {
+        case BtfKind.INT:
+        case BtfKind.ENUM:
+        case BtfKind.PTR: {
+            if (t.kind === BtfKind.INT && t.int!.encoding & BtfIntEncoding.BOOL)
+                return `buf.readUInt8(${off}) !== 0`
+            const accessor = this.intAccessor(size, this.isSigned(t))
+            if (accessor === undefined)
+                break
+            const expr = `buf.read${accessor}(${off})`
+            if (t.kind === BtfKind.ENUM && size === 8)
+                return `Number(${expr})`
+            if (t.kind === BtfKind.PTR && size !== 8)
+                return `BigInt(${expr})`
+            return expr
+        }
+        case BtfKind.FLOAT:
+            if (size === 4 || size === 8)
+                return `buf.read${size === 4 ? 'Float' : 'Double'}LE(${off})`
+            break
+        case BtfKind.ARRAY: {
+            const { type, length } = t.array!
+            const elemSize = this.btf.sizeOf(type)
+            if (this.isChar(this.resolve(type))) {
+                this.helpers.add('readString')
+                return `readString(buf, ${off}, ${length})`
+            }
+            const i = `i${this.depth++}`
+            const elem = this.read(type, `${off} + ${i} * ${elemSize}`)
+            this.depth--
+            return `Array.from({ length: ${length} }, (_, ${i}) => ${elem})`
+        }
+        case BtfKind.STRUCT:
+        case BtfKind.UNION:
+            return `parse${this.name(t.id)}(buf, ${off})`
+        }
+        return `Buffer.from(buf.subarray(${off}, ${off} + ${size}))`
+    }
+
+    private write(id: number, value: string, off: string): string {
+        const t = this.resolve(id)
+        const size = this.btf.sizeOf(t.id)
+        switch (t.kind) {
+        case BtfKind.INT:
+        case BtfKind.ENUM:
+        case BtfKind.PTR: {
+            if (t.kind === BtfKind.INT && t.int!.encoding & BtfIntEncoding.BOOL)
+                return `buf.writeUInt8(${value} ? 1 : 0, ${off})`
+            const accessor = this.intAccessor(size, this.isSigned(t))
+            if (accessor === undefined)
+                break
+            if (t.kind === BtfKind.ENUM && size === 8)
+                value = `BigInt(${value})`
+            if (t.kind === BtfKind.PTR && size !== 8)
+                value = `Number(${value})`
+            return `buf.write${accessor}(${value}, ${off})`
+        }
+        case BtfKind.FLOAT:
+            if (size === 4 || size === 8)
+                return `buf.write${size === 4 ? 'Float' : 'Double'}LE(${value}, ${off})`
+            break
+        case BtfKind.ARRAY: {
+            const { type, length } = t.array!
+            const elemSize = this.btf.sizeOf(type)
+            if (this.isChar(this.resolve(type))) {
+                this.helpers.add('writeString')
+                return `writeString(buf, ${off}, ${length}, ${value})`
+            }
+            const i = `i${this.depth++}`
+            const elem = this.write(type, `${value}[${i}]`, `${off} + ${i} * ${elemSize}`)
+            this.depth--
+            return `for (let ${i} = 0; ${i} < Math.min(${length}, ${value}.length); ${i}++) ${elem}`
+        }
+        case BtfKind.STRUCT:
+        case BtfKind.UNION:
+            return `format${this.name(t.id)}(${value}, buf, ${off})`
+        }
+        return `${value}.copy(buf, ${off}, 0, ${size})`
+    }
+
+    private bitfield(f: FieldLayout) {
+        const t = this.resolve(f.type)
+        if ((t.kind !== BtfKind.INT && t.kind !== BtfKind.ENUM) || f.bitSize > 32)
+            throw new Error(`Unsupported bitfield ${f.name}`)
+        const shift = f.bitOffset % 8
+        return { shift, bytes: Math.ceil((shift + f.bitSize) / 8), signed: this.isSigned(t) }
+    }
+
+    private generateEnum(t: BtfType): string[] {
+        const name = this.names.get(t.id)!
+        return [
+            ...docComment([ `\`enum ${t.name}\`` ]),
+            `export enum ${name} {`,
+            ...t.values!.map(x => `    ${x.name} = ${x.value},`),
+            '}',
+        ]
+    }
+
+    private generateComposite(t: BtfType): string[] {
+        const name = this.names.get(t.id)!
+        const constant = constantCase(name)
+        const layout = this.btf.structLayout(t.id)
+        const kind = t.kind === BtfKind.STRUCT ? 'struct' : 'union'
+        const doc = [ `\`${kind} ${t.name || '(anonymous)'}\` (${layout.size} bytes)` ]
+        if (this.options.declarations && t.name)
+            doc.push('', '```c', ...this.btf.dumpC(t.id).replace(/\s+$/, '').split('\n'), '```')
+
+        // fields overlapping earlier ones (e.g. union members) are optional
+        let covered = 0
+        const fields = layout.fields.filter(f => f.name).map(f => {
+            const end = f.bitOffset + (f.bitSize || 8 * f.size)
+            const optional = f.bitOffset < covered
+            covered = Math.max(covered, end)
+            return { ...f, optional }
+        })
+
+        const lines = [ ...docComment(doc), `export interface ${name} {` ]
+        for (const f of fields)
+            lines.push(`    ${f.name}${f.optional ? '?' : ''}: ${f.bitSize ? 'number' : this.tsType(f.type)}`)
+        lines.push('}', '')
+
+        lines.push(`/** Size of [[${name}]], in bytes */`, `export const ${constant}_SIZE = ${layout.size}`, '')
+
+        lines.push(`/** Parse a [[${name}]] at \`offset\` of \`buf\` */`)
+        lines.push(`export function parse${name}(buf: Buffer, offset: number = 0): ${name} {`)
+        lines.push('    return {')
+        for (const f of fields) {
+            let expr: string
+            if (f.bitSize) {
+                const { shift, bytes, signed } = this.bitfield(f)
+                this.helpers.add('readBits')
+                expr = `readBits(buf, offset + ${f.offset}, ${bytes}, ${shift}, ${f.bitSize}, ${signed})`
+            } else {
+                expr = this.read(f.type, `offset + ${f.offset}`)
+            }
+            lines.push(`        ${f.name}: ${expr},`)
+        }
+        lines.push('    }', '}', '')
+
+        lines.push(`/** Write a [[${name}]] at \`offset\` of \`buf\` (a new buffer by default) */`)
+        lines.push(`export function format${name}(value: ${name}, buf: Buffer = Buffer.alloc(${layout.size}), offset: number = 0): Buffer {`)
+        for (const f of fields) {
+            let stmt: string
+            if (f.bitSize) {
+                const { shift, bytes } = this.bitfield(f)
+                this.helpers.add('writeBits')
+                stmt = `writeBits(buf, offset + ${f.offset}, ${bytes}, ${shift}, ${f.bitSize}, value.${f.name}${f.optional ? '!' : ''})`
+            } else {
+                stmt = this.write(f.type, `value.${f.name}${f.optional ? '!' : ''}`, `offset + ${f.offset}`)
+            }
+            if (f.optional)
+                lines.push(`    if (value.${f.name} !== undefined)`, `        ${stmt}`)
+            else
+                lines.push(`    ${stmt}`)
+        }
+        lines.push('    return buf', '}')
+        return lines
+    }
+
+    generate(types: (number | string)[]): string {
+        for (const type of types) {
+            const id = typeof type === 'number' ? this.btf.resolveType(type) :
+                (this.btf.findType(type, BtfKind.STRUCT) ?? this.btf.findType(type, BtfKind.UNION) ??
+                    this.btf.findType(type, BtfKind.ENUM) ?? this.btf.findType(type, BtfKind.TYPEDEF))
+            if (id === undefined)
+                throw new Error(`Type ${type} not found`)
+            const t = this.resolve(id)
+            if (![ BtfKind.STRUCT, BtfKind.UNION, BtfKind.ENUM ].includes(t.kind))
+                throw new Error(`Type ${type} isn't a struct, union or enum`)
+            this.name(t.id)
+        }
+        const blocks: string[][] = []
+        for (let i = 0; i < this.queue.length; i++) {
+            const t = this.btf.getType(this.queue[i])
+            blocks.push(t.kind === BtfKind.ENUM ? this.generateEnum(t) : this.generateComposite(t))
+        }
+        const prelude = Object.keys(PRELUDE).filter(x => this.helpers.has(x)).map(x => PRELUDE[x].trim())
+        return [
+            '// Generated from BTF by node_bpf, do not edit',
+            ...prelude,
+            ...blocks.map(x => x.join('\n')),
+        ].join('\n\n') + '\n'
+    }
+}
+
+/**
+ * Generate TypeScript declarations for BTF types: an interface for
+ * each struct and union, with `parse` and `format` functions that
+ * read and write it at fixed offsets (and a `SIZE` constant), and
+ * an enum for each enum. The types they reference are generated
+ * too. Run it ahead of time and save the result as a module.
+ * 
+ * Integers of 8 bytes and pointers become `bigint`, char arrays
+ * become strings, and members of unions (or of anonymous unions)
+ * that overlap earlier members are optional; `format` writes them
+ * only if present. The generated code assumes little endian.
+ * 
+ * @param btf BTF to take types from
+ * @param types Types to generate (IDs or names; typedefs are followed)
+ * @param options Generation options
+ * @returns TypeScript source
+ */
+export function generateTypeScript(btf: Btf, types: (number | string)[], options?: CodegenOptions): string {
+    return new Generator(btf, options || {}).generate(types)
+}
+
+/**
+ * Generate TypeScript declarations (see [[generateTypeScript]])
+ * for the key and value types of a map created with BTF, such as
+ * the maps of an object loaded through [[loadObject]].
+ * 
+ * Since Linux 4.18.
+ * 
+ * @param map Map to generate declarations for
+ * @param options Generation options
+ * @returns TypeScript source
+ */
+export function generateMapTypeScript(map: MapRef, options?: CodegenOptions): string {
+    if (!map.btfId)
+        throw new Error(`Map ${map.name || map.id} has no BTF`)
+    const btf = new Btf({ id: map.btfId })
+    const composite = [ BtfKind.STRUCT, BtfKind.UNION, BtfKind.ENUM ]
+    const types = [ map.btfKeyTypeId, map.btfValueTypeId ]
+        .filter(id => id && composite.includes(btf.getType(btf.resolveType(id)).kind)) as number[]
+    return generateTypeScript(btf, types, options)
+}
@@ -87,6 +87,15 @@ export enum AttachType {
     SK_SKB_VERDICT,    
 }
 
+export enum LinkType {
+    RAW_TRACEPOINT = 1,
+    TRACING,
+    CGROUP,
+    ITER,
+    NETNS,
+    XDP,
+}
+
 export enum MapType {
     /** [Hash](https://github.com/torvalds/linux/commit/0f8e4bd8a1fc8c4185f1630061d0a1f2d197a475) (since Linux 3.19) */
     HASH = 1,
@@ -207,3 +216,134 @@ export enum MapLookupFlags {
     /** spin_lock-ed operation (since Linux 5.1) */
     F_LOCK = 4,
 }
+
+/**
+ * Flags for XDP attachment.
+ * 
+ * Keep synchronized with `deps/libbpf/include/uapi/linux/if_link.h`.
+ */
+export enum XdpFlags {
+    /** Fail if a program is already attached */
+    UPDATE_IF_NOEXIST = (1 << 0),
+    /** Generic XDP, run by the kernel after the skb is allocated (since Linux 4.12) */
+    SKB_MODE = (1 << 1),
+    /** Native XDP, run by the driver (since Linux 4.12) */
+    DRV_MODE = (1 << 2),
+    /** Offloaded XDP, run by the NIC (since Linux 4.18) */
+    HW_MODE = (1 << 3),
+    /** Only replace the currently attached program if it's the expected one (since Linux 5.7) */
+    REPLACE = (1 << 4),
+}
+
+/**
+ * Flags for binding AF_XDP sockets.
+ * 
+ * Keep synchronized with `deps/libbpf/include/uapi/linux/if_xdp.h`.
+ */
+export enum XskBindFlags {
+    /** Share the UMEM of another socket */
+    SHARED_UMEM = (1 << 0),
+    /** Force copy mode */
+    COPY = (1 << 1),
+    /** Force zero-copy mode (fails if the driver doesn't support it) */
+    ZEROCOPY = (1 << 2),
+    /**
+     * Only process the TX and fill rings when woken up (see
+     * [[XdpSocket.needsWakeup]]), which saves CPU (since Linux 5.4)
+     */
+    USE_NEED_WAKEUP = (1 << 3),
+}
+
+/** Mode a network device's XDP program is attached in */
+export enum XdpAttachMode {
+    NONE = 0,
+    DRV,
+    SKB,
+    HW,
+    /** Programs attached in more than one mode */
+    MULTI,
+}
+
+/**
+ * TC hook attach points.
+ * 
+ * Keep synchronized with `deps/libbpf/src/libbpf.h`.
+ */
+export enum TcAttachPoint {
+    /** Ingress of the `clsact` qdisc */
+    INGRESS = (1 << 0),
+    /** Egress of the `clsact` qdisc */
+    EGRESS = (1 << 1),
+    /** Custom parent qdisc, specified by [[TcHook.parent]] */
+    CUSTOM = (1 << 2),
+}
+
+/** Flags for attaching programs through `BPF_PROG_ATTACH` (i.e. to cgroups) */
+export enum AttachFlags {
+    /**
+     * Allow programs attached to descendant cgroups to override
+     * this one (since Linux 4.10; by default, attaching to a
+     * descendant of a cgroup with a program attached fails)
+     */
+    ALLOW_OVERRIDE = (1 << 0),
+    /**
+     * Allow multiple programs to be attached at the same time,
+     * running in attach order, after the ones of descendant
+     * cgroups (since Linux 4.15)
+     */
+    ALLOW_MULTI = (1 << 1),
+    /** Replace a specific attached program, instead of adding another one (since Linux 5.6) */
+    REPLACE = (1 << 2),
+}
+
+/** Flags for querying attached programs */
+export enum QueryFlags {
+    /** Report the effective programs (including inherited ones), instead of the attached ones */
+    EFFECTIVE = (1 << 0),
+}
+
+/**
+ * Types of perf events (`perf_type_id`).
+ * 
+ * Keep synchronized with `linux/perf_event.h`.
+ */
+export enum PerfType {
+    /** Generic hardware events, see [[PerfHwId]] */
+    HARDWARE = 0,
+    /** Software events, see [[PerfSwId]] */
+    SOFTWARE,
+    TRACEPOINT,
+    HW_CACHE,
+    RAW,
+    BREAKPOINT,
+}
+
+/** Generic hardware events (`perf_hw_id`), these need PMU support */
+export enum PerfHwId {
+    CPU_CYCLES = 0,
+    INSTRUCTIONS,
+    CACHE_REFERENCES,
+    CACHE_MISSES,
+    BRANCH_INSTRUCTIONS,
+    BRANCH_MISSES,
+    BUS_CYCLES,
+    STALLED_CYCLES_FRONTEND,
+    STALLED_CYCLES_BACKEND,
+    REF_CPU_CYCLES,
+}
+
+/** Software events (`perf_sw_ids`), available everywhere */
+export enum PerfSwId {
+    /** High-resolution per-CPU timer, the usual choice for sampling */
+    CPU_CLOCK = 0,
+    TASK_CLOCK,
+    PAGE_FAULTS,
+    CONTEXT_SWITCHES,
+    CPU_MIGRATIONS,
+    PAGE_FAULTS_MIN,
+    PAGE_FAULTS_MAJ,
+    ALIGNMENT_FAULTS,
+    EMULATION_FAULTS,
+    DUMMY,
+    BPF_OUTPUT,
+}
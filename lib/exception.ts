@@ -64,6 +64,8 @@ export class BPFError extends Error {
     errno: number | LibbpfErrno
     code?: string
     count?: number
+    /** Verifier log, if the operation was a failed program or BTF load */
+    log?: string
 
     constructor(errno: number, operation: string, count?: number) {
         const code = BPFError.getCode(errno)
@@ -1,7 +1,29 @@
-export { version, versions } from './util'
-export { ProgramType, MapType, AttachType, MapFlags, MapUpdateFlags, MapLookupFlags, OBJ_NAME_LEN } from './constants'
+export { version, versions, ifNameToIndex, numPossibleCpus } from './util'
+export { ProgramType, MapType, AttachType, LinkType, MapFlags, MapUpdateFlags, MapLookupFlags, XdpFlags, XdpAttachMode, XskBindFlags, TcAttachPoint, AttachFlags, QueryFlags, PerfType, PerfHwId, PerfSwId, OBJ_NAME_LEN } from './constants'
 export { LibbpfErrno, BPFError, libbpfErrnoMessages } from './exception'
-export { MapDef, MapInfo, MapRef, createMap, createMapRef, openMap, TypeConversion, u32type, objGet } from './map/common'
+export { MapDef, MapInfo, MapRef, createMap, createMapRef, openMap, TypeConversion, u32type, objGet, objPin } from './map/common'
 export { IMap, RawMap, ConvMap } from './map/map'
 export { IQueueMap, RawQueueMap, ConvQueueMap, createQueueMap, createStackMap } from './map/queue'
+export { SockMap, SOCKET_TUPLE_SIZE, socketTuple, spliceVerdictProgram, streamParserProgram, createSockMap, createSockHash } from './map/sock'
+export { ProgArrayMap, createProgArrayMap } from './map/prog'
+export { CpuMapEntry, CpuMap, DevMapEntry, DevMap, createCpuMap, createDevMap } from './map/redirect'
+export { StackBuildIdStatus, BuildIdFrame, StackBatch, StackTraceMap, parseBuildIdFrames, createStackTraceMap } from './map/stack'
 export { IArrayMap, RawArrayMap, ConvArrayMap, createArrayMap } from './map/array'
+export { INSN_SIZE, ProgramDef, ProgramDefOptional, ProgramInfo, ProgramRef, loadProgram, createProgramRef, openProgram, findVmlinuxBtfId, getProgramMaps } from './program'
+export { LinkRef, LinkInfo, KprobeOptions, UprobeOptions, PerfEventAttr, PerfEventOptions, TracepointField, getLinkInfo, updateLink, migrateLink, attachKprobe, attachUprobe, attachTracepoint, tracepointFormat, attachPerfEvent, attachRawTracepoint } from './link'
+export { IterOptions, ReadIterOptions, attachIter, readIter, readIterAll } from './iter'
+export { XdpOptions, XdpInfo, attachXdp, detachXdp, getXdpInfo, attachXdpLink } from './xdp'
+export { TcFilterId, TcFilter, TcAttachOptions, TcHook, attachTcBulk } from './tc'
+export { SocketLike, getSocketFd, attachSocketFilter, detachSocketFilter } from './socket'
+export { Assembler, Reg, InsnClass, Size, AluOp, JmpOp, Helper } from './asm'
+export { ReuseportMaps, ReuseportGroup, reuseportProgram, attachReuseport, detachReuseport, bindReuseport } from './reuseport'
+export { CgroupLike, CgroupAttachOptions, CgroupQueryResult, attachCgroup, detachCgroup, queryCgroup, attachCgroupLink } from './cgroup'
+export { XdpSocketOptions, XdpDesc, XdpSocketStatistics, XdpPollEvents, XdpSocket } from './xsk'
+export { NO_SYMBOL, KernelSymbol, ResolvedSymbol, SymbolBatch, KernelSymbolizerOptions, KernelSymbolizer, formatSymbol, ElfSymbol, ElfSymbols, ResolvedUserSymbol, ProcessMapping, readProcessMappings, UserSymbolizer } from './symbolize'
+export { SAMPLE_KEY_SIZE, StackSampleMaps, StackSampleOptions, SamplingOptions, StackSample, FoldOptions, ProfilerOptions, OffCpuMaps, OffCpuFilter, OffCpuProfilerOptions, SchedSwitchOffsets, stackSampleProgram, schedSwitchOffsets, offCpuProgram, attachSampling, foldStackCounts, Profiler, OffCpuProfiler } from './profile'
+export { LOG2_SLOTS, LatencyMaps, FunctionLocation, LatencyHistogram, EventLoopProfilerOptions, UV_PHASES, latencyPrograms, findProcessFunctions, histogramPercentile, EventLoopProfiler } from './latency'
+export { UsdtArgKind, UsdtArgument, UsdtProbe, parseUsdtArguments, readUsdtProbes, findUsdtProbe, fetchUsdtArgument, attachUsdt } from './usdt'
+export { VMLINUX_BTF_PATH, BtfKind, BtfIntEncoding, BtfMember, BtfType, FieldLayout, StructLayout, Btf, BtfRef, loadBtf } from './btf'
+export { LayoutCacheOptions, kernelBuildId, vmlinuxBtfKey, LayoutCache } from './layouts'
+export { BtfSource, findArchivedBtf, TargetBtfCache, defaultBtfCache, ObjectLoadOptions, LoadedObject, loadObject } from './object'
+export { CodegenOptions, generateTypeScript, generateMapTypeScript } from './codegen'
@@ -0,0 +1,98 @@
+import * as fs from 'fs'
+import { promisify } from 'util'
+import { native } from './util'
+import { checkStatus } from './exception'
+import { AttachType } from './constants'
+import { MapRef } from './map/common'
+import { ProgramRef } from './program'
+import { LinkRef, createLinkRef } from './link'
+
+const read = promisify(fs.read)
+
+/** Default size of the chunks read from an iterator */
+const DEFAULT_CHUNK_SIZE = 1 << 18
+
+export interface IterOptions {
+    /** For `bpf_map_elem` iterators: the map to iterate over (since Linux 5.9) */
+    map?: MapRef
+}
+
+export interface ReadIterOptions {
+    /**
+     * Size of each read, in bytes. Chunks may be smaller
+     * (the kernel stops at object boundaries).
+     */
+    chunkSize?: number
+}
+
+/**
+ * Attach an iterator program (`TRACING` with expected attach
+ * type `TRACE_ITER`). The returned link can then be used to
+ * create any number of iterator instances through [[readIter]].
+ * 
+ * To load the program, use [[findVmlinuxBtfId]] with the
+ * iterator target (i.e. `'task'`, `'tcp'`, `'bpf_map_elem'`)
+ * to obtain the `attachBtfId`.
+ * 
+ * Since Linux 5.8.
+ * 
+ * @param prog Program to attach
+ * @param options Target options
+ * @returns [[LinkRef]] for the attachment
+ */
+export function attachIter(prog: ProgramRef, options?: IterOptions): LinkRef {
+    let iterInfo: Uint8Array | undefined
+    if (options?.map !== undefined)
+        iterInfo = new Uint8Array(Uint32Array.of(options.map.fd).buffer)
+    const status = native.linkCreate(prog.fd, 0, AttachType.TRACE_ITER, { iterInfo })
+    checkStatus('bpf_link_create', status)
+    return createLinkRef(status)
+}
+
+/**
+ * Create a new iterator instance from an iterator link, and read
+ * all of its output. Reads happen in the libuv thread pool, in large
+ * chunks, so the event loop isn't blocked while the kernel runs the
+ * program over the objects.
+ * 
+ * The iterator is closed when the generator finishes (or is
+ * returned early).
+ * 
+ * Since Linux 5.8.
+ * 
+ * @param link Link returned by [[attachIter]]
+ * @param options Read options
+ * @returns Async iterator yielding the output chunks
+ */
+export async function* readIter(link: LinkRef, options?: ReadIterOptions): AsyncIterableIterator<Buffer> {
+    const chunkSize = options?.chunkSize || DEFAULT_CHUNK_SIZE
+    const status = native.iterCreate(link.fd)
+    checkStatus('bpf_iter_create', status)
+    const ref = new native.FDRef(status)
+    try {
+        while (true) {
+            const buf = Buffer.allocUnsafe(chunkSize)
+            const { bytesRead } = await read(ref.fd, buf, 0, chunkSize, null)
+            if (bytesRead === 0)
+                return
+            yield buf.subarray(0, bytesRead)
+        }
+    } finally {
+        ref.close()
+    }
+}
+
+/**
+ * Convenience function that collects the output of [[readIter]]
+ * into a single `Buffer`.
+ * 
+ * @param link Link returned by [[attachIter]]
+ * @param options Read options
+ * @returns Full iterator output
+ */
+export async function readIterAll(link: LinkRef, options?: ReadIterOptions): Promise<Buffer> {
+    const chunks: Buffer[] = []
+    for await (const chunk of readIter(link, options))
+        chunks.push(chunk)
+    return Buffer.concat(chunks)
+}
@@ -0,0 +1,338 @@
+import { constants } from 'os'
+import { realpathSync } from 'fs'
+import { basename } from 'path'
+import { native, asUint8Array } from './util'
+import { checkStatus } from './exception'
+import { MapType, ProgramType } from './constants'
+import { MapRef, createMap } from './map/common'
+import { ProgramRef, loadProgram } from './program'
+import { attachUprobe } from './link'
+import { Assembler, Reg, Size, JmpOp, AluOp, Helper } from './asm'
+import { ElfSymbols, readProcessMappings } from './symbolize'
+const { ENOENT, EINVAL } = constants.errno
+
+const BPF_ANY = 0
+
+/** Number of slots of the log2 histograms kept by [[latencyPrograms]] */
+export const LOG2_SLOTS = 64
+
+/** Maps used by [[latencyPrograms]] */
+export interface LatencyMaps {
+    /**
+     * `HASH` map holding the start time (`u64`) of the calls in
+     * progress, keyed by thread ID (`u32`) and phase (`u32`)
+     */
+    start: MapRef
+    /**
+     * `ARRAY` map holding a log2 histogram of call durations for
+     * each phase: [[LOG2_SLOTS]] `u64` counts per phase, where
+     * slot `i` counts calls that took `[2^i, 2^(i+1))` nanoseconds
+     */
+    histograms: MapRef
+}
+
+/**
+ * Build the `KPROBE` programs that measure the duration of calls
+ * to a function, to be attached as a uprobe and a uretprobe on it.
+ * The entry program records the time for the current thread, and
+ * the return program adds the elapsed time to the phase's
+ * histogram. The function must not be recursive.
+ * 
+ * @param maps Maps to use
+ * @param phase Index of the histogram to use
+ * @returns Entry and return programs bytecode
+ */
+export function latencyPrograms(maps: LatencyMaps, phase: number): { entry: Buffer, exit: Buffer } {
+    const entry = new Assembler()
+        .call(Helper.GET_CURRENT_PID_TGID)
+        .stxMem(Size.W, Reg.R10, Reg.R0, -8)
+        .stMem(Size.W, Reg.R10, -4, phase)
+        .call(Helper.KTIME_GET_NS)
+        .stxMem(Size.DW, Reg.R10, Reg.R0, -16)
+        .ldMapFd(Reg.R1, maps.start.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, -8)
+        .movReg(Reg.R3, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R3, -16)
+        .movImm(Reg.R4, BPF_ANY)
+        .call(Helper.MAP_UPDATE_ELEM)
+        .movImm(Reg.R0, 0)
+        .exit()
+        .build()
+
+    const asm = new Assembler()
+        .call(Helper.GET_CURRENT_PID_TGID)
+        .stxMem(Size.W, Reg.R10, Reg.R0, -8)
+        .stMem(Size.W, Reg.R10, -4, phase)
+        .ldMapFd(Reg.R1, maps.start.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, -8)
+        .call(Helper.MAP_LOOKUP_ELEM)
+        .jmpImm(JmpOp.JEQ, Reg.R0, 0, 'out')
+        .movReg(Reg.R7, Reg.R0)
+        .call(Helper.KTIME_GET_NS)
+        .ldxMem(Size.DW, Reg.R1, Reg.R7, 0)
+        .aluReg(AluOp.SUB, Reg.R0, Reg.R1)
+        .movReg(Reg.R6, Reg.R0)
+        .ldMapFd(Reg.R1, maps.start.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, -8)
+        .call(Helper.MAP_DELETE_ELEM)
+    // R8 = log2(R6), by halving the remaining width each step
+    asm.movImm(Reg.R8, 0)
+    for (const bits of [ 32, 16, 8, 4, 2, 1 ]) {
+        asm.movReg(Reg.R1, Reg.R6)
+            .aluImm(AluOp.RSH, Reg.R1, bits)
+            .jmpImm(JmpOp.JEQ, Reg.R1, 0, `log2_${bits}`)
+            .movReg(Reg.R6, Reg.R1)
+            .aluImm(AluOp.ADD, Reg.R8, bits)
+            .label(`log2_${bits}`)
+    }
+    const exit = asm
+        .aluImm(AluOp.ADD, Reg.R8, phase * LOG2_SLOTS)
+        .stxMem(Size.W, Reg.R10, Reg.R8, -20)
+        .ldMapFd(Reg.R1, maps.histograms.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, -20)
+        .call(Helper.MAP_LOOKUP_ELEM)
+        .jmpImm(JmpOp.JEQ, Reg.R0, 0, 'out')
+        .movImm(Reg.R1, 1)
+        .atomicAdd(Size.DW, Reg.R0, Reg.R1, 0)
+        .label('out')
+        .movImm(Reg.R0, 0)
+        .exit()
+        .build()
+
+    return { entry, exit }
+}
+
+/** Location of a function in a process, see [[findProcessFunctions]] */
+export interface FunctionLocation {
+    /** Path of the ELF file (accessible from this process) */
+    path: string
+    /** File offset of the function, to attach uprobes */
+    fileOffset: number
+}
+
+/**
+ * Find functions in the main executable of a process, or in the
+ * libraries it maps whose name starts with one of `libraries`.
+ * The executable and libraries need to have symbols.
+ * 
+ * @param pid Process ID
+ * @param names Function names
+ * @param libraries Prefixes of library file names to search
+ * @returns Location of each function (`undefined` if not found)
+ */
+export function findProcessFunctions(pid: number, names: string[], libraries: string[] = []): (FunctionLocation | undefined)[] {
+    const root = `/proc/${pid}/root`
+    const exe = realpathSync(`/proc/${pid}/exe`)
+    const paths = new Set([ exe ])
+    for (const { path } of readProcessMappings(pid))
+        if (libraries.some(prefix => basename(path).startsWith(prefix)))
+            paths.add(path)
+
+    const result: (FunctionLocation | undefined)[] = names.map(() => undefined)
+    for (const path of paths) {
+        const file = new ElfSymbols(root + path)
+        names.forEach((name, i) => {
+            const sym = result[i] === undefined && file.findSymbol(name)
+            if (sym)
+                result[i] = { path: root + path, fileOffset: sym.fileOffset }
+        })
+        if (result.every(x => x !== undefined))
+            break
+    }
+    return result
+}
+
+/**
+ * libuv functions running each phase of an event loop turn.
+ * Some are usually inlined, and won't be found.
+ */
+export const UV_PHASES = [
+    'uv__run_timers',
+    'uv__run_pending',
+    'uv__run_idle',
+    'uv__run_prepare',
+    'uv__io_poll',
+    'uv__run_check',
+    'uv__run_closing_handles',
+]
+
+/** Duration histogram of a phase, see [[EventLoopProfiler.read]] */
+export interface LatencyHistogram {
+    /** Slot `i` counts calls that took `[2^i, 2^(i+1))` nanoseconds */
+    counts: number[]
+    /** Total number of calls */
+    total: number
+}
+
+/**
+ * Estimate a percentile from a log2 histogram.
+ * 
+ * @param hist Histogram
+ * @param p Percentile, from 0 to 100
+ * @returns Upper bound of the slot the percentile falls in,
+ * in nanoseconds (zero if the histogram is empty)
+ */
+export function histogramPercentile(hist: LatencyHistogram, p: number): number {
+    let remaining = hist.total * p / 100
+    for (let i = 0; i < hist.counts.length; i++) {
+        remaining -= hist.counts[i]
+        if (remaining <= 0 && hist.counts[i] > 0)
+            return 2 ** (i + 1)
+    }
+    return 0
+}
+
+export interface EventLoopProfilerOptions {
+    /** Process to measure (default: this one) */
+    pid?: number
+    /** Functions to measure (default: [[UV_PHASES]]) */
+    functions?: string[]
+    /**
+     * Prefixes of library file names to search the functions in,
+     * besides the main executable (default: `libuv` and `libnode`,
+     * for Node builds linked against them)
+     */
+    libraries?: string[]
+}
+
+/**
+ * Measures how long each phase of a Node (libuv) event loop takes,
+ * through uprobes on the libuv functions running them, keeping
+ * log2 histograms of their durations in-kernel (see
+ * [[latencyPrograms]]). This attributes long event loop turns
+ * to a phase (e.g. timers or I/O callbacks) at a low cost.
+ * 
+ * Reading the histograms takes a single syscall (on Linux 5.6+),
+ * so it barely perturbs the event loop, even when measuring
+ * this same process. Note that `uv__io_poll` includes the time
+ * spent waiting for I/O, and that event loops of worker threads
+ * are measured too.
+ * 
+ * Since Linux 4.17 (requires the `uprobe` PMU).
+ */
+export class EventLoopProfiler {
+    /** Functions being measured */
+    readonly phases: string[]
+    /** Functions that weren't found (e.g. because they are inlined) */
+    readonly missing: string[]
+    readonly maps: LatencyMaps
+    private readonly refs: { close(): void }[]
+    private readonly keys: Buffer
+    private readonly values: Buffer
+    private readonly batchOut = Buffer.alloc(4)
+    private batchSupported = true
+
+    /**
+     * Find the functions, load the programs and attach them.
+     * 
+     * @param options Profiler options
+     */
+    constructor(options?: EventLoopProfilerOptions) {
+        const pid = options?.pid === undefined ? process.pid : options.pid
+        const functions = options?.functions || UV_PHASES
+        const locations = findProcessFunctions(pid, functions, options?.libraries || [ 'libuv', 'libnode' ])
+        this.phases = functions.filter((_, i) => locations[i] !== undefined)
+        this.missing = functions.filter((_, i) => locations[i] === undefined)
+        if (!this.phases.length)
+            throw new Error(`None of the functions were found: ${functions.join(', ')}`)
+
+        const refs: { close(): void }[] = []
+        try {
+            const start = createMap({
+                type: MapType.HASH,
+                keySize: 8,
+                valueSize: 8,
+                maxEntries: 4096,
+            })
+            refs.push(start)
+            const histograms = createMap({
+                type: MapType.ARRAY,
+                keySize: 4,
+                valueSize: 8,
+                maxEntries: this.phases.length * LOG2_SLOTS,
+            })
+            refs.push(histograms)
+            const maps = { start, histograms }
+            this.phases.forEach((name, phase) => {
+                const { path, fileOffset } = locations[functions.indexOf(name)]!
+                const { entry, exit } = latencyPrograms(maps, phase)
+                for (const [ insns, retprobe ] of [ [ entry, false ], [ exit, true ] ] as [Buffer, boolean][]) {
+                    const prog: ProgramRef = loadProgram({ type: ProgramType.KPROBE, insns, license: 'GPL' })
+                    refs.push(prog)
+                    refs.push(attachUprobe(prog, path, fileOffset, { pid, retprobe }))
+                }
+            })
+            this.maps = maps
+            this.refs = refs
+        } catch (e) {
+            refs.reverse().forEach(x => x.close())
+            throw e
+        }
+        this.keys = Buffer.alloc(4 * this.maps.histograms.maxEntries)
+        this.values = Buffer.alloc(8 * this.maps.histograms.maxEntries)
+    }
+
+    private readValues(): Buffer {
+        const length = this.maps.histograms.maxEntries
+        if (this.batchSupported) {
+            const [ status ] = native.mapLookupBatch(this.maps.histograms.fd,
+                undefined, this.batchOut, this.keys, this.values, length, {})
+            if (status === 0 || status === -ENOENT)
+                return this.values
+            if (status !== -EINVAL)
+                checkStatus('bpf_map_lookup_batch', status)
+            // batch operations need Linux 5.6
+            this.batchSupported = false
+        }
+        for (let i = 0; i < length; i++) {
+            const status = native.mapLookupElem(this.maps.histograms.fd,
+                asUint8Array(Uint32Array.of(i)), this.values.subarray(8 * i, 8 * (i + 1)), 0)
+            checkStatus('bpf_map_lookup_elem_flags', status)
+        }
+        return this.values
+    }
+
+    /**
+     * Read the histograms of every phase.
+     * 
+     * @returns Histogram of each function in [[phases]]
+     */
+    read(): { [phase: string]: LatencyHistogram } {
+        const values = this.readValues()
+        const result: { [phase: string]: LatencyHistogram } = {}
+        this.phases.forEach((name, phase) => {
+            const counts = Array.from({ length: LOG2_SLOTS }, (_, i) =>
+                Number(values.readBigUInt64LE(8 * (phase * LOG2_SLOTS + i))))
+            result[name] = { counts, total: counts.reduce((a, b) => a + b, 0) }
+        })
+        return result
+    }
+
+    /** Reset the histograms */
+    reset(): void {
+        const length = this.maps.histograms.maxEntries
+        const keys = asUint8Array(Uint32Array.from({ length }, (_, i) => i))
+        const zero = Buffer.alloc(8 * length)
+        if (this.batchSupported) {
+            const [ status ] = native.mapUpdateBatch(this.maps.histograms.fd, keys, zero, length, {})
+            if (status !== -EINVAL)
+                return checkStatus('bpf_map_update_batch', status)
+            this.batchSupported = false
+        }
+        for (let i = 0; i < length; i++) {
+            const status = native.mapUpdateElem(this.maps.histograms.fd,
+                keys.subarray(4 * i, 4 * (i + 1)), zero.subarray(0, 8), 0)
+            checkStatus('bpf_map_update_elem', status)
+        }
+    }
+
+    /** Detach the probes and release the maps */
+    close(): void {
+        this.refs.reverse().forEach(x => x.close())
+        this.refs.length = 0
+    }
+}
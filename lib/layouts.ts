@@ -0,0 +1,302 @@
+import { readFileSync, writeFileSync, renameSync, statSync, mkdirSync, unlinkSync } from 'fs'
+import { dirname } from 'path'
+import { versions } from './util'
+import { Btf, BtfKind, StructLayout, FieldLayout, VMLINUX_BTF_PATH } from './btf'
+
+const MAGIC = 0x434c424e // 'NBLC'
+const FORMAT_VERSION = 1
+const HEADER_SIZE = 16
+const NT_GNU_BUILD_ID = 3
+
+/**
+ * Build ID of the running kernel, from `/sys/kernel/notes`.
+ * 
+ * @returns Build ID (hex), or `undefined` if it's not available
+ */
+export function kernelBuildId(): string | undefined {
+    let notes: Buffer
+    try {
+        notes = readFileSync('/sys/kernel/notes')
+    } catch (e) {
+        return undefined
+    }
+    const align = (x: number) => (x + 3) & ~3
+    for (let pos = 0; pos + 12 <= notes.length;) {
+        const nameSize = notes.readUInt32LE(pos), descSize = notes.readUInt32LE(pos + 4)
+        const type = notes.readUInt32LE(pos + 8)
+        const name = notes.toString('latin1', pos + 12, pos + 12 + nameSize)
+        const desc = pos + 12 + align(nameSize)
+        if (type === NT_GNU_BUILD_ID && name === 'GNU\0')
+            return notes.toString('hex', desc, desc + descSize)
+        pos = desc + align(descSize)
+    }
+    return undefined
+}
+
+/**
+ * Key identifying the running kernel's BTF: kernel release,
+ * build ID and BTF size. Layouts cached under a different key
+ * are discarded.
+ */
+export function vmlinuxBtfKey(): string {
+    let size = 0
+    try {
+        size = statSync(VMLINUX_BTF_PATH).size
+    } catch (e) {
+        // no BTF, the cache will only be useful with a custom one
+    }
+    return `${versions.kernel}:${kernelBuildId() || ''}:${size}`
+}
+
+function checksum(buf: Buffer, start: number): number {
+    let h = 0x811c9dc5 // FNV-1a
+    for (let i = start; i < buf.length; i++)
+        h = Math.imul(h ^ buf[i], 0x01000193)
+    return h >>> 0
+}
+
+class Writer {
+    private buf = Buffer.alloc(4096)
+    length = 0
+
+    private reserve(n: number) {
+        if (this.length + n > this.buf.length) {
+            const old = this.buf
+            this.buf = Buffer.alloc(Math.max(old.length * 2, this.length + n))
+            old.copy(this.buf)
+        }
+    }
+    u32(x: number): this {
+        this.reserve(4)
+        this.buf.writeUInt32LE(x >>> 0, this.length)
+        this.length += 4
+        return this
+    }
+    str(s: string): this {
+        const bytes = Buffer.from(s)
+        this.u32(bytes.length)
+        this.reserve(bytes.length + 3)
+        bytes.copy(this.buf, this.length)
+        this.length = (this.length + bytes.length + 3) & ~3
+        return this
+    }
+    field(f: FieldLayout): this {
+        return this.str(f.name).u32(f.type).u32(f.offset).u32(f.size).u32(f.bitOffset).u32(f.bitSize)
+    }
+    finish(): Buffer {
+        return this.buf.subarray(0, this.length)
+    }
+}
+
+class Reader {
+    constructor(readonly buf: Buffer, public pos: number) {}
+
+    u32(): number {
+        const x = this.buf.readUInt32LE(this.pos)
+        this.pos += 4
+        return x
+    }
+    str(): string {
+        const length = this.u32()
+        if (this.pos + length > this.buf.length)
+            throw new RangeError('String out of bounds')
+        const s = this.buf.toString('utf8', this.pos, this.pos + length)
+        this.pos = (this.pos + length + 3) & ~3
+        return s
+    }
+    field(): FieldLayout {
+        const name = this.str()
+        const [ type, offset, size, bitOffset, bitSize ] = [ this.u32(), this.u32(), this.u32(), this.u32(), this.u32() ]
+        return { name, type, offset, size, bitOffset, bitSize }
+    }
+}
+
+export interface LayoutCacheOptions {
+    /**
+     * Key of the BTF the layouts come from (default: [[vmlinuxBtfKey]]).
+     * Pass a different one when using a custom `btf`.
+     */
+    key?: string
+    /**
+     * Function returning the BTF to resolve missing layouts from,
+     * called on the first miss (default: [[Btf.vmlinux]])
+     */
+    btf?: () => Btf
+}
+
+/**
+ * On-disk cache of struct and field layouts resolved from BTF
+ * (see [[Btf.structLayout]] and [[Btf.fieldLayout]]), so that
+ * programs starting again on the same kernel don't need to load
+ * and walk its BTF at all.
+ * 
+ * The file holds a header (magic, format version, checksum),
+ * the BTF key, and a flat list of records (layouts with their
+ * fields) that is indexed on open and decoded on first use.
+ * If the file is missing, corrupted or was written for another
+ * kernel, it's ignored and rewritten by [[save]].
+ */
+export class LayoutCache {
+    /** Path of the cache file */
+    readonly path: string
+    /** Key of the BTF the layouts come from */
+    readonly key: string
+    /** Whether valid layouts were read from the file */
+    readonly loaded: boolean
+    private readonly loadBtf: () => Btf
+    private btf?: Btf
+    private readonly buf?: Buffer
+    /** record offsets of the file, by record key */
+    private readonly offsets = new Map<string, number>()
+    private readonly structs = new Map<string, StructLayout>()
+    private readonly fields = new Map<string, FieldLayout>()
+    private dirty = false
+
+    /**
+     * Open a cache file (it's not kept open).
+     * 
+     * @param path Cache file path
+     * @param options Cache options
+     */
+    constructor(path: string, options?: LayoutCacheOptions) {
+        this.path = path
+        this.key = options?.key ?? vmlinuxBtfKey()
+        this.loadBtf = options?.btf || Btf.vmlinux
+        let buf: Buffer | undefined
+        try {
+            buf = readFileSync(path)
+        } catch (e) {
+            // no cache yet
+        }
+        this.loaded = buf !== undefined && this.index(buf)
+        if (this.loaded)
+            this.buf = buf
+        else
+            this.offsets.clear()
+        this.dirty = !this.loaded
+    }
+
+    private index(buf: Buffer): boolean {
+        try {
+            if (buf.length < HEADER_SIZE || buf.readUInt32LE(0) !== MAGIC ||
+                    buf.readUInt32LE(4) !== FORMAT_VERSION || buf.readUInt32LE(8) !== checksum(buf, HEADER_SIZE))
+                return false
+            const reader = new Reader(buf, HEADER_SIZE)
+            if (reader.str() !== this.key)
+                return false
+            const count = reader.u32()
+            for (let i = 0; i < count; i++) {
+                const key = reader.str()
+                const length = reader.u32()
+                this.offsets.set(key, reader.pos)
+                reader.pos += length
+            }
+            return reader.pos === buf.length
+        } catch (e) {
+            if (e instanceof RangeError)
+                return false
+            throw e
+        }
+    }
+
+    private getBtf(): Btf {
+        if (this.btf === undefined)
+            this.btf = this.loadBtf()
+        return this.btf
+    }
+
+    /** Number of cached layouts */
+    get size(): number {
+        return new Set([ ...this.offsets.keys(), ...this.structs.keys(), ...this.fields.keys() ]).size
+    }
+
+    /**
+     * Get the layout of a struct or union, see [[Btf.structLayout]].
+     * 
+     * @param name Struct name
+     * @returns Layout
+     */
+    structLayout(name: string): StructLayout {
+        const key = `struct:${name}`
+        let layout = this.structs.get(key)
+        if (layout !== undefined)
+            return layout
+        const offset = this.offsets.get(key)
+        if (offset !== undefined) {
+            const reader = new Reader(this.buf!, offset)
+            const [ id, kind, size, count ] = [ reader.u32(), reader.u32(), reader.u32(), reader.u32() ]
+            const fields = Array.from({ length: count }, () => reader.field())
+            layout = { id, kind: kind as BtfKind.STRUCT | BtfKind.UNION, name, size, fields }
+        } else {
+            layout = this.getBtf().structLayout(name)
+            this.dirty = true
+        }
+        this.structs.set(key, layout)
+        return layout
+    }
+
+    /**
+     * Locate a (possibly nested) field of a struct or union,
+     * see [[Btf.fieldLayout]].
+     * 
+     * @param name Struct name
+     * @param path Field path, with nested fields separated by dots
+     * @returns Field layout
+     */
+    fieldLayout(name: string, path: string): FieldLayout {
+        const key = `field:${name}.${path}`
+        let field = this.fields.get(key)
+        if (field !== undefined)
+            return field
+        const offset = this.offsets.get(key)
+        if (offset !== undefined) {
+            field = new Reader(this.buf!, offset).field()
+        } else {
+            field = this.getBtf().fieldLayout(name, path)
+            this.dirty = true
+        }
+        this.fields.set(key, field)
+        return field
+    }
+
+    /**
+     * Write the cache file if new layouts were resolved, or it
+     * wasn't valid. The file is replaced atomically, so concurrent
+     * readers never see a partial file.
+     */
+    save(): void {
+        if (!this.dirty)
+            return
+        // records from the file that weren't used are kept as is
+        const records = new Map<string, Buffer>()
+        const recordLength = (offset: number) => this.buf!.readUInt32LE(offset - 4)
+        for (const [ key, offset ] of this.offsets)
+            records.set(key, this.buf!.subarray(offset, offset + recordLength(offset)))
+        for (const [ key, layout ] of this.structs) {
+            const w = new Writer().u32(layout.id).u32(layout.kind).u32(layout.size).u32(layout.fields.length)
+            layout.fields.forEach(f => w.field(f))
+            records.set(key, w.finish())
+        }
+        for (const [ key, field ] of this.fields)
+            records.set(key, new Writer().field(field).finish())
+
+        const w = new Writer().u32(MAGIC).u32(FORMAT_VERSION).u32(0).u32(0)
+        w.str(this.key).u32(records.size)
+        const parts = [ w.finish() ]
+        for (const [ key, record ] of records)
+            parts.push(new Writer().str(key).u32(record.length).finish(), record)
+        const buf = Buffer.concat(parts)
+        buf.writeUInt32LE(checksum(buf, HEADER_SIZE), 8)
+
+        mkdirSync(dirname(this.path), { recursive: true })
+        const tmp = `${this.path}.${process.pid}.tmp`
+        try {
+            writeFileSync(tmp, buf)
+            renameSync(tmp, this.path)
+        } catch (e) {
+            try { unlinkSync(tmp) } catch (_) { /* ignore */ }
+            throw e
+        }
+        this.dirty = false
+    }
+}
@@ -0,0 +1,355 @@
+import { readFileSync } from 'fs'
+import { native, FD } from './util'
+import { checkStatus } from './exception'
+import { LinkType, AttachType, PerfType } from './constants'
+import { MapRef } from './map/common'
+import { ProgramDef, ProgramRef, loadProgram, openProgram, getProgramMaps } from './program'
+
+/**
+ * Object holding a file descriptor for an attachment of an
+ * eBPF program (a *link*). The program stays attached as long
+ * as the descriptor is open, so the same lifetime rules of
+ * [[MapRef]] apply: closing it (or letting it get garbage
+ * collected) detaches the program.
+ * 
+ * Depending on the attachment, the FD may refer to a perf
+ * event (kprobes, uprobes, tracepoints) or to a kernel
+ * `bpf_link` object (raw tracepoints, iterators, ...).
+ */
+export interface LinkRef {
+    /**
+     * Readonly property holding the FD owned by this object.
+     * Don't store this value elsewhere, query it
+     * from here every time to make sure it's valid.
+     * 
+     * Throws if `close()` was successfully called.
+     */
+    readonly fd: FD
+
+    /**
+     * Closes the FD early, detaching the program.
+     * 
+     * If supported, calling it a second time does nothing.
+     */
+    close(): void
+}
+
+/**
+ * Information reported about a `bpf_link` (links backed by perf
+ * events don't have any). Type-specific fields are only present
+ * for the corresponding link type.
+ */
+export interface LinkInfo {
+    /** Link type */
+    type: LinkType
+    /** Link ID */
+    id: number
+    /** ID of the attached program */
+    progId: number
+
+    // Type-specific
+
+    /** For `TRACING`, `CGROUP` and `NETNS` links: attach type */
+    attachType?: AttachType
+    /** For `TRACING` links: ID of the target program or BTF object */
+    targetObjId?: number
+    /** For `TRACING` links: BTF type ID of the target */
+    targetBtfId?: number
+    /** For `CGROUP` links: ID of the cgroup */
+    cgroupId?: bigint
+    /** For `ITER` links: ID of the target map, if any */
+    mapId?: number
+    /** For `NETNS` links: inode of the network namespace */
+    netnsIno?: number
+    /** For `XDP` links: ifindex of the network device */
+    ifindex?: number
+}
+
+export interface KprobeOptions {
+    /** Attach to the function return instead (kretprobe) */
+    retprobe?: boolean
+    /** Offset inside the function to place the probe at */
+    offset?: number
+}
+
+/**
+ * Parameters of a perf event (subset of `perf_event_attr`). Boolean
+ * fields default to `false`.
+ */
+export interface PerfEventAttr {
+    /** Event type */
+    type: PerfType
+    /** Type-specific event (i.e. [[PerfSwId]] for `SOFTWARE` events) */
+    config?: number
+    /** Take a sample (run the program) every this many events */
+    samplePeriod?: number
+    /**
+     * Take this many samples per second instead, adjusting the
+     * period dynamically (takes precedence over `samplePeriod`)
+     */
+    sampleFreq?: number
+    /** Fields recorded in samples (`perf_event_sample_format`) */
+    sampleType?: number
+    /** Wake up the reader every this many samples */
+    wakeupEvents?: number
+    /** Create the event disabled */
+    disabled?: boolean
+    /** Also count events of child tasks */
+    inherit?: boolean
+    excludeKernel?: boolean
+    excludeUser?: boolean
+    excludeHv?: boolean
+    excludeIdle?: boolean
+}
+
+export interface PerfEventOptions {
+    /** Only monitor this process or thread (default: all) */
+    pid?: number
+    /** Only monitor this CPU (default: all, but then `pid` must be passed) */
+    cpu?: number
+}
+
+export interface UprobeOptions {
+    /** Attach to the function return instead (uretprobe) */
+    retprobe?: boolean
+    /** Only trace this process (by default, all processes are traced) */
+    pid?: number
+    /**
+     * File offset of a reference counter (e.g. a USDT semaphore) that
+     * the kernel increments while the probe is attached (since Linux 4.20)
+     */
+    refCtrOffset?: number
+}
+
+/**
+ * Wraps a new link FD, taking ownership of it.
+ */
+export function createLinkRef(fd: FD): LinkRef {
+    return Object.freeze(new native.FDRef(fd))
+}
+
+function attachPerfEventFd(progFd: FD, pfd: number): LinkRef {
+    checkStatus('perf_event_open', pfd)
+    const ref = createLinkRef(pfd)
+    const status = native.perfEventAttach(pfd, progFd)
+    if (status < 0) {
+        ref.close()
+        checkStatus('perf_event_ioc_set_bpf', status)
+    }
+    return ref
+}
+
+/**
+ * Attach a `KPROBE` program to a kernel function.
+ * 
+ * Since Linux 4.17 (requires the `kprobe` PMU).
+ * 
+ * @param prog Program to attach
+ * @param func Name of the kernel function
+ * @param options Attach options
+ * @returns [[LinkRef]] for the attachment
+ */
+export function attachKprobe(prog: ProgramRef, func: string, options?: KprobeOptions): LinkRef {
+    const progFd = prog.fd
+    const pfd = native.perfEventOpenProbe(false, !!options?.retprobe, func, options?.offset)
+    return attachPerfEventFd(progFd, pfd)
+}
+
+/**
+ * Attach a `KPROBE` program to a function in a userspace binary.
+ * 
+ * Since Linux 4.17 (requires the `uprobe` PMU).
+ * 
+ * @param prog Program to attach
+ * @param binaryPath Path to the ELF binary or library
+ * @param offset File offset of the instruction to probe
+ * (not the virtual address)
+ * @param options Attach options
+ * @returns [[LinkRef]] for the attachment
+ */
+export function attachUprobe(prog: ProgramRef, binaryPath: string, offset: number, options?: UprobeOptions): LinkRef {
+    const progFd = prog.fd
+    const pid = options?.pid === undefined ? -1 : options.pid
+    const pfd = native.perfEventOpenProbe(true, !!options?.retprobe, binaryPath, offset, pid, options?.refCtrOffset)
+    return attachPerfEventFd(progFd, pfd)
+}
+
+/**
+ * Attach a `TRACEPOINT` program to a kernel tracepoint.
+ * 
+ * tracefs needs to be mounted at `/sys/kernel/tracing` or
+ * `/sys/kernel/debug/tracing`.
+ * 
+ * Since Linux 4.7.
+ * 
+ * @param prog Program to attach
+ * @param category Tracepoint category (i.e. `'syscalls'`)
+ * @param name Tracepoint name (i.e. `'sys_enter_openat'`)
+ * @returns [[LinkRef]] for the attachment
+ */
+export function attachTracepoint(prog: ProgramRef, category: string, name: string): LinkRef {
+    const progFd = prog.fd
+    const pfd = native.perfEventOpenTracepoint(category, name)
+    return attachPerfEventFd(progFd, pfd)
+}
+
+/** Field of the records of a tracepoint, see [[tracepointFormat]] */
+export interface TracepointField {
+    name: string
+    /** C declaration of the field, e.g. `char prev_comm[16]` */
+    declaration: string
+    /** Offset in the record (the context of `TRACEPOINT` programs), in bytes */
+    offset: number
+    /** Size, in bytes */
+    size: number
+    signed: boolean
+}
+
+/**
+ * Parse the record format of a kernel tracepoint, to find the
+ * offsets of its fields instead of hardcoding them (they vary
+ * across kernel versions and configurations).
+ * 
+ * tracefs needs to be mounted, as for [[attachTracepoint]].
+ * 
+ * @param category Tracepoint category (e.g. `'sched'`)
+ * @param name Tracepoint name (e.g. `'sched_switch'`)
+ * @returns Fields, including the common ones
+ */
+export function tracepointFormat(category: string, name: string): TracepointField[] {
+    const roots = [ '/sys/kernel/tracing', '/sys/kernel/debug/tracing' ]
+    let format: string | undefined
+    for (const root of roots) {
+        try {
+            format = readFileSync(`${root}/events/${category}/${name}/format`, 'utf8')
+            break
+        } catch (e) {
+            if (e.code !== 'ENOENT' || root === roots[roots.length - 1])
+                throw e
+        }
+    }
+    const fields: TracepointField[] = []
+    const re = /^\s*field:(.+?);\s*offset:(\d+);\s*size:(\d+);\s*signed:(\d+);/gm
+    for (let m; (m = re.exec(format!));) {
+        const declaration = m[1].trim()
+        const name = /(\w+)(\[[^\]]*\])*$/.exec(declaration)![1]
+        fields.push({ name, declaration, offset: Number(m[2]), size: Number(m[3]), signed: m[4] === '1' })
+    }
+    return fields
+}
+
+/**
+ * Open a perf event (`perf_event_open`) and attach a program to
+ * it, which runs whenever the event overflows its sample period
+ * (or frequency). Events are monitored either for a process on
+ * all CPUs, for all processes on a CPU, or both.
+ * 
+ * For sampling profilers, attach a `PERF_EVENT` program to a
+ * `CPU_CLOCK` software event on each CPU (see [[attachSampling]]).
+ * `KPROBE` and `TRACEPOINT` programs can also be attached, to
+ * events of the corresponding type.
+ * 
+ * Since Linux 4.9.
+ * 
+ * @param prog Program to attach
+ * @param attr Event parameters
+ * @param options Which process and CPU to monitor
+ * @returns [[LinkRef]] for the attachment
+ */
+export function attachPerfEvent(prog: ProgramRef, attr: PerfEventAttr, options?: PerfEventOptions): LinkRef {
+    const progFd = prog.fd
+    const pfd = native.perfEventOpen(attr, options?.pid, options?.cpu)
+    return attachPerfEventFd(progFd, pfd)
+}
+
+/**
+ * Attach a `RAW_TRACEPOINT` program to a kernel tracepoint. For
+ * `TRACING` programs (fentry, fexit, ...), `name` must be omitted
+ * since the target is specified at load time.
+ * 
+ * Since Linux 4.17.
+ * 
+ * @param prog Program to attach
+ * @param name Tracepoint name (i.e. `'sched_switch'`)
+ * @returns [[LinkRef]] for the attachment
+ */
+export function attachRawTracepoint(prog: ProgramRef, name?: string): LinkRef {
+    const status = native.rawTracepointOpen(name, prog.fd)
+    checkStatus('bpf_raw_tracepoint_open', status)
+    return createLinkRef(status)
+}
+
+/**
+ * Query information about a `bpf_link`.
+ * 
+ * Since Linux 5.8.
+ * 
+ * @param link Link to query
+ * @returns Link information
+ */
+export function getLinkInfo(link: LinkRef): LinkInfo {
+    const [ status, info ] = native.getLinkInfo(link.fd)
+    checkStatus('bpf_obj_get_info_by_fd', status)
+    return info
+}
+
+/**
+ * Atomically replace the program attached through a `bpf_link`,
+ * without detaching. There's no window in which no program
+ * is attached, so no events (or packets) are missed.
+ * 
+ * If `expected` is passed, the update only succeeds if that
+ * program is the one currently attached (fails with `EPERM`
+ * otherwise), which protects against concurrent updates.
+ * 
+ * Since Linux 5.7. Only `bpf_link` based attachments are supported,
+ * not perf events.
+ * 
+ * @param link Link to update
+ * @param prog New program, must have the same type (and expected
+ * attach type) as the current one
+ * @param options Update options
+ */
+export function updateLink(link: LinkRef, prog: ProgramRef, options?: {
+    expected?: ProgramRef
+}): void {
+    const oldProgFd = options?.expected?.fd
+    const status = native.linkUpdate(link.fd, prog.fd, { oldProgFd })
+    checkStatus('bpf_link_update', status)
+}
+
+/**
+ * Load a new version of the program attached to a link, keeping
+ * its state, and atomically swap it in.
+ * 
+ * The maps used by the currently attached program are opened
+ * and passed to `build`, which must return the new program's
+ * parameters (referencing those same maps, so that state is
+ * preserved). The link is then updated with the currently attached
+ * program as `expected` (see [[updateLink]]). If anything fails,
+ * the old program stays attached.
+ * 
+ * Since Linux 5.8.
+ * 
+ * @param link Link to update
+ * @param build Function returning the new program's parameters
+ * @returns Reference to the new program
+ */
+export function migrateLink(link: LinkRef, build: (maps: MapRef[]) => ProgramDef): ProgramRef {
+    const oldProg = openProgram(getLinkInfo(link).progId)
+    let maps: MapRef[] = []
+    try {
+        maps = getProgramMaps(oldProg)
+        const prog = loadProgram(build(maps))
+        try {
+            updateLink(link, prog, { expected: oldProg })
+        } catch (e) {
+            prog.close()
+            throw e
+        }
+        return prog
+    } finally {
+        maps.forEach(map => map.close())
+        oldProg.close()
+    }
+}
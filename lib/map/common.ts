@@ -2,10 +2,9 @@ import { constants } from 'os'
 import { native, FD, asUint32Array, checkU32 } from '../util'
 import { checkStatus, BPFError } from '../exception'
 import { MapType, MapFlags } from '../constants'
+import { BtfRef } from '../btf'
 const { EFAULT, EINVAL } = constants.errno
 
-// FIXME: we are excluding BTF related parameters for now
-
 export interface MapDefOptional {
     /** Flags specified on map creation, see [[MapFlags]] */
     flags?: number
@@ -22,6 +21,17 @@ export interface MapDefOptional {
     innerMap?: MapDef | MapRef | number
     /** For offloading, ifindex of network device to create the map on (since Linux 4.16) */
     ifindex?: number
+    /**
+     * BTF describing the key and value types (since Linux 4.18), or its FD.
+     * It's needed for values holding a `struct bpf_spin_lock`, which
+     * enables [[MapUpdateFlags.F_LOCK]] and [[MapLookupFlags.F_LOCK]].
+     * The passed BTF's lifetime isn't affected in any way.
+     */
+    btf?: BtfRef | number
+    /** With `btf`: ID of the key type */
+    btfKeyTypeId?: number
+    /** With `btf`: ID of the value type */
+    btfValueTypeId?: number
 }
 
 /**
@@ -80,6 +90,13 @@ export interface MapInfo {
 
     netnsDev?: bigint
     netnsIno?: bigint
+
+    /** ID of the map's BTF object, or zero (since Linux 4.18) */
+    btfId?: number
+    /** BTF type ID of the key, or zero (since Linux 4.18) */
+    btfKeyTypeId?: number
+    /** BTF type ID of the value, or zero (since Linux 4.18) */
+    btfValueTypeId?: number
 }
 
 /**
@@ -199,6 +216,8 @@ export function createMap(desc: MapDef): MapRef {
             }
             desc.innerMap = fd
         }
+        if (desc.btf !== undefined && typeof desc.btf !== 'number')
+            desc.btf = desc.btf.fd
 
         const status: number = native.createMap(desc)
         checkStatus('bpf_create_map_xattr', status)
@@ -303,3 +322,18 @@ export function objGet(path: string): number {
     checkStatus('bpf_obj_get', fd)
     return fd
 }
+
+/**
+ * Pin an eBPF object (map, program, link, ...) to a path in
+ * BPFFS, so that it outlives the process and can be opened
+ * by other processes through [[objGet]].
+ *
+ * Since Linux 4.4.
+ *
+ * @param ref Reference to the object (only its `fd` is used)
+ * @param path Path to pin the object at (inside a BPFFS mount)
+ */
+export function objPin(ref: { readonly fd: FD }, path: string): void {
+    const status = native.bpfObjPin(ref.fd, path)
+    checkStatus('bpf_obj_pin', status)
+}
@@ -0,0 +1,188 @@
+import { constants } from 'os'
+import { native, asUint8Array, checkU32 } from '../util'
+import { checkStatus } from '../exception'
+import { MapRef, MapDefOptional, createMap } from './common'
+import { MapType, ProgramType } from '../constants'
+import { ProgramRef, openProgram } from '../program'
+const { ENOENT } = constants.errno
+
+/**
+ * Map holding programs to tail-call into (`PROG_ARRAY` type),
+ * through the `bpf_tail_call` helper.
+ * 
+ * Updates of a single slot are atomic: a tail call jumps
+ * either to the old program or the new one, so stages of a
+ * pipeline can be replaced at runtime without detaching
+ * the root program.
+ * 
+ * All programs in the map must have the same type as the
+ * program that uses it. Entries only hold a reference to the
+ * program while the map is in use by some program (or open
+ * from userspace), see the kernel docs for details.
+ */
+export class ProgArrayMap {
+    readonly ref: MapRef
+    /** Size of the array in items */
+    readonly length: number
+    /**
+     * Program type accepted by the map, if known (either passed
+     * at construction time, or the type of the first program set)
+     */
+    programType?: ProgramType
+
+    /**
+     * Construct a new instance operating on the given map.
+     * 
+     * The map must be of `PROG_ARRAY` type.
+     * 
+     * @param ref Reference to the map. See [[MapRef]] if
+     * you want to implement your own instances.
+     * @param programType Program type to accept (the kernel
+     * validates it anyway, this just gives earlier errors)
+     */
+    constructor(ref: MapRef, programType?: ProgramType) {
+        if (ref.type !== MapType.PROG_ARRAY)
+            throw new Error(`Expected prog array map, got type ${MapType[ref.type] || ref.type}`)
+        this.ref = ref
+        this.length = checkU32(ref.maxEntries)
+        this.programType = programType
+    }
+
+    private _kBuf(x: number) {
+        checkU32(x)
+        if (x >= this.length)
+            throw new RangeError(`Invalid index ${x} for array of length ${this.length}`)
+        return asUint8Array(Uint32Array.of(x))
+    }
+
+    private _checkProgram(prog: ProgramRef) {
+        if (this.programType !== undefined && prog.type !== this.programType)
+            throw new Error(`Expected program of type ${ProgramType[this.programType]}, got ${ProgramType[prog.type] || prog.type}`)
+    }
+
+    /**
+     * Get the ID of the program at a certain slot.
+     * Use [[openProgram]] to get a reference to it.
+     * 
+     * Since Linux 4.18.
+     * 
+     * @param key Slot index
+     * @returns Program ID, or `undefined` if the slot is empty
+     */
+    getId(key: number): number | undefined {
+        const out = new Uint32Array(1)
+        const status = native.mapLookupElem(this.ref.fd, this._kBuf(key), asUint8Array(out), 0)
+        if (status === -ENOENT)
+            return undefined
+        checkStatus('bpf_map_lookup_elem_flags', status)
+        return out[0]
+    }
+
+    /**
+     * Atomically place a program at a certain slot, replacing
+     * the previous one (if any).
+     * 
+     * @param key Slot index
+     * @param prog Program to place
+     * @param flags Operation flags, see [[MapUpdateFlags]]
+     */
+    set(key: number, prog: ProgramRef, flags: number = 0): this {
+        this._checkProgram(prog)
+        const value = asUint8Array(Uint32Array.of(prog.fd))
+        const status = native.mapUpdateElem(this.ref.fd, this._kBuf(key), value, flags)
+        checkStatus('bpf_map_update_elem', status)
+        if (this.programType === undefined)
+            this.programType = prog.type
+        return this
+    }
+
+    /**
+     * Empty a slot. Tail calls to it will fail (and the
+     * caller will continue executing).
+     * 
+     * @param key Slot index
+     * @returns `true` if the slot had a program
+     */
+    delete(key: number): boolean {
+        const status = native.mapDeleteElem(this.ref.fd, this._kBuf(key))
+        if (status === -ENOENT)
+            return false
+        checkStatus('bpf_map_delete_elem', status)
+        return true
+    }
+
+    /**
+     * Install many programs at once (`undefined` empties the
+     * slot). All programs are validated first; if an update
+     * fails, the slots already written are restored to their
+     * previous contents before throwing.
+     * 
+     * Note that each slot is updated atomically, but the whole
+     * operation isn't: a packet may see some slots updated and
+     * others not. Update stages in an order that keeps the
+     * pipeline consistent (i.e. callees before callers).
+     * 
+     * @param entries Pairs of slot index and program
+     */
+    setMany(entries: [number, ProgramRef | undefined][]): this {
+        entries.forEach(([ key, prog ]) => {
+            this._kBuf(key)
+            prog && this._checkProgram(prog)
+        })
+        const previous: [number, number | undefined][] = []
+        try {
+            for (const [ key, prog ] of entries) {
+                previous.push([ key, this.getId(key) ])
+                prog ? this.set(key, prog) : this.delete(key)
+            }
+        } catch (e) {
+            for (const [ key, id ] of previous.reverse()) {
+                if (id === undefined) {
+                    this.delete(key)
+                    continue
+                }
+                const prog = openProgram(id)
+                try {
+                    this.set(key, prog)
+                } finally {
+                    prog.close()
+                }
+            }
+            throw e
+        }
+        return this
+    }
+
+    /**
+     * Get the IDs of the programs in every slot.
+     * 
+     * @returns Array with the program ID (or `undefined`) of each slot
+     */
+    getAllIds(): (number | undefined)[] {
+        return Array.from({ length: this.length }, (_, i) => this.getId(i))
+    }
+}
+
+/**
+ * Convenience function to create a `PROG_ARRAY` map using
+ * [[createMap]] and construct a [[ProgArrayMap]] instance.
+ * 
+ * @param length Array size, in slots
+ * @param programType Program type to accept
+ * @param options Other map options
+ * @returns Map instance
+ */
+export function createProgArrayMap(
+    length: number,
+    programType?: ProgramType,
+    options?: MapDefOptional
+): ProgArrayMap {
+    const ref = createMap({
+        ...options,
+        type: MapType.PROG_ARRAY,
+        keySize: 4,
+        maxEntries: length,
+        valueSize: 4,
+    })
+    return new ProgArrayMap(ref, programType)
+}
@@ -0,0 +1,265 @@
+import { constants } from 'os'
+import { native, asUint8Array, checkU32, numPossibleCpus } from '../util'
+import { checkStatus } from '../exception'
+import { MapRef, MapDefOptional, createMap } from './common'
+import { MapType } from '../constants'
+import { ProgramRef } from '../program'
+const { ENOENT } = constants.errno
+
+// Both bpf_cpumap_val and bpf_devmap_val are a u32 followed by an
+// optional program (fd when writing, ID when reading). Older kernels
+// only accept the u32, which is why the value size can also be 4.
+
+function formatValue(ref: MapRef, first: number, prog?: ProgramRef) {
+    const value = new Uint32Array(ref.valueSize / 4)
+    value[0] = checkU32(first)
+    if (prog !== undefined) {
+        if (value.length < 2)
+            throw new Error('Map values are too small to hold a program (4 bytes, expected 8)')
+        value[1] = prog.fd
+    }
+    return value
+}
+
+class RedirectMap {
+    readonly ref: MapRef
+
+    constructor(ref: MapRef, types: MapType[]) {
+        if (!types.includes(ref.type))
+            throw new Error(`Expected ${types.map(t => MapType[t]).join(' or ')} map, got type ${MapType[ref.type] || ref.type}`)
+        if (ref.keySize !== 4 || (ref.valueSize !== 4 && ref.valueSize !== 8))
+            throw new Error(`Unexpected key / value size: ${ref.keySize} / ${ref.valueSize}`)
+        this.ref = ref
+    }
+
+    protected _get(key: number): Uint32Array | undefined {
+        const out = new Uint32Array(this.ref.valueSize / 4)
+        const status = native.mapLookupElem(this.ref.fd, asUint8Array(Uint32Array.of(key)), asUint8Array(out), 0)
+        if (status === -ENOENT)
+            return undefined
+        checkStatus('bpf_map_lookup_elem_flags', status)
+        return out
+    }
+
+    protected _set(key: number, value: Uint32Array, flags: number) {
+        const status = native.mapUpdateElem(this.ref.fd, asUint8Array(Uint32Array.of(checkU32(key))), asUint8Array(value), flags)
+        checkStatus('bpf_map_update_elem', status)
+    }
+
+    /**
+     * Delete an entry.
+     * 
+     * @param key Entry key
+     * @returns `true` if an entry was found and deleted
+     */
+    delete(key: number): boolean {
+        const status = native.mapDeleteElem(this.ref.fd, asUint8Array(Uint32Array.of(checkU32(key))))
+        if (status === -ENOENT)
+            return false
+        checkStatus('bpf_map_delete_elem', status)
+        return true
+    }
+}
+
+/** Entry of a [[CpuMap]] (`struct bpf_cpumap_val`) */
+export interface CpuMapEntry {
+    /** Size of the queue of packets redirected to the CPU */
+    qsize: number
+    /**
+     * When writing: program to run on the CPU for redirected
+     * packets, loaded with expected attach type `XDP_CPUMAP`
+     * (since Linux 5.9)
+     */
+    prog?: ProgramRef
+    /** When reading: ID of the program run on the CPU, or zero */
+    progId?: number
+}
+
+/**
+ * `CPUMAP` map, the target of `bpf_redirect_map` for moving
+ * packets to other CPUs from an XDP program. The network stack
+ * (or the entry's program) then processes them on that CPU, so
+ * the receive load can be spread across cores.
+ * 
+ * Keys are CPU indexes. Setting an entry allocates a kthread and
+ * a queue for that CPU, deleting it tears them down.
+ * 
+ * Since Linux 4.15.
+ */
+export class CpuMap extends RedirectMap {
+    /**
+     * Construct a new instance operating on the given map.
+     * 
+     * The map must be of `CPUMAP` type.
+     * 
+     * @param ref Reference to the map. See [[MapRef]] if
+     * you want to implement your own instances.
+     */
+    constructor(ref: MapRef) {
+        super(ref, [ MapType.CPUMAP ])
+    }
+
+    /**
+     * Get the entry for a CPU.
+     * 
+     * @param cpu CPU index
+     * @returns Entry, or `undefined` if not set
+     */
+    get(cpu: number): CpuMapEntry | undefined {
+        const value = this._get(cpu)
+        return value && (value.length > 1 ?
+            { qsize: value[0], progId: value[1] } : { qsize: value[0] })
+    }
+
+    /**
+     * Set up (or reconfigure) a CPU as a redirect target.
+     * 
+     * @param cpu CPU index
+     * @param entry Entry to set
+     * @param flags Operation flags, see [[MapUpdateFlags]]
+     */
+    set(cpu: number, entry: CpuMapEntry, flags: number = 0): this {
+        this._set(cpu, formatValue(this.ref, entry.qsize, entry.prog), flags)
+        return this
+    }
+
+    /**
+     * Set up many CPUs with the same entry.
+     * 
+     * @param entry Entry to set
+     * @param cpus CPU indexes (default: all possible CPUs
+     * that fit in the map)
+     */
+    setAll(entry: CpuMapEntry, cpus?: Iterable<number>): this {
+        if (cpus === undefined) {
+            const count = Math.min(numPossibleCpus(), this.ref.maxEntries)
+            cpus = Array.from({ length: count }, (_, i) => i)
+        }
+        const value = formatValue(this.ref, entry.qsize, entry.prog)
+        for (const cpu of cpus)
+            this._set(cpu, value, 0)
+        return this
+    }
+}
+
+/** Entry of a [[DevMap]] (`struct bpf_devmap_val`) */
+export interface DevMapEntry {
+    /** Index of the target network device */
+    ifindex: number
+    /**
+     * When writing: program to run on redirected packets before
+     * transmitting them, loaded with expected attach type
+     * `XDP_DEVMAP` (since Linux 5.8)
+     */
+    prog?: ProgramRef
+    /** When reading: ID of the program run on redirected packets, or zero */
+    progId?: number
+}
+
+/**
+ * `DEVMAP` or `DEVMAP_HASH` map, the target of `bpf_redirect_map`
+ * for forwarding packets to other network devices from an
+ * XDP program.
+ * 
+ * For `DEVMAP`, keys are array indexes; for `DEVMAP_HASH` (since
+ * Linux 5.4) they're arbitrary, but usually the ifindex itself.
+ * 
+ * Since Linux 4.14.
+ */
+export class DevMap extends RedirectMap {
+    /**
+     * Construct a new instance operating on the given map.
+     * 
+     * The map must be of `DEVMAP` or `DEVMAP_HASH` type.
+     * 
+     * @param ref Reference to the map. See [[MapRef]] if
+     * you want to implement your own instances.
+     */
+    constructor(ref: MapRef) {
+        super(ref, [ MapType.DEVMAP, MapType.DEVMAP_HASH ])
+    }
+
+    /**
+     * Get an entry.
+     * 
+     * @param key Entry key
+     * @returns Entry, or `undefined` if not set
+     */
+    get(key: number): DevMapEntry | undefined {
+        const value = this._get(key)
+        return value && (value.length > 1 ?
+            { ifindex: value[0], progId: value[1] } : { ifindex: value[0] })
+    }
+
+    /**
+     * Set an entry.
+     * 
+     * @param key Entry key
+     * @param entry Entry to set
+     * @param flags Operation flags, see [[MapUpdateFlags]]
+     */
+    set(key: number, entry: DevMapEntry, flags: number = 0): this {
+        this._set(key, formatValue(this.ref, entry.ifindex, entry.prog), flags)
+        return this
+    }
+
+    /**
+     * Set many entries at once. For `DEVMAP_HASH` maps, you can
+     * pass the entries alone, which are then keyed by their
+     * ifindex.
+     * 
+     * @param entries Entries to set, or pairs of key and entry
+     */
+    setMany(entries: ([number, DevMapEntry] | DevMapEntry)[]): this {
+        for (const item of entries) {
+            const [ key, entry ]: [number, DevMapEntry] = Array.isArray(item) ? item : [ item.ifindex, item ]
+            this.set(key, entry)
+        }
+        return this
+    }
+}
+
+/**
+ * Convenience function to create a `CPUMAP` map using [[createMap]]
+ * and construct a [[CpuMap]] instance.
+ * 
+ * The map is created with room for programs in its values, which
+ * needs Linux 5.9. For older kernels, create it with 4-byte values.
+ * 
+ * @param maxEntries Max entries (default: number of possible CPUs)
+ * @param options Other map options
+ * @returns Map instance
+ */
+export function createCpuMap(maxEntries: number = numPossibleCpus(), options?: MapDefOptional): CpuMap {
+    const ref = createMap({
+        ...options,
+        type: MapType.CPUMAP,
+        keySize: 4,
+        maxEntries,
+        valueSize: 8,
+    })
+    return new CpuMap(ref)
+}
+
+/**
+ * Convenience function to create a `DEVMAP` (or `DEVMAP_HASH`)
+ * map using [[createMap]] and construct a [[DevMap]] instance.
+ * 
+ * The map is created with room for programs in its values, which
+ * needs Linux 5.8. For older kernels, create it with 4-byte values.
+ * 
+ * @param maxEntries Max entries
+ * @param hash Create a `DEVMAP_HASH` map
+ * @param options Other map options
+ * @returns Map instance
+ */
+export function createDevMap(maxEntries: number, hash: boolean = false, options?: MapDefOptional): DevMap {
+    const ref = createMap({
+        ...options,
+        type: hash ? MapType.DEVMAP_HASH : MapType.DEVMAP,
+        keySize: 4,
+        maxEntries,
+        valueSize: 8,
+    })
+    return new DevMap(ref)
+}
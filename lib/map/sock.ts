@@ -0,0 +1,249 @@
+import { constants } from 'os'
+import * as net from 'net'
+import { native, asUint8Array, asUint16Array } from '../util'
+import { checkStatus } from '../exception'
+import { MapRef, MapDefOptional, createMap } from './common'
+import { MapType, AttachType } from '../constants'
+import { ProgramRef } from '../program'
+import { SocketLike, getSocketFd } from '../socket'
+import { Assembler, Reg, Size, AluOp, Helper } from '../asm'
+const { ENOENT } = constants.errno
+
+/**
+ * Map holding sockets, currently `SOCKMAP` (indexed by
+ * a `uint32`) and `SOCKHASH` (arbitrary keys).
+ * 
+ * Placing a socket in the map makes the programs attached to
+ * the map (see [[attach]]) run for that socket: `SK_SKB` programs
+ * for received data, and `SK_MSG` programs for sent data. These
+ * can then redirect the data to other sockets in the map, without
+ * ever going through userspace.
+ * 
+ * Sockets are removed from the map automatically when closed.
+ * Until Linux 5.7 only established TCP sockets can be placed.
+ * 
+ * Since Linux 4.14 (`SOCKHASH` since Linux 4.18).
+ */
+export class SockMap {
+    readonly ref: MapRef
+
+    /**
+     * Construct a new instance operating on the given map.
+     * 
+     * The map must be of `SOCKMAP` or `SOCKHASH` type.
+     * 
+     * @param ref Reference to the map. See [[MapRef]] if
+     * you want to implement your own instances.
+     */
+    constructor(ref: MapRef) {
+        if (ref.type !== MapType.SOCKMAP && ref.type !== MapType.SOCKHASH)
+            throw new Error(`Expected sockmap or sockhash, got type ${MapType[ref.type] || ref.type}`)
+        this.ref = ref
+    }
+
+    private _kBuf(key: number | Buffer) {
+        const buf = typeof key === 'number' ? asUint8Array(Uint32Array.of(key)) : key
+        if (buf.length !== this.ref.keySize)
+            throw Error(`Passed ${buf.length} byte key, expected ${this.ref.keySize}`)
+        return buf
+    }
+
+    /**
+     * Place a socket in the map, replacing the previous one.
+     * The map doesn't keep the socket open.
+     * 
+     * @param key Entry key (a number is accepted for 4-byte keys)
+     * @param socket Socket to place
+     * @param flags Operation flags, see [[MapUpdateFlags]]
+     */
+    set(key: number | Buffer, socket: SocketLike, flags: number = 0): this {
+        const fd = getSocketFd(socket)
+        // the kernel accepts both 32-bit and 64-bit values
+        const value = this.ref.valueSize === 8 ?
+            asUint8Array(BigUint64Array.of(BigInt(fd))) : asUint8Array(Uint32Array.of(fd))
+        const status = native.mapUpdateElem(this.ref.fd, this._kBuf(key), value, flags)
+        checkStatus('bpf_map_update_elem', status)
+        return this
+    }
+
+    /**
+     * Remove a socket from the map.
+     * 
+     * @param key Entry key
+     * @returns `true` if an entry was found and deleted
+     */
+    delete(key: number | Buffer): boolean {
+        const status = native.mapDeleteElem(this.ref.fd, this._kBuf(key))
+        if (status == -ENOENT)
+            return false
+        checkStatus('bpf_map_delete_elem', status)
+        return true
+    }
+
+    /**
+     * Attach a program to the map. Possible attach types are
+     * `SK_SKB_STREAM_PARSER`, `SK_SKB_STREAM_VERDICT` (for
+     * `SK_SKB` programs) and `SK_MSG_VERDICT` (for `SK_MSG`
+     * programs). Only one program per attach type is allowed,
+     * attaching replaces the previous one.
+     * 
+     * Until Linux 5.9, a stream verdict program doesn't run
+     * unless there's also a stream parser attached (see
+     * [[streamParserProgram]]).
+     * 
+     * @param prog Program to attach
+     * @param attachType Attach type
+     */
+    attach(prog: ProgramRef, attachType: AttachType): void {
+        const status = native.progAttach(prog.fd, this.ref.fd, attachType, {})
+        checkStatus('bpf_prog_attach', status)
+    }
+
+    /**
+     * Detach a program from the map.
+     * 
+     * @param prog Program to detach
+     * @param attachType Attach type
+     */
+    detach(prog: ProgramRef, attachType: AttachType): void {
+        const status = native.progDetach(this.ref.fd, attachType, prog.fd)
+        checkStatus('bpf_prog_detach2', status)
+    }
+
+    /**
+     * Splice two connected sockets, so that data received on
+     * each of them is sent on the other (i.e. client and backend
+     * connections of a proxy). This only works on a `SOCKHASH` map
+     * keyed by [[socketTuple]] with [[spliceVerdictProgram]]
+     * attached as stream verdict.
+     * 
+     * Make sure there's no unread data in the sockets first:
+     * received data will never reach Node.js after this.
+     * 
+     * @param a First socket
+     * @param b Second socket
+     */
+    splice(a: net.Socket, b: net.Socket): this {
+        this.set(socketTuple(a), b)
+        try {
+            this.set(socketTuple(b), a)
+        } catch (e) {
+            this.delete(socketTuple(a))
+            throw e
+        }
+        return this
+    }
+}
+
+/** Size of the keys produced by [[socketTuple]] */
+export const SOCKET_TUPLE_SIZE = 16
+
+const parseIPv4 = (address: string | undefined) => {
+    const m = address && /^(?:::ffff:)?(\d+)\.(\d+)\.(\d+)\.(\d+)$/i.exec(address)
+    if (!m)
+        throw new Error(`Expected connected IPv4 socket, got address ${address}`)
+    return m.slice(1).map(Number)
+}
+
+/**
+ * Build the key identifying a connected IPv4 socket, the same way
+ * [[spliceVerdictProgram]] does: remote address, local address
+ * (both in network order), remote port (in network order) and
+ * local port (in host order), as they appear in `__sk_buff`.
+ * 
+ * @param socket Connected socket
+ * @returns Key ([[SOCKET_TUPLE_SIZE]] bytes)
+ */
+export function socketTuple(socket: net.Socket): Buffer {
+    const key = Buffer.alloc(SOCKET_TUPLE_SIZE)
+    key.set(parseIPv4(socket.remoteAddress), 0)
+    key.set(parseIPv4(socket.localAddress), 4)
+    const remotePort = Buffer.alloc(2)
+    remotePort.writeUInt16BE(socket.remotePort!, 0)
+    key.set(asUint8Array(Uint32Array.of(asUint16Array(remotePort)[0], socket.localPort!)), 8)
+    return key
+}
+
+/**
+ * Build an `SK_SKB` stream verdict program that redirects
+ * received data to the socket found in `map` under the key of
+ * the receiving socket (see [[socketTuple]]), or drops it if
+ * there's none. See [[SockMap.splice]].
+ * 
+ * @param map `SOCKHASH` map with [[SOCKET_TUPLE_SIZE]] byte keys
+ * @returns Program bytecode
+ */
+export function spliceVerdictProgram(map: MapRef): Buffer {
+    // offsets in struct __sk_buff
+    const fields = [ 92 /* remote_ip4 */, 96 /* local_ip4 */, 132 /* remote_port */, 136 /* local_port */ ]
+    const asm = new Assembler().movReg(Reg.R6, Reg.R1)
+    fields.forEach((offset, i) => asm
+        .ldxMem(Size.W, Reg.R2, Reg.R6, offset)
+        .stxMem(Size.W, Reg.R10, Reg.R2, -SOCKET_TUPLE_SIZE + 4 * i))
+    return asm
+        .movReg(Reg.R1, Reg.R6)
+        .ldMapFd(Reg.R2, map.fd)
+        .movReg(Reg.R3, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R3, -SOCKET_TUPLE_SIZE)
+        .movImm(Reg.R4, 0)
+        .call(Helper.SK_REDIRECT_HASH)
+        .exit()
+        .build()
+}
+
+/**
+ * Build an `SK_SKB` stream parser program that treats all
+ * received data as a single message (returns `skb->len`).
+ * 
+ * @returns Program bytecode
+ */
+export function streamParserProgram(): Buffer {
+    return new Assembler()
+        .ldxMem(Size.W, Reg.R0, Reg.R1, 0)
+        .exit()
+        .build()
+}
+
+/**
+ * Convenience function to create a `SOCKMAP` map using [[createMap]]
+ * and construct a [[SockMap]] instance.
+ * 
+ * @param maxEntries Max entries
+ * @param options Other map options
+ * @returns Map instance
+ */
+export function createSockMap(maxEntries: number, options?: MapDefOptional): SockMap {
+    const ref = createMap({
+        ...options,
+        type: MapType.SOCKMAP,
+        keySize: 4,
+        maxEntries,
+        valueSize: 4,
+    })
+    return new SockMap(ref)
+}
+
+/**
+ * Convenience function to create a `SOCKHASH` map using [[createMap]]
+ * and construct a [[SockMap]] instance.
+ * 
+ * @param maxEntries Max entries
+ * @param keySize Size of each key, in bytes (defaults to
+ * [[SOCKET_TUPLE_SIZE]], for use with [[SockMap.splice]])
+ * @param options Other map options
+ * @returns Map instance
+ */
+export function createSockHash(
+    maxEntries: number,
+    keySize: number = SOCKET_TUPLE_SIZE,
+    options?: MapDefOptional
+): SockMap {
+    const ref = createMap({
+        ...options,
+        type: MapType.SOCKHASH,
+        keySize,
+        maxEntries,
+        valueSize: 4,
+    })
+    return new SockMap(ref)
+}
@@ -0,0 +1,221 @@
+import { native, asUint8Array, asBigUint64Array, checkU32 } from '../util'
+import { checkStatus } from '../exception'
+import { MapRef, MapDefOptional, createMap } from './common'
+import { MapType, MapFlags } from '../constants'
+
+/** Size of `struct bpf_stack_build_id` */
+const BUILD_ID_FRAME_SIZE = 32
+const BUILD_ID_SIZE = 20
+
+/** Status of a build ID frame (`enum bpf_stack_build_id_status`) */
+export enum StackBuildIdStatus {
+    /** Valid build ID and offset */
+    VALID = 1,
+    /** Couldn't get the build ID, only the IP is available */
+    IP = 2,
+}
+
+/** Frame of a stack trace collected with `STACK_BUILD_ID` */
+export interface BuildIdFrame {
+    status: StackBuildIdStatus
+    /** For `VALID` frames: build ID of the object */
+    buildId?: Buffer
+    /** For `VALID` frames: offset inside the object */
+    offset?: bigint
+    /** For `IP` frames: instruction pointer */
+    ip?: bigint
+}
+
+/**
+ * Result of [[StackTraceMap.lookupBatch]]: frames of all the
+ * stacks, packed together. The frames of the `i`-th stack are
+ * `frames.subarray(offsets[i], offsets[i+1])` (empty if the stack
+ * ID wasn't found).
+ */
+export interface StackBatch {
+    /** Number of stacks */
+    count: number
+    /** Offset of the frames of each stack, plus the total (`count + 1` items) */
+    offsets: Uint32Array
+    /** Frames of all stacks: IPs, or raw `bpf_stack_build_id` for build ID maps */
+    frames: BigUint64Array | Buffer
+}
+
+/**
+ * `STACK_TRACE` map, where programs store stack traces through
+ * `bpf_get_stackid`, getting an ID for each one.
+ * 
+ * Stacks are read by ID. To keep up with many stacks per second,
+ * [[lookupBatch]] reads (and optionally deletes) many IDs in a
+ * single call, packing their frames together. Delete IDs after
+ * consuming them, so the map doesn't fill up.
+ * 
+ * If the map was created with `STACK_BUILD_ID`, frames are
+ * build ID + offset pairs instead of IPs (see [[BuildIdFrame]]).
+ * 
+ * Since Linux 4.6.
+ */
+export class StackTraceMap {
+    readonly ref: MapRef
+    /** Whether frames are build IDs (map created with `STACK_BUILD_ID`) */
+    readonly buildId: boolean
+    /** Size of each frame, in bytes */
+    readonly frameSize: number
+    /** Max frames in a stack */
+    readonly maxDepth: number
+
+    private ids = new Uint32Array(0)
+    private offsets = new Uint32Array(1)
+    private frames = Buffer.alloc(0)
+
+    /**
+     * Construct a new instance operating on the given map.
+     * 
+     * The map must be of `STACK_TRACE` type.
+     * 
+     * @param ref Reference to the map. See [[MapRef]] if
+     * you want to implement your own instances.
+     */
+    constructor(ref: MapRef) {
+        if (ref.type !== MapType.STACK_TRACE)
+            throw new Error(`Expected stack trace map, got type ${MapType[ref.type] || ref.type}`)
+        this.ref = ref
+        this.buildId = !!(ref.flags & MapFlags.STACK_BUILD_ID)
+        this.frameSize = this.buildId ? BUILD_ID_FRAME_SIZE : 8
+        this.maxDepth = Math.floor(ref.valueSize / this.frameSize)
+    }
+
+    private _run(ids: ArrayLike<number>, lookup: boolean, del: boolean): number {
+        if (this.ids.length < ids.length) {
+            this.ids = new Uint32Array(ids.length)
+            this.offsets = new Uint32Array(ids.length + 1)
+        }
+        if (ids instanceof Uint32Array)
+            this.ids.set(ids)
+        else
+            for (let i = 0; i < ids.length; i++)
+                this.ids[i] = checkU32(ids[i])
+        const size = ids.length * this.ref.valueSize
+        if (lookup && this.frames.length < size)
+            this.frames = Buffer.alloc(size)
+
+        const [ status, count ] = native.stackMapLookupBatch(this.ref.fd, this.ids, ids.length,
+            this.ref.valueSize, this.frameSize, lookup ? this.frames : undefined, this.offsets, del)
+        checkStatus(lookup ? 'bpf_map_lookup_elem' : 'bpf_map_delete_elem', status)
+        return count
+    }
+
+    /**
+     * Read the stacks with the given IDs, in a single call.
+     * 
+     * The returned arrays are owned by this instance, and are
+     * overwritten by the next call, so process (or copy) them first.
+     * 
+     * @param ids Stack IDs
+     * @param options.delete Also delete the stacks from the map
+     * @returns Frames of the stacks, see [[StackBatch]]
+     */
+    lookupBatch(ids: ArrayLike<number>, options?: { delete?: boolean }): StackBatch {
+        const count = this._run(ids, true, !!options?.delete)
+        const offsets = this.offsets.subarray(0, count + 1)
+        const used = this.frames.subarray(0, offsets[count] * this.frameSize)
+        return {
+            count,
+            offsets,
+            frames: this.buildId ? used : asBigUint64Array(used),
+        }
+    }
+
+    /**
+     * Delete the stacks with the given IDs, in a single call.
+     * Missing IDs are ignored.
+     * 
+     * @param ids Stack IDs
+     */
+    deleteBatch(ids: ArrayLike<number>): void {
+        this._run(ids, false, true)
+    }
+
+    /**
+     * Read a stack of IPs.
+     * 
+     * @param id Stack ID
+     * @returns IPs (innermost first), or `undefined` if not found
+     */
+    get(id: number): bigint[] | undefined {
+        if (this.buildId)
+            throw new Error('Map stores build IDs, use getBuildId')
+        const { frames, offsets } = this.lookupBatch([ id ])
+        return offsets[1] > 0 ? Array.from(frames as BigUint64Array) :
+            (this.has(id) ? [] : undefined)
+    }
+
+    /**
+     * Read a stack of build ID frames.
+     * 
+     * @param id Stack ID
+     * @returns Frames (innermost first), or `undefined` if not found
+     */
+    getBuildId(id: number): BuildIdFrame[] | undefined {
+        if (!this.buildId)
+            throw new Error('Map stores IPs, use get')
+        const { frames, offsets } = this.lookupBatch([ id ])
+        return offsets[1] > 0 ? parseBuildIdFrames(frames as Buffer) :
+            (this.has(id) ? [] : undefined)
+    }
+
+    private has(id: number): boolean {
+        const value = Buffer.alloc(this.ref.valueSize)
+        return native.mapLookupElem(this.ref.fd, asUint8Array(Uint32Array.of(id)), value, 0) === 0
+    }
+}
+
+/**
+ * Parse raw `bpf_stack_build_id` frames, as returned by
+ * [[StackTraceMap.lookupBatch]] for build ID maps.
+ * 
+ * @param frames Raw frames
+ * @returns Parsed frames
+ */
+export function parseBuildIdFrames(frames: Buffer): BuildIdFrame[] {
+    const result: BuildIdFrame[] = []
+    for (let pos = 0; pos + BUILD_ID_FRAME_SIZE <= frames.length; pos += BUILD_ID_FRAME_SIZE) {
+        const status = frames.readInt32LE(pos)
+        const value = frames.readBigUInt64LE(pos + 24)
+        result.push(status === StackBuildIdStatus.VALID ? {
+            status,
+            buildId: Buffer.from(frames.subarray(pos + 4, pos + 4 + BUILD_ID_SIZE)),
+            offset: value,
+        } : { status, ip: value })
+    }
+    return result
+}
+
+/**
+ * Convenience function to create a `STACK_TRACE` map using
+ * [[createMap]] and construct a [[StackTraceMap]] instance.
+ * 
+ * @param maxEntries Max number of stacks
+ * @param maxDepth Max frames per stack (default: 127, the
+ * kernel's default `perf_event_max_stack`)
+ * @param buildId Store build ID frames instead of IPs
+ * (`STACK_BUILD_ID`, since Linux 4.17)
+ * @param options Other map options
+ * @returns Map instance
+ */
+export function createStackTraceMap(
+    maxEntries: number,
+    maxDepth: number = 127,
+    buildId: boolean = false,
+    options?: MapDefOptional
+): StackTraceMap {
+    const ref = createMap({
+        ...options,
+        flags: (options?.flags || 0) | (buildId ? MapFlags.STACK_BUILD_ID : 0),
+        type: MapType.STACK_TRACE,
+        keySize: 4,
+        maxEntries,
+        valueSize: maxDepth * (buildId ? BUILD_ID_FRAME_SIZE : 8),
+    })
+    return new StackTraceMap(ref)
+}
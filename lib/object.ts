@@ -0,0 +1,261 @@
+import { readFileSync, writeFileSync, statSync, lstatSync, existsSync, mkdirSync, renameSync, unlinkSync, openSync, readSync, closeSync } from 'fs'
+import { homedir } from 'os'
+import { join } from 'path'
+import { createHash, randomBytes } from 'crypto'
+import { native, versions } from './util'
+import { checkStatus } from './exception'
+import { MapRef, createMapRef } from './map/common'
+import { ProgramRef, createProgramRef } from './program'
+import { Btf, VMLINUX_BTF_PATH } from './btf'
+
+/** Source of target BTF, see [[TargetBtfCache.resolve]] */
+export type BtfSource = string | Buffer | Btf
+
+/**
+ * Locate the BTF of the running kernel in a local copy of a
+ * BTFHub-style archive, laid out as
+ * `<root>/<os id>/<os version>/<arch>/<kernel release>.btf`
+ * (the files need to be extracted). `<root>/<kernel release>.btf`
+ * is also accepted.
+ * 
+ * @param root Archive directory
+ * @param release Kernel release (default: running kernel)
+ * @returns Path of the BTF, or `undefined` if not found
+ */
+export function findArchivedBtf(root: string, release: string = versions.kernel): string | undefined {
+    const candidates = [ join(root, `${release}.btf`) ]
+    try {
+        const osRelease = readFileSync('/etc/os-release', 'utf8')
+        const field = (name: string) => {
+            const m = new RegExp(`^${name}=("?)(.*)\\1$`, 'm').exec(osRelease)
+            return m ? m[2] : undefined
+        }
+        const arch = ({ x64: 'x86_64', arm64: 'arm64' } as { [arch: string]: string })[process.arch] || process.arch
+        const id = field('ID'), version = field('VERSION_ID')
+        if (id && version)
+            candidates.unshift(join(root, id, version, arch, `${release}.btf`))
+    } catch (e) {
+        // not identifiable, try the flat layout only
+    }
+    return candidates.find(x => existsSync(x))
+}
+
+const sha1 = (data: Uint8Array) => createHash('sha1').update(data).digest('hex')
+
+const fileStamp = (path: string) => {
+    const { size, mtimeMs, ino } = statSync(path)
+    return `${ino}:${size}:${mtimeMs}`
+}
+
+const BTF_MAGIC = 0xeb9f
+const BTF_HEADER_SIZE = 24
+const ELF_MAGIC = 0x464c457f // '\x7fELF'
+
+/**
+ * Cheap sanity check of a BTF, without parsing it: raw BTF needs a
+ * valid header and sections that fit in `size`. ELF files are left
+ * for libbpf to check.
+ */
+function checkBtfHeader(head: Buffer, size: number, what: string) {
+    if (head.length >= 4 && head.readUInt32LE(0) === ELF_MAGIC)
+        return
+    if (head.length < BTF_HEADER_SIZE || head.readUInt16LE(0) !== BTF_MAGIC || head.readUInt8(2) !== 1)
+        throw new Error(`${what} isn't BTF or ELF`)
+    const hdrLen = head.readUInt32LE(4)
+    const typesEnd = head.readUInt32LE(8) + head.readUInt32LE(12)
+    const stringsEnd = head.readUInt32LE(16) + head.readUInt32LE(20)
+    if (hdrLen < BTF_HEADER_SIZE || hdrLen + Math.max(typesEnd, stringsEnd) > size)
+        throw new Error(`${what} is truncated`)
+}
+
+function checkBtfFile(path: string) {
+    const fd = openSync(path, 'r')
+    try {
+        const head = Buffer.alloc(BTF_HEADER_SIZE)
+        const length = readSync(fd, head, 0, head.length, 0)
+        checkBtfHeader(head.subarray(0, length), statSync(path).size, path)
+    } finally {
+        closeSync(fd)
+    }
+}
+
+/**
+ * Cache of target BTFs used to load objects with [[loadObject]].
+ * Each BTF is validated once (only its header is checked, libbpf
+ * parses it when loading), and in-memory blobs are written to a
+ * file once, so the following loads using the same BTF just hand
+ * its path to libbpf. Parsed BTFs can be obtained through [[get]],
+ * e.g. to resolve layouts.
+ * 
+ * Blob files are named after their hash, and are checked against
+ * it before being used. The directory must belong to the current
+ * user and not be writable by others.
+ */
+export class TargetBtfCache {
+    /** Directory in-memory blobs are written to */
+    readonly dir: string
+    /** stamps of the validated files, by path */
+    private readonly stamps = new Map<string, string>()
+
+    /**
+     * @param dir Directory to write in-memory blobs to (default:
+     * `node_bpf/btf` under the user's cache dir, e.g. `~/.cache`)
+     */
+    constructor(dir: string = join(process.env.XDG_CACHE_HOME || join(homedir(), '.cache'), 'node_bpf', 'btf')) {
+        this.dir = dir
+    }
+
+    /**
+     * Parse a BTF. Parsed BTFs aren't kept, so each call parses
+     * it again (except for parsed BTFs, which are returned as is).
+     * 
+     * @param source BTF file path, raw blob, or parsed BTF
+     */
+    get(source: BtfSource): Btf {
+        if (source instanceof Btf)
+            return source
+        return new Btf(this.resolve(source))
+    }
+
+    /**
+     * Get a path libbpf can load a BTF from, validating it first.
+     * Files are revalidated if they change.
+     * 
+     * @param source BTF file path (raw BTF or ELF), raw blob,
+     * or parsed BTF
+     * @returns Path of the BTF
+     */
+    resolve(source: BtfSource): string {
+        if (source instanceof Btf) {
+            if (source.path === undefined)
+                throw new Error('BTF loaded by ID has no path')
+            return source.path
+        }
+        let path: string
+        if (typeof source === 'string') {
+            path = source
+        } else {
+            checkBtfHeader(source, source.length, 'BTF blob')
+            const hash = sha1(source)
+            path = join(this.dir, `${hash}.btf`)
+            const stamp = this.stamps.get(path)
+            if (stamp === undefined || !existsSync(path) || stamp !== fileStamp(path)) {
+                // the file may come from a previous run (or have changed), check it holds the blob
+                this.checkDir()
+                if (!existsSync(path) || sha1(readFileSync(path)) !== hash)
+                    this.write(path, source)
+            }
+        }
+        const stamp = fileStamp(path)
+        if (this.stamps.get(path) !== stamp) {
+            checkBtfFile(path)
+            this.stamps.set(path, stamp)
+        }
+        return path
+    }
+
+    // create the directory if needed, and make sure only we can write to it
+    private checkDir() {
+        mkdirSync(this.dir, { recursive: true, mode: 0o700 })
+        const st = lstatSync(this.dir)
+        if (!st.isDirectory() || st.uid !== process.getuid() || (st.mode & 0o022))
+            throw new Error(`BTF cache directory ${this.dir} must be a directory owned by the current user, and not writable by others`)
+    }
+
+    private write(path: string, data: Uint8Array) {
+        // random name, created exclusively: can't be pre-created or be a symlink
+        const tmp = `${path}.${randomBytes(8).toString('hex')}.tmp`
+        try {
+            writeFileSync(tmp, data, { flag: 'wx', mode: 0o600 })
+            renameSync(tmp, path)
+        } catch (e) {
+            try { unlinkSync(tmp) } catch (_) { /* ignore */ }
+            throw e
+        }
+    }
+
+    /** Drop all entries (files written are left in place) */
+    clear(): void {
+        this.stamps.clear()
+    }
+}
+
+/** Cache used by [[loadObject]] when none is passed */
+export const defaultBtfCache = new TargetBtfCache()
+
+export interface ObjectLoadOptions {
+    /** Object name (default: derived from the file name) */
+    name?: string
+    /**
+     * BTF to relocate the object against (CO-RE), instead of
+     * the running kernel's. Use it on kernels without embedded
+     * BTF ([[VMLINUX_BTF_PATH]]).
+     */
+    targetBtf?: BtfSource
+    /**
+     * If no `targetBtf` is passed and the kernel has no embedded
+     * BTF, look for it in this archive (see [[findArchivedBtf]])
+     */
+    btfArchive?: string
+    /** Cache to resolve `targetBtf` through (default: [[defaultBtfCache]]) */
+    btfCache?: TargetBtfCache
+    /** libbpf log level for program loading */
+    logLevel?: number
+}
+
+/** Maps and programs of an object loaded with [[loadObject]] */
+export interface LoadedObject {
+    /** Maps, by name */
+    maps: { [name: string]: MapRef }
+    /** Programs, by (function) name */
+    programs: { [name: string]: ProgramRef }
+    /** Close all maps and programs */
+    close(): void
+}
+
+/**
+ * Load an ELF object (as produced by `clang -target bpf`) through
+ * libbpf: maps are created, programs relocated and loaded, and
+ * references to both returned. Objects using CO-RE relocations
+ * are relocated against the kernel's BTF, or the one passed in
+ * `targetBtf`, so one object can run on many kernels.
+ * 
+ * @param file Object file path, or contents
+ * @param options Load options
+ * @returns Loaded maps and programs (the caller owns them)
+ */
+export function loadObject(file: string | Buffer, options?: ObjectLoadOptions): LoadedObject {
+    let target = options?.targetBtf
+    if (target === undefined && options?.btfArchive !== undefined && !existsSync(VMLINUX_BTF_PATH)) {
+        target = findArchivedBtf(options.btfArchive)
+        if (target === undefined)
+            throw new Error(`No BTF for kernel ${versions.kernel} in ${options.btfArchive}`)
+    }
+    const targetPath = target === undefined ? undefined :
+        (options?.btfCache || defaultBtfCache).resolve(target)
+
+    const [ status, maps, programs ] = native.loadObject(file, options?.name, targetPath, options?.logLevel)
+    checkStatus('bpf_object__load_xattr', status)
+    const result: LoadedObject = {
+        maps: {},
+        programs: {},
+        close() {
+            Object.values(this.programs).forEach(x => x.close())
+            Object.values(this.maps).forEach(x => x.close())
+        },
+    }
+    // own every FD first, so none is leaked if querying one fails
+    const owned: { fd: number, close(): void }[] = [ ...maps, ...programs ].map(x => new native.FDRef(x[1]))
+    try {
+        (maps as [string, number][]).forEach(([ name ], i) =>
+            result.maps[name] = createMapRef(owned[i].fd))
+        ;(programs as [string, number][]).forEach(([ name ], i) =>
+            result.programs[name] = createProgramRef(owned[maps.length + i].fd))
+    } catch (e) {
+        result.close()
+        throw e
+    } finally {
+        owned.forEach(x => x.close())
+    }
+    return result
+}
@@ -0,0 +1,500 @@
+import { constants } from 'os'
+import { statSync } from 'fs'
+import { native, numPossibleCpus } from './util'
+import { BPFError, checkStatus } from './exception'
+import { MapType, ProgramType, PerfType, PerfSwId } from './constants'
+import { MapRef, createMap } from './map/common'
+import { RawMap } from './map/map'
+import { StackTraceMap, createStackTraceMap } from './map/stack'
+import { ProgramRef, loadProgram } from './program'
+import { LinkRef, PerfEventAttr, attachPerfEvent, attachTracepoint, tracepointFormat } from './link'
+import { KernelSymbolizer } from './symbolize'
+import { Assembler, Reg, Size, JmpOp, AluOp, Helper } from './asm'
+const { ENODEV } = constants.errno
+
+const BPF_F_USER_STACK = 1 << 8
+const BPF_ANY = 0, BPF_NOEXIST = 1
+
+/**
+ * Size of the keys of the counts map used by [[stackSampleProgram]]:
+ * the process ID (`u32`), kernel stack ID and user stack ID (`s32`,
+ * negative if not collected), followed by 4 bytes of padding.
+ */
+export const SAMPLE_KEY_SIZE = 16
+
+/** Maps used by [[stackSampleProgram]] */
+export interface StackSampleMaps {
+    /** `STACK_TRACE` map where stacks are stored */
+    stacks: MapRef
+    /** `HASH` map counting samples by key (see [[SAMPLE_KEY_SIZE]]), with `u64` values */
+    counts: MapRef
+}
+
+/** Which stacks to collect */
+export interface StackSampleOptions {
+    /** Collect kernel stacks (default: true) */
+    kernel?: boolean
+    /** Collect user stacks (default: true) */
+    user?: boolean
+}
+
+/**
+ * Build a `PERF_EVENT` program that aggregates samples in-kernel:
+ * it collects the stacks of the current task into `stacks`, and
+ * increments the count of the (process, kernel stack, user stack)
+ * key in `counts`. This way, only unique stacks are ever copied
+ * to userspace.
+ * 
+ * @param maps Maps to use
+ * @param options Which stacks to collect
+ * @returns Program bytecode
+ */
+export function stackSampleProgram(maps: StackSampleMaps, options?: StackSampleOptions): Buffer {
+    const asm = new Assembler()
+        .movReg(Reg.R6, Reg.R1)
+        .call(Helper.GET_CURRENT_PID_TGID)
+        .aluImm(AluOp.RSH, Reg.R0, 32)
+        .stxMem(Size.W, Reg.R10, Reg.R0, -16)
+        .stMem(Size.W, Reg.R10, -4, 0)
+    collectStacks(asm, maps, options, -12)
+    asm.movImm(Reg.R1, 1)
+    return addCount(asm, maps, -16, Reg.R1, -24)
+        .label('out')
+        .movImm(Reg.R0, 0)
+        .exit()
+        .build()
+}
+
+// Store the kernel and user stack IDs at off, off + 4 (R6 must hold the context)
+function collectStacks(asm: Assembler, maps: StackSampleMaps, options: StackSampleOptions | undefined, off: number) {
+    const { kernel = true, user = true } = options || {}
+    const collect = (flags: number, off: number) => {
+        asm.movReg(Reg.R1, Reg.R6)
+            .ldMapFd(Reg.R2, maps.stacks.fd)
+            .movImm(Reg.R3, flags)
+            .call(Helper.GET_STACKID)
+            .stxMem(Size.W, Reg.R10, Reg.R0, off)
+    }
+    kernel ? collect(0, off) : asm.stMem(Size.W, Reg.R10, off, -1)
+    user ? collect(BPF_F_USER_STACK, off + 4) : asm.stMem(Size.W, Reg.R10, off + 4, -1)
+}
+
+// Add the value in reg to the count of the key at keyOff, storing
+// it at valueOff first (so reg may be clobbered), then jump to 'out'
+function addCount(asm: Assembler, maps: StackSampleMaps, keyOff: number, reg: Reg, valueOff: number) {
+    return asm
+        .stxMem(Size.DW, Reg.R10, reg, valueOff)
+        .ldMapFd(Reg.R1, maps.counts.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, keyOff)
+        .call(Helper.MAP_LOOKUP_ELEM)
+        .jmpImm(JmpOp.JEQ, Reg.R0, 0, 'new')
+        .ldxMem(Size.DW, Reg.R1, Reg.R10, valueOff)
+        .atomicAdd(Size.DW, Reg.R0, Reg.R1, 0)
+        .ja('out')
+        .label('new')
+        // another CPU may insert the key first, losing this value
+        .ldMapFd(Reg.R1, maps.counts.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, keyOff)
+        .movReg(Reg.R3, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R3, valueOff)
+        .movImm(Reg.R4, BPF_NOEXIST)
+        .call(Helper.MAP_UPDATE_ELEM)
+}
+
+export interface SamplingOptions {
+    /** Samples per second, on each CPU (default: 49) */
+    frequency?: number
+    /** Take a sample every this many events instead of at a fixed frequency */
+    period?: number
+    /** Event to sample on (default: the `CPU_CLOCK` software event) */
+    event?: { type: PerfType, config?: number }
+    /** Only sample this process (default: all) */
+    pid?: number
+    /** CPUs to sample on (default: all possible CPUs) */
+    cpus?: number[]
+}
+
+/**
+ * Attach a `PERF_EVENT` program to a sampling event on each CPU
+ * (see [[attachPerfEvent]]). Offline CPUs are skipped.
+ * 
+ * Since Linux 4.9.
+ * 
+ * @param prog Program to attach
+ * @param options Sampling options
+ * @returns [[LinkRef]] for each CPU's attachment
+ */
+export function attachSampling(prog: ProgramRef, options?: SamplingOptions): LinkRef[] {
+    const { type = PerfType.SOFTWARE, config = PerfSwId.CPU_CLOCK } = options?.event || {}
+    const attr: PerfEventAttr = options?.period !== undefined ?
+        { type, config, samplePeriod: options.period } :
+        { type, config, sampleFreq: options?.frequency || 49 }
+    const cpus = options?.cpus || Array.from({ length: numPossibleCpus() }, (_, i) => i)
+    const links: LinkRef[] = []
+    try {
+        for (const cpu of cpus) {
+            try {
+                links.push(attachPerfEvent(prog, attr, { cpu, pid: options?.pid }))
+            } catch (e) {
+                if (!(e instanceof BPFError && e.errno === ENODEV))
+                    throw e
+            }
+        }
+    } catch (e) {
+        links.forEach(link => link.close())
+        throw e
+    }
+    return links
+}
+
+/**
+ * Aggregated samples of a stack, as returned by [[Profiler.read]]
+ * and [[OffCpuProfiler.read]]
+ */
+export interface StackSample {
+    /** Process ID */
+    pid: number
+    /** Kernel stack, if collected (innermost first) */
+    kernelStack?: BigUint64Array
+    /** User stack, if collected (innermost first) */
+    userStack?: BigUint64Array
+    /**
+     * Number of samples (for [[OffCpuProfiler]], nanoseconds
+     * spent off-CPU)
+     */
+    count: number
+}
+
+export interface FoldOptions {
+    /** Remove the samples (and stacks) that were read (default: true) */
+    clear?: boolean
+    /** Symbolize kernel frames with this symbolizer */
+    kernelSymbolizer?: KernelSymbolizer
+}
+
+/**
+ * Read the stacks counted by [[stackSampleProgram]] or
+ * [[offCpuProgram]] in the format used by flame graph tools
+ * (*folded stacks*): one line per unique stack, with the process
+ * ID and the frames (outermost first, user frames followed by
+ * kernel frames) separated by `;`, then a space and the count.
+ * 
+ * The maps are read (and cleared) in batches, and the output is
+ * produced natively. User frames are printed as addresses; use
+ * [[Profiler.read]] and [[UserSymbolizer]] to resolve them.
+ * 
+ * @param maps Maps to read
+ * @param options Fold options
+ * @returns Folded stacks
+ */
+export function foldStackCounts(maps: StackSampleMaps, options?: FoldOptions): string {
+    const [ status, folded ] = native.foldStackCounts(maps.counts.fd, maps.stacks.fd,
+        maps.stacks.valueSize, options?.clear !== false, options?.kernelSymbolizer?.native)
+    checkStatus('bpf_map_lookup_batch', status)
+    return folded
+}
+
+export interface ProfilerOptions extends SamplingOptions, StackSampleOptions {
+    /** Max unique stacks stored between reads (default: 16384) */
+    maxStacks?: number
+    /** Max frames per stack (default: 127) */
+    maxDepth?: number
+}
+
+/** Base of profilers aggregating stacks with [[StackSampleMaps]] */
+class StackCountProfiler {
+    readonly maps: StackSampleMaps
+    readonly stacks: StackTraceMap
+    private readonly counts: RawMap
+    private readonly refs: { close(): void }[]
+
+    /**
+     * Create the maps and call `start` to load and attach
+     * the programs, which adds the resources to release
+     * on [[close]] to `refs`.
+     */
+    protected constructor(
+        options: ProfilerOptions | undefined,
+        start: (maps: StackSampleMaps, refs: { close(): void }[]) => void,
+    ) {
+        const maxStacks = options?.maxStacks || 16384
+        const stacks = createStackTraceMap(maxStacks, options?.maxDepth)
+        const refs: { close(): void }[] = [ stacks.ref ]
+        try {
+            const counts = createMap({
+                type: MapType.HASH,
+                keySize: SAMPLE_KEY_SIZE,
+                valueSize: 8,
+                maxEntries: maxStacks,
+            })
+            refs.push(counts)
+            const maps = { stacks: stacks.ref, counts }
+            start(maps, refs)
+            this.maps = maps
+            this.stacks = stacks
+            this.counts = new RawMap(counts)
+            this.refs = refs
+        } catch (e) {
+            refs.reverse().forEach(x => x.close())
+            throw e
+        }
+    }
+
+    /**
+     * Collect the samples aggregated so far.
+     * 
+     * Stacks are removed from the maps as they're read (unless
+     * `clear` is false), so samples taken during the read
+     * may have their stacks missing.
+     * 
+     * @param clear Remove the samples (and stacks) that were read
+     * @returns Aggregated samples
+     */
+    read(clear: boolean = true): StackSample[] {
+        const entries = [...this.counts.entries()]
+        const samples = entries.map(([ key, value ]) => ({
+            pid: key.readUInt32LE(0),
+            kernelId: key.readInt32LE(4),
+            userId: key.readInt32LE(8),
+            count: Number(value.readBigUInt64LE(0)),
+        }))
+        if (clear)
+            entries.forEach(([ key ]) => this.counts.delete(key))
+
+        const uniqueIds = new Set<number>()
+        for (const { kernelId, userId } of samples) {
+            kernelId >= 0 && uniqueIds.add(kernelId)
+            userId >= 0 && uniqueIds.add(userId)
+        }
+        const ids = [...uniqueIds]
+        const { frames, offsets } = this.stacks.lookupBatch(ids, { delete: clear })
+        const stacks = new Map<number, BigUint64Array>()
+        ids.forEach((id, i) => stacks.set(id, (frames as BigUint64Array).slice(offsets[i], offsets[i+1])))
+
+        return samples.map(({ pid, kernelId, userId, count }) => {
+            const sample: StackSample = { pid, count }
+            if (stacks.has(kernelId))
+                sample.kernelStack = stacks.get(kernelId)
+            if (stacks.has(userId))
+                sample.userStack = stacks.get(userId)
+            return sample
+        })
+    }
+
+    /**
+     * Collect the samples aggregated so far as folded stacks,
+     * see [[foldStackCounts]].
+     * 
+     * @param options Fold options
+     */
+    readFolded(options?: FoldOptions): string {
+        return foldStackCounts(this.maps, options)
+    }
+
+    /** Stop profiling and release the maps */
+    close(): void {
+        this.refs.reverse().forEach(x => x.close())
+        this.refs.length = 0
+    }
+}
+
+/**
+ * Sampling (on-CPU) profiler: samples the stacks of running tasks
+ * on every CPU (see [[attachSampling]]), aggregating them in-kernel
+ * with [[stackSampleProgram]]. Call [[read]] or [[readFolded]]
+ * periodically to collect the samples since the last read, and
+ * resolve the frames with [[KernelSymbolizer]] and [[UserSymbolizer]].
+ * 
+ * Stacks are deduplicated by the kernel, and each read copies
+ * every unique stack once, so the overhead is mostly determined
+ * by the sampling frequency.
+ * 
+ * Since Linux 4.9.
+ */
+export class Profiler extends StackCountProfiler {
+    /**
+     * Create the maps, load the program and start sampling.
+     * 
+     * @param options Profiler options
+     */
+    constructor(options?: ProfilerOptions) {
+        super(options, (maps, refs) => {
+            const prog = loadProgram({
+                type: ProgramType.PERF_EVENT,
+                insns: stackSampleProgram(maps, options),
+                license: 'GPL',
+            })
+            refs.push(prog)
+            refs.push(...attachSampling(prog, options))
+        })
+    }
+}
+
+/** Offsets of the fields of `sched:sched_switch` used by [[offCpuProgram]] */
+export interface SchedSwitchOffsets {
+    prevPid: number
+    nextPid: number
+}
+
+/**
+ * Get the offsets of `prev_pid` and `next_pid` in the records
+ * of `sched:sched_switch`, from its tracefs format.
+ */
+export function schedSwitchOffsets(): SchedSwitchOffsets {
+    const fields = tracepointFormat('sched', 'sched_switch')
+    const offset = (name: string) => {
+        const field = fields.find(x => x.name === name)
+        if (field === undefined || field.size !== 4)
+            throw new Error(`Unexpected sched_switch format: no 4-byte ${name}`)
+        return field.offset
+    }
+    return { prevPid: offset('prev_pid'), nextPid: offset('next_pid') }
+}
+
+/** Maps used by [[offCpuProgram]] */
+export interface OffCpuMaps extends StackSampleMaps {
+    /**
+     * `HASH` map holding blocked tasks, keyed by thread ID (`u32`),
+     * with 24-byte values: when it was switched out (`u64`), then
+     * the first 12 bytes of its [[SAMPLE_KEY_SIZE]] key
+     */
+    start: MapRef
+}
+
+/** Which tasks [[offCpuProgram]] accounts */
+export interface OffCpuFilter {
+    /** Only this process */
+    pid?: number
+    /** Only tasks in this cgroup (v2), by path or ID (since Linux 4.18) */
+    cgroup?: string | bigint
+}
+
+/**
+ * Build a `TRACEPOINT` program, to be attached to
+ * `sched:sched_switch`, that aggregates blocked time in-kernel:
+ * when a task is switched out, it records the time and its stacks
+ * in `start`, and when it's switched back in, the time it spent
+ * off-CPU is added to the (process, kernel stack, user stack) key
+ * in `counts`.
+ * 
+ * @param maps Maps to use
+ * @param options Which tasks and stacks to account
+ * @param offsets Field offsets (default: read from tracefs,
+ * see [[schedSwitchOffsets]])
+ * @returns Program bytecode
+ */
+export function offCpuProgram(
+    maps: OffCpuMaps,
+    options?: OffCpuFilter & StackSampleOptions,
+    offsets: SchedSwitchOffsets = schedSwitchOffsets(),
+): Buffer {
+    const asm = new Assembler()
+        .movReg(Reg.R6, Reg.R1)
+        // switch out: current task is prev
+        .ldxMem(Size.W, Reg.R7, Reg.R6, offsets.prevPid)
+        .jmpImm(JmpOp.JEQ, Reg.R7, 0, 'in')
+        .call(Helper.GET_CURRENT_PID_TGID)
+        .aluImm(AluOp.RSH, Reg.R0, 32)
+        .movReg(Reg.R8, Reg.R0)
+    if (options?.pid !== undefined)
+        asm.jmpImm(JmpOp.JNE, Reg.R8, options.pid, 'in')
+    if (options?.cgroup !== undefined) {
+        const id = typeof options.cgroup === 'bigint' ?
+            options.cgroup : statSync(options.cgroup, { bigint: true }).ino
+        asm.call(Helper.GET_CURRENT_CGROUP_ID)
+            .ldImm64(Reg.R1, id)
+            .jmpReg(JmpOp.JNE, Reg.R0, Reg.R1, 'in')
+    }
+    asm.call(Helper.KTIME_GET_NS)
+        .stxMem(Size.DW, Reg.R10, Reg.R0, -32)
+        .stxMem(Size.W, Reg.R10, Reg.R8, -24)
+    collectStacks(asm, maps, options, -20)
+    asm.stMem(Size.W, Reg.R10, -12, 0)
+        .stxMem(Size.W, Reg.R10, Reg.R7, -4)
+        .ldMapFd(Reg.R1, maps.start.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, -4)
+        .movReg(Reg.R3, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R3, -32)
+        .movImm(Reg.R4, BPF_ANY)
+        .call(Helper.MAP_UPDATE_ELEM)
+
+        // switch in: account the time next was blocked, if recorded
+        .label('in')
+        .ldxMem(Size.W, Reg.R7, Reg.R6, offsets.nextPid)
+        .stxMem(Size.W, Reg.R10, Reg.R7, -4)
+        .ldMapFd(Reg.R1, maps.start.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, -4)
+        .call(Helper.MAP_LOOKUP_ELEM)
+        .jmpImm(JmpOp.JEQ, Reg.R0, 0, 'out')
+        .movReg(Reg.R8, Reg.R0)
+    for (const off of [ 0, 4, 8 ])
+        asm.ldxMem(Size.W, Reg.R1, Reg.R8, 8 + off)
+            .stxMem(Size.W, Reg.R10, Reg.R1, -48 + off)
+    asm.stMem(Size.W, Reg.R10, -36, 0)
+        .call(Helper.KTIME_GET_NS)
+        .ldxMem(Size.DW, Reg.R1, Reg.R8, 0)
+        .aluReg(AluOp.SUB, Reg.R0, Reg.R1)
+        .movReg(Reg.R9, Reg.R0)
+        .ldMapFd(Reg.R1, maps.start.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, -4)
+        .call(Helper.MAP_DELETE_ELEM)
+    return addCount(asm, maps, -48, Reg.R9, -56)
+        .label('out')
+        .movImm(Reg.R0, 0)
+        .exit()
+        .build()
+}
+
+export interface OffCpuProfilerOptions extends OffCpuFilter, StackSampleOptions {
+    /** Max unique stacks stored between reads (default: 16384) */
+    maxStacks?: number
+    /** Max frames per stack (default: 127) */
+    maxDepth?: number
+    /** Max tasks blocked at the same time (default: 32768) */
+    maxTasks?: number
+}
+
+/**
+ * Off-CPU profiler: accounts the time tasks spend blocked (waiting
+ * for locks, I/O, ...) to the stacks they blocked at, aggregating
+ * it in-kernel with [[offCpuProgram]]. Call [[read]] or
+ * [[readFolded]] periodically to collect it; counts are in
+ * nanoseconds.
+ * 
+ * Time is accounted when the task is switched back in, so tasks
+ * still blocked don't show up until they wake up. This includes
+ * time spent runnable but preempted.
+ * 
+ * Since Linux 4.9.
+ */
+export class OffCpuProfiler extends StackCountProfiler {
+    /**
+     * Create the maps, load the program and attach it
+     * to `sched:sched_switch`.
+     * 
+     * @param options Profiler options
+     */
+    constructor(options?: OffCpuProfilerOptions) {
+        super(options, (maps, refs) => {
+            const start = createMap({
+                type: MapType.HASH,
+                keySize: 4,
+                valueSize: 24,
+                maxEntries: options?.maxTasks || 32768,
+            })
+            refs.push(start)
+            const prog = loadProgram({
+                type: ProgramType.TRACEPOINT,
+                insns: offCpuProgram({ ...maps, start }, options),
+                license: 'GPL',
+            })
+            refs.push(prog)
+            refs.push(attachTracepoint(prog, 'sched', 'sched_switch'))
+        })
+    }
+}
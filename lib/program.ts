@@ -0,0 +1,241 @@
+import { native, FD } from './util'
+import { checkStatus, BPFError } from './exception'
+import { ProgramType, AttachType } from './constants'
+import { MapRef, openMap } from './map/common'
+
+/** Size of a single eBPF instruction (`struct bpf_insn`), in bytes */
+export const INSN_SIZE = 8
+
+/** Default size of the buffer used to collect the verifier log */
+const DEFAULT_LOG_SIZE = 1 << 20
+
+export interface ProgramDefOptional {
+    /** Program name (might get truncated if longer than [[OBJ_NAME_LEN]]) (since Linux 4.15) */
+    name?: string
+    /**
+     * Expected attach type, required by some program types
+     * (since Linux 4.17), see [[AttachType]]
+     */
+    expectedAttachType?: AttachType
+    /**
+     * Kernel version the program was built for, in
+     * `KERNEL_VERSION(a,b,c)` format. Only checked for `KPROBE`
+     * programs on kernels older than 5.0. Defaults to the running kernel.
+     */
+    kernVersion?: number
+    /** For offloading, ifindex of network device to load the program on (since Linux 4.16) */
+    ifindex?: number
+    /**
+     * For `TRACING`, `LSM` and `EXT` programs: BTF ID of the attach
+     * target (a kernel function, or a function of [[attachProgFd]])
+     */
+    attachBtfId?: number
+    /** For `EXT` and `TRACING` programs attaching to another program: FD of that program */
+    attachProgFd?: number
+    /** Program flags (`BPF_F_STRICT_ALIGNMENT`, `BPF_F_SLEEPABLE`, ...) */
+    flags?: number
+    /**
+     * Verifier log level. If zero (the default), the log is only
+     * collected if loading fails, and attached to the thrown error.
+     */
+    logLevel?: number
+    /**
+     * Size of the verifier log buffer, in bytes. If the log doesn't fit,
+     * loading fails with `ENOSPC`.
+     */
+    logSize?: number
+}
+
+/**
+ * Parameters to load an eBPF program.
+ */
+export interface ProgramDef extends ProgramDefOptional {
+    /**
+     * Program type. This decides the context the program runs
+     * in and the helpers it can call. Keep in mind that not all
+     * of the types may be supported by your kernel.
+     */
+    type: ProgramType
+    /**
+     * Program bytecode: `struct bpf_insn` items in native endianness,
+     * [[INSN_SIZE]] bytes each
+     */
+    insns: Uint8Array
+    /**
+     * License string. GPL-only helpers can only be used if this
+     * is GPL compatible (i.e. `'GPL'` or `'Dual MIT/GPL'`).
+     */
+    license: string
+}
+
+/**
+ * Information reported about a loaded eBPF program.
+ * 
+ * Optional parameters are present if the running kernel version
+ * supports them.
+ */
+export interface ProgramInfo {
+    /** Program type */
+    type: ProgramType
+    /** Program ID (since Linux 4.13) */
+    id: number
+    /** Hash of the program bytecode, as hex string */
+    tag: string
+    /** Load time, in nanoseconds since boot */
+    loadTime: bigint
+    /** UID of the process that loaded the program */
+    createdByUid: number
+
+    // Optional
+
+    /** Program name (might get truncated if longer than [[OBJ_NAME_LEN]]) (since Linux 4.15) */
+    name?: string
+    /** For offloading, ifindex of network device the program was loaded on (reported since Linux 4.16) */
+    ifindex?: number
+    /** Whether the program license is GPL compatible (since Linux 4.18) */
+    gplCompatible?: boolean
+
+    netnsDev?: bigint
+    netnsIno?: bigint
+
+    /** ID of the program's BTF object, or zero (since Linux 5.0) */
+    btfId?: number
+}
+
+/**
+ * Object holding a file descriptor (plus information) for a
+ * loaded eBPF program. Same semantics as [[MapRef]]: the object
+ * must own the file descriptor, and the program is unloaded
+ * when the last reference to it is closed (attachments and
+ * pins also hold references).
+ */
+export interface ProgramRef extends ProgramInfo {
+    /**
+     * Readonly property holding the FD owned by this object.
+     * Don't store this value elsewhere, query it
+     * from here every time to make sure it's valid.
+     * 
+     * Throws if `close()` was successfully called.
+     */
+    readonly fd: FD
+
+    /**
+     * Closes the FD early. Instances don't necessarily support
+     * this operation (and will throw in that case), but all
+     * instances returned by this module do.
+     * 
+     * If supported, calling it a second time does nothing.
+     */
+    close(): void
+}
+
+/**
+ * Load a new eBPF program into the kernel. It is recommended to
+ * use [[close]] if you're no longer going to need it at some point.
+ * 
+ * If the verifier rejects the program, the thrown [[BPFError]]
+ * includes the verifier log in its `log` field.
+ * 
+ * @param desc Program parameters
+ * @returns [[ProgramRef]] instance, holding a reference
+ * to the newly loaded program, and its information
+ */
+export function loadProgram(desc: ProgramDef): ProgramRef {
+    if (desc.insns.length % INSN_SIZE !== 0)
+        throw new Error(`Bytecode length ${desc.insns.length} isn't a multiple of ${INSN_SIZE}`)
+    const logBuf = Buffer.allocUnsafe(desc.logSize || DEFAULT_LOG_SIZE)
+    const status: number = native.loadProgram(desc, logBuf)
+    if (status < 0) {
+        const error = new BPFError(-status, 'bpf_load_program_xattr')
+        const end = logBuf.indexOf(0)
+        const log = logBuf.toString('utf8', 0, end === -1 ? logBuf.length : end)
+        if (log)
+            error.log = log
+        throw error
+    }
+    return createProgramRef(status, { transfer: true })
+}
+
+/**
+ * Given an existing file descriptor pointing to an eBPF program,
+ * obtain its information and return a [[ProgramRef]] instance
+ * pointing to that program (but creating a duplicate descriptor).
+ * 
+ * Since Linux 4.13.
+ * 
+ * If `transfer` is `true`, the passed FD itself is used
+ * (taking ownership of it) instead of creating a new FD first.
+ * Do this only if the FD isn't being used anywhere else.
+ * 
+ * Note that there is no way to check whether the FD actually
+ * points to an eBPF program, the caller is responsible to check first.
+ * 
+ * @param fd file descriptor
+ * @param options options
+ * @returns [[ProgramRef]] instance
+ */
+export function createProgramRef(fd: number, options?: {
+    transfer?: boolean
+}): ProgramRef {
+    if (!(options && options.transfer)) {
+        fd = native.dup(fd)
+        checkStatus('dup', fd)
+    }
+    const ref = new native.FDRef(fd)
+
+    const [ status, info ] = native.getProgInfo(fd)
+    checkStatus('bpf_obj_get_info_by_fd', status)
+    Object.assign(ref, info)
+    Object.freeze(ref) // prevent changes to the info
+    return ref
+}
+
+/**
+ * Get a [[ProgramRef]] to the eBPF program with specified ID.
+ * 
+ * Since Linux 4.13.
+ * 
+ * @param id Program ID
+ * @returns [[ProgramRef]] instance
+ */
+export function openProgram(id: number): ProgramRef {
+    const status = native.progGetFdById(id)
+    checkStatus('bpf_prog_get_fd_by_id', status)
+    return createProgramRef(status, { transfer: true })
+}
+
+/**
+ * Find the BTF ID of a kernel function or type in the vmlinux
+ * BTF, to be used as [[attachBtfId]] when loading `TRACING` or
+ * `LSM` programs. The name is prefixed according to the attach
+ * type (i.e. for `TRACE_ITER`, passing `'task'` looks up
+ * `bpf_iter_task`).
+ * 
+ * Requires a kernel with embedded BTF (`CONFIG_DEBUG_INFO_BTF`).
+ * 
+ * @param name Function name, without prefix
+ * @param attachType Attach type the program will be loaded with
+ * @returns BTF type ID
+ */
+export function findVmlinuxBtfId(name: string, attachType: AttachType): number {
+    const status = native.findVmlinuxBtfId(name, attachType)
+    checkStatus('libbpf_find_vmlinux_btf_id', status)
+    return status
+}
+
+/**
+ * Get [[MapRef]]s to the maps used by a loaded program. This is
+ * useful to load a new version of a program that reuses the same
+ * maps (and so, keeps its state), see [[migrateLink]].
+ * 
+ * Since Linux 4.13.
+ * 
+ * @param prog Program to query
+ * @returns References to the program's maps (which should
+ * be closed when no longer needed)
+ */
+export function getProgramMaps(prog: ProgramRef): MapRef[] {
+    const [ status, ids, count ] = native.getProgMapIds(prog.fd)
+    checkStatus('bpf_obj_get_info_by_fd', status)
+    return Array.from((ids as Uint32Array).subarray(0, count), id => openMap(id))
+}
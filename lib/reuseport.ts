@@ -0,0 +1,261 @@
+import { native, numPossibleCpus } from './util'
+import { checkStatus } from './exception'
+import { MapType, ProgramType } from './constants'
+import { MapRef, createMap, u32type } from './map/common'
+import { ConvMap } from './map/map'
+import { ConvArrayMap } from './map/array'
+import { ProgramRef, loadProgram } from './program'
+import { Assembler, Reg, Size, JmpOp, AluOp, Helper } from './asm'
+import { SocketLike, getSocketFd } from './socket'
+
+/**
+ * Attach an `SK_REUSEPORT` program to a socket
+ * (`SO_ATTACH_REUSEPORT_EBPF`). The program selects which socket
+ * of the reuseport group receives each new connection (or
+ * datagram), and applies to the whole group, so it only needs
+ * to be attached to one of its sockets.
+ * 
+ * The socket must have `SO_REUSEPORT` enabled and be bound.
+ * 
+ * Since Linux 4.19 (earlier kernels accept `SOCKET_FILTER`
+ * programs returning an index).
+ * 
+ * @param socket Socket in the reuseport group
+ * @param prog Program to attach
+ */
+export function attachReuseport(socket: SocketLike, prog: ProgramRef): void {
+    const status = native.attachReuseportProgram(getSocketFd(socket), prog.fd)
+    checkStatus('setsockopt', status)
+}
+
+/**
+ * Detach the program attached to the reuseport group of a socket
+ * (`SO_DETACH_REUSEPORT_BPF`), going back to hash-based selection.
+ * 
+ * Since Linux 5.3.
+ * 
+ * @param socket Socket in the reuseport group
+ */
+export function detachReuseport(socket: SocketLike): void {
+    const status = native.detachReuseportProgram(getSocketFd(socket))
+    checkStatus('setsockopt', status)
+}
+
+/**
+ * Create a TCP socket with `SO_REUSEPORT` enabled, bound to
+ * `host` and `port`, and start listening on it with
+ * `server.listen({ fd })`. Binding several sockets to the same
+ * address and port (as the same user) puts them in one
+ * reuseport group.
+ * 
+ * Node.js only sets `SO_REUSEPORT` itself through the `reusePort`
+ * listen option, available since v23.1, so this is needed on
+ * earlier versions.
+ * 
+ * @param port Port to bind to (0 picks one, see `server.address()`)
+ * @param host IPv4 or IPv6 address to bind to
+ * @returns FD of the socket (owned by the server once listening)
+ */
+export function bindReuseport(port: number, host: string = '0.0.0.0'): number {
+    const status = native.bindReuseport(host, port)
+    checkStatus('bind', status)
+    return status
+}
+
+/** Maps backing a [[ReuseportGroup]] */
+export interface ReuseportMaps {
+    /** `REUSEPORT_SOCKARRAY` map holding the sockets, by slot */
+    sockets: MapRef
+    /** `ARRAY` map holding the slot to use for each CPU */
+    steering: MapRef
+}
+
+/**
+ * Build the `SK_REUSEPORT` program used by [[ReuseportGroup]]:
+ * it looks up the receiving CPU in `steering`, and selects the
+ * socket at the resulting slot of `sockets`. If there's no entry,
+ * or the slot is empty, the kernel falls back to its default
+ * (hash-based) selection.
+ * 
+ * @param maps Maps to use
+ * @returns Program bytecode
+ */
+export function reuseportProgram(maps: ReuseportMaps): Buffer {
+    return new Assembler()
+        .movReg(Reg.R6, Reg.R1)
+        .call(Helper.GET_SMP_PROCESSOR_ID)
+        .stxMem(Size.W, Reg.R10, Reg.R0, -4)
+        .ldMapFd(Reg.R1, maps.steering.fd)
+        .movReg(Reg.R2, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R2, -4)
+        .call(Helper.MAP_LOOKUP_ELEM)
+        .jmpImm(JmpOp.JEQ, Reg.R0, 0, 'pass')
+        .ldxMem(Size.W, Reg.R0, Reg.R0, 0)
+        .stxMem(Size.W, Reg.R10, Reg.R0, -8)
+        .movReg(Reg.R1, Reg.R6)
+        .ldMapFd(Reg.R2, maps.sockets.fd)
+        .movReg(Reg.R3, Reg.R10)
+        .aluImm(AluOp.ADD, Reg.R3, -8)
+        .movImm(Reg.R4, 0)
+        .call(Helper.SK_SELECT_REUSEPORT)
+        .label('pass')
+        .movImm(Reg.R0, 1) // SK_PASS
+        .exit()
+        .build()
+}
+
+/**
+ * Steers incoming connections across a group of `SO_REUSEPORT`
+ * sockets (i.e. one listening socket per worker), so that they
+ * land on a chosen worker instead of being hashed.
+ * 
+ * Each socket occupies a slot, and every CPU is assigned a slot
+ * in the steering table: connections are delivered to the socket
+ * at the slot of the CPU that received them. By default, CPU `n`
+ * is assigned slot `n % size`, which keeps connections local to
+ * a worker pinned to that CPU. Call [[steer]] at any time to
+ * reassign CPUs (i.e. away from the most loaded workers).
+ * 
+ * Each worker needs its own `SO_REUSEPORT` listening socket: use
+ * the `reusePort` listen option (Node.js 23.1+), or [[bindReuseport]]
+ * with `server.listen({ fd })`. Create the group in the parent and
+ * pin its maps (see [[objPin]]), then open them from each worker
+ * with [[ReuseportGroup.open]] and [[add]] its listening socket.
+ * `cluster` workers hand `listen({ fd })` over to the primary
+ * process, so with [[bindReuseport]] create the workers with
+ * `child_process.fork` (or use worker threads) instead.
+ * 
+ * Since Linux 4.19.
+ */
+export class ReuseportGroup {
+    readonly maps: ReuseportMaps
+    /** Number of slots */
+    readonly size: number
+    private readonly sockets: ConvMap<number, number>
+    private readonly steering: ConvArrayMap<number>
+    private prog?: ProgramRef
+
+    private constructor(maps: ReuseportMaps) {
+        if (maps.sockets.type !== MapType.REUSEPORT_SOCKARRAY)
+            throw new Error(`Expected reuseport sockarray, got type ${MapType[maps.sockets.type] || maps.sockets.type}`)
+        this.maps = maps
+        this.size = maps.sockets.maxEntries
+        this.sockets = new ConvMap(maps.sockets, u32type, u32type)
+        this.steering = new ConvArrayMap(maps.steering, u32type)
+    }
+
+    /**
+     * Create a new group, with CPU-affine steering.
+     * 
+     * @param size Number of slots (i.e. workers)
+     * @returns Group instance
+     */
+    static create(size: number): ReuseportGroup {
+        const sockets = createMap({
+            type: MapType.REUSEPORT_SOCKARRAY,
+            keySize: 4,
+            valueSize: 4,
+            maxEntries: size,
+        })
+        let steering: MapRef
+        try {
+            steering = createMap({
+                type: MapType.ARRAY,
+                keySize: 4,
+                valueSize: 4,
+                maxEntries: numPossibleCpus(),
+            })
+        } catch (e) {
+            sockets.close()
+            throw e
+        }
+        const group = new ReuseportGroup({ sockets, steering })
+        for (let cpu = 0; cpu < group.steering.length; cpu++)
+            group.steering.set(cpu, cpu % size)
+        return group
+    }
+
+    /**
+     * Operate on the maps of an existing group (i.e. opened from
+     * their pinned paths through [[objGet]] and [[createMapRef]]).
+     * 
+     * @param maps Maps of the group
+     * @returns Group instance
+     */
+    static open(maps: ReuseportMaps): ReuseportGroup {
+        return new ReuseportGroup(maps)
+    }
+
+    /**
+     * Place a socket at a slot, replacing the previous one.
+     * The socket must be bound with `SO_REUSEPORT`, and all
+     * sockets of the group must belong to the same reuseport
+     * group (same address, port and owner).
+     * 
+     * The map holds a reference to the socket, it's removed
+     * automatically when the socket is closed.
+     * 
+     * @param slot Slot index
+     * @param socket Socket to place
+     */
+    add(slot: number, socket: SocketLike): this {
+        this.sockets.set(slot, getSocketFd(socket))
+        return this
+    }
+
+    /**
+     * Empty a slot. Connections steered to it will fall back
+     * to the default selection.
+     * 
+     * @param slot Slot index
+     * @returns `true` if the slot had a socket
+     */
+    remove(slot: number): boolean {
+        return this.sockets.delete(slot)
+    }
+
+    /**
+     * Assign the slot that receives connections arriving at a CPU.
+     * 
+     * @param cpu CPU index
+     * @param slot Slot index
+     */
+    steer(cpu: number, slot: number): this {
+        this.steering.set(cpu, slot)
+        return this
+    }
+
+    /** Get the slot assigned to a CPU */
+    getSteering(cpu: number): number {
+        return this.steering.get(cpu)
+    }
+
+    /**
+     * Load the steering program (if needed) and attach it to the
+     * reuseport group of `socket`. See [[attachReuseport]].
+     * 
+     * @param socket Any socket of the reuseport group
+     */
+    attach(socket: SocketLike): void {
+        if (this.prog === undefined) {
+            this.prog = loadProgram({
+                type: ProgramType.SK_REUSEPORT,
+                insns: reuseportProgram(this.maps),
+                license: 'GPL',
+                name: 'reuseport_steer',
+            })
+        }
+        attachReuseport(socket, this.prog)
+    }
+
+    /**
+     * Close the program and maps owned by this instance.
+     * Attached programs (and placed sockets) stay active until
+     * every socket of the reuseport group is closed.
+     */
+    close(): void {
+        this.prog?.close()
+        this.maps.sockets.close()
+        this.maps.steering.close()
+    }
+}
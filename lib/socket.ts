@@ -0,0 +1,69 @@
+import * as net from 'net'
+import * as dgram from 'dgram'
+import { native, FD } from './util'
+import { checkStatus } from './exception'
+import { ProgramRef } from './program'
+
+/**
+ * A socket, as a raw file descriptor or a Node.js object holding
+ * one. Node.js sockets only have a descriptor once they're
+ * bound, listening or connected.
+ */
+export type SocketLike = FD | net.Socket | net.Server | dgram.Socket
+
+/**
+ * Get the file descriptor of a Node.js socket. Node.js doesn't
+ * expose it publicly, so this relies on internals (`_handle`)
+ * which have been stable for a long time.
+ * 
+ * The descriptor is still owned by the socket, and is only valid
+ * while it's open.
+ * 
+ * @param socket Socket
+ * @returns File descriptor
+ */
+export function getSocketFd(socket: SocketLike): FD {
+    if (typeof socket === 'number')
+        return socket
+    let handle = (socket as any)._handle
+    if (socket instanceof dgram.Socket) {
+        // dgram keeps its handle in a symbol property (since Node.js 11)
+        const symbol = Object.getOwnPropertySymbols(socket)
+            .find(x => x.toString() === 'Symbol(state symbol)')
+        handle = symbol ? (socket as any)[symbol].handle : undefined
+    }
+    const fd = handle && handle.fd
+    if (typeof fd !== 'number' || fd < 0)
+        throw new Error('Socket has no file descriptor (not bound / connected yet?)')
+    return fd
+}
+
+/**
+ * Attach a `SOCKET_FILTER` program to a socket (`SO_ATTACH_BPF`).
+ * The program runs for every incoming packet, before it's queued
+ * to the socket: the return value is the amount of bytes to keep
+ * (zero drops the packet), so unwanted traffic never wakes up the
+ * event loop.
+ * 
+ * The attachment lasts until the socket is closed, or the program
+ * is replaced or detached. The program doesn't need to be kept open.
+ * 
+ * Since Linux 3.19.
+ * 
+ * @param socket Socket to attach the filter to
+ * @param prog Program to attach
+ */
+export function attachSocketFilter(socket: SocketLike, prog: ProgramRef): void {
+    const status = native.attachSocketFilter(getSocketFd(socket), prog.fd)
+    checkStatus('setsockopt', status)
+}
+
+/**
+ * Detach the filter program attached to a socket (`SO_DETACH_BPF`).
+ * 
+ * @param socket Socket to detach the filter from
+ */
+export function detachSocketFilter(socket: SocketLike): void {
+    const status = native.detachSocketFilter(getSocketFd(socket))
+    checkStatus('setsockopt', status)
+}
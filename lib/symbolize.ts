@@ -0,0 +1,488 @@
+import { readFileSync, statSync } from 'fs'
+import { native } from './util'
+import { checkStatus } from './exception'
+import { BuildIdFrame, StackBuildIdStatus } from './map/stack'
+
+/** Index returned by batched resolution for addresses without a symbol */
+export const NO_SYMBOL = 0xFFFFFFFF
+
+/** Kernel symbol, see [[KernelSymbolizer]] */
+export interface KernelSymbol {
+    name: string
+    address: bigint
+    /** Module the symbol belongs to (`bpf` for BPF programs) */
+    module?: string
+}
+
+/** Address resolved to a symbol */
+export interface ResolvedSymbol<S> {
+    symbol: S
+    /** Offset of the address from the start of the symbol */
+    offset: bigint
+}
+
+/**
+ * Result of [[KernelSymbolizer.resolveBatch]] or
+ * [[ElfSymbols.resolveBatch]]. The arrays are parallel
+ * to the passed addresses.
+ */
+export interface SymbolBatch {
+    /** Number of addresses that resolved to a symbol */
+    found: number
+    /** Symbol index of each address (see `symbol()`), or [[NO_SYMBOL]] */
+    indexes: Uint32Array
+    /** Offset of each address from the start of its symbol */
+    offsets: BigUint64Array
+}
+
+export interface KernelSymbolizerOptions {
+    /** Path to the kernel symbol table (default: `/proc/kallsyms`) */
+    kallsymsPath?: string
+    /** Path to the module list, used to detect changes (default: `/proc/modules`) */
+    modulesPath?: string
+}
+
+/**
+ * Resolves kernel addresses (i.e. from a [[StackTraceMap]]) to
+ * symbols. The symbol table is parsed once into a sorted table in
+ * native memory, and addresses are resolved in batches through
+ * binary search, without creating objects per address.
+ * 
+ * Symbols are identified by an index, which is stable for
+ * core kernel symbols. Module symbols are re-indexed when
+ * [[refresh]] picks up changes.
+ * 
+ * Only text symbols are loaded. Addresses past the end of core
+ * text (`_etext`), past the end of a module, or inside a data
+ * symbol resolve to [[NO_SYMBOL]]. Reading addresses needs root
+ * (or `kernel.kptr_restrict=0`), otherwise construction fails
+ * with `EPERM`.
+ */
+export class KernelSymbolizer {
+    /** @hidden Native symbol table, used by [[foldStackCounts]] */
+    readonly native: any
+    private symbols: KernelSymbol[] = []
+    private indexes = new Uint32Array(0)
+    private offsets = new BigUint64Array(0)
+
+    /**
+     * Load the kernel symbol table.
+     * 
+     * @param options Symbolizer options
+     */
+    constructor(options?: KernelSymbolizerOptions) {
+        this.native = new native.Kallsyms()
+        const status = this.native.load(
+            options?.kallsymsPath || '/proc/kallsyms',
+            options?.modulesPath || '/proc/modules',
+        )
+        checkStatus('kallsyms', status)
+    }
+
+    /** Number of symbols loaded */
+    get size(): number {
+        return this.native.count
+    }
+
+    /**
+     * Re-read module symbols if the loaded modules changed.
+     * Symbols of BPF programs appear and disappear constantly,
+     * use `force` to pick them up.
+     * 
+     * @param force Re-read module symbols unconditionally
+     * @returns `true` if module symbols were re-read (indexes
+     * of module symbols are no longer valid)
+     */
+    refresh(force: boolean = false): boolean {
+        const status = this.native.refresh(force)
+        checkStatus('kallsyms', status)
+        if (status > 0)
+            this.symbols.length = Math.min(this.symbols.length, this.native.coreCount)
+        return status > 0
+    }
+
+    /**
+     * Resolve many addresses in a single call.
+     * 
+     * The returned arrays are owned by this instance, and are
+     * overwritten by the next call, so process (or copy) them first.
+     * 
+     * @param addrs Addresses (i.e. the frames of a [[StackBatch]])
+     * @param count Number of addresses to take from `addrs`
+     */
+    resolveBatch(addrs: BigUint64Array, count: number = addrs.length): SymbolBatch {
+        if (this.indexes.length < count) {
+            this.indexes = new Uint32Array(count)
+            this.offsets = new BigUint64Array(count)
+        }
+        const found = this.native.resolve(addrs, count, this.indexes, this.offsets)
+        return {
+            found,
+            indexes: this.indexes.subarray(0, count),
+            offsets: this.offsets.subarray(0, count),
+        }
+    }
+
+    /**
+     * Get a symbol by index. Symbols are cached, so the same
+     * object is returned for the same index.
+     * 
+     * @param index Symbol index
+     */
+    symbol(index: number): KernelSymbol {
+        let sym = this.symbols[index]
+        if (sym === undefined) {
+            const [ name, address, module ] = this.native.getSymbol(index)
+            sym = this.symbols[index] = module === undefined ?
+                { name, address } : { name, address, module }
+        }
+        return sym
+    }
+
+    /**
+     * Resolve a single address.
+     * 
+     * @param addr Address
+     * @returns Symbol and offset, or `undefined` if not found
+     */
+    resolve(addr: bigint): ResolvedSymbol<KernelSymbol> | undefined {
+        return this.resolveStack(BigUint64Array.of(addr))[0]
+    }
+
+    /**
+     * Resolve the frames of a stack.
+     * 
+     * @param frames Addresses
+     * @returns Symbol and offset of each frame (`undefined`
+     * for frames that weren't found)
+     */
+    resolveStack(frames: BigUint64Array): (ResolvedSymbol<KernelSymbol> | undefined)[] {
+        const { indexes, offsets } = this.resolveBatch(frames)
+        return Array.from(indexes, (index, i) => index === NO_SYMBOL ?
+            undefined : { symbol: this.symbol(index), offset: offsets[i] })
+    }
+}
+
+/**
+ * Format a resolved address the usual way (`name+0x1f [module]`).
+ * 
+ * @param resolved Resolved address
+ * @param addr Address, printed if it couldn't be resolved
+ */
+export function formatSymbol(resolved: ResolvedSymbol<KernelSymbol> | undefined, addr?: bigint): string {
+    if (resolved === undefined)
+        return addr === undefined ? '[unknown]' : `0x${addr.toString(16)}`
+    const { symbol, offset } = resolved
+    const module = symbol.module === undefined ? '' : ` [${symbol.module}]`
+    return `${symbol.name}+0x${offset.toString(16)}${module}`
+}
+
+/** Function symbol of an ELF file, see [[ElfSymbols]] */
+export interface ElfSymbol {
+    name: string
+    address: bigint
+    /** Size of the function, in bytes (zero if unknown) */
+    size: number
+}
+
+/**
+ * Function symbols of an ELF file (from both `.symtab` and
+ * `.dynsym`), loaded into a sorted table in native memory.
+ * 
+ * Addresses are given as offsets into the file, as in
+ * `/proc/<pid>/maps` or build ID stack frames, and translated
+ * through the loadable segments of the file.
+ */
+export class ElfSymbols {
+    private readonly native: any
+    private symbols: ElfSymbol[] = []
+    private indexes = new Uint32Array(0)
+    private offsets = new BigUint64Array(0)
+    /** Path the file was loaded from */
+    readonly path: string
+    /** Build ID of the file (from its `.note.gnu.build-id`), if present */
+    readonly buildId?: Buffer
+
+    /**
+     * Load the symbols of an ELF file.
+     * 
+     * @param path File path
+     */
+    constructor(path: string) {
+        this.native = new native.ElfSymbols()
+        const status = this.native.load(path)
+        checkStatus('elf_begin', status)
+        this.path = path
+        this.buildId = this.native.buildId
+    }
+
+    /** Number of symbols loaded */
+    get size(): number {
+        return this.native.count
+    }
+
+    /**
+     * Resolve many file offsets in a single call.
+     * 
+     * The returned arrays are owned by this instance, and are
+     * overwritten by the next call, so process (or copy) them first.
+     * 
+     * @param fileOffsets Offsets into the file
+     * @param count Number of offsets to take from `fileOffsets`
+     */
+    resolveBatch(fileOffsets: BigUint64Array, count: number = fileOffsets.length): SymbolBatch {
+        if (this.indexes.length < count) {
+            this.indexes = new Uint32Array(count)
+            this.offsets = new BigUint64Array(count)
+        }
+        const found = this.native.resolve(fileOffsets, count, this.indexes, this.offsets)
+        return {
+            found,
+            indexes: this.indexes.subarray(0, count),
+            offsets: this.offsets.subarray(0, count),
+        }
+    }
+
+    /**
+     * Get a symbol by index. Symbols are cached, so the same
+     * object is returned for the same index.
+     * 
+     * @param index Symbol index
+     */
+    symbol(index: number): ElfSymbol {
+        let sym = this.symbols[index]
+        if (sym === undefined) {
+            const [ name, address, size ] = this.native.getSymbol(index)
+            sym = this.symbols[index] = { name, address, size }
+        }
+        return sym
+    }
+
+    /**
+     * Find a function by name, i.e. to attach a uprobe to it
+     * (see [[attachUprobe]]). Symbols sharing their address
+     * with another one may not be found.
+     * 
+     * @param name Symbol name
+     * @returns Address and file offset of the function, or
+     * `undefined` if not found
+     */
+    findSymbol(name: string): { address: bigint, fileOffset: number } | undefined {
+        const result = this.native.findSymbol(name)
+        return result && { address: result[0], fileOffset: result[1] }
+    }
+
+    /**
+     * Resolve a single file offset.
+     * 
+     * @param fileOffset Offset into the file
+     * @returns Symbol and offset, or `undefined` if not found
+     */
+    resolve(fileOffset: bigint): ResolvedSymbol<ElfSymbol> | undefined {
+        const { indexes, offsets } = this.resolveBatch(BigUint64Array.of(fileOffset))
+        return indexes[0] === NO_SYMBOL ? undefined :
+            { symbol: this.symbol(indexes[0]), offset: offsets[0] }
+    }
+}
+
+/** Address resolved by [[UserSymbolizer]] */
+export interface ResolvedUserSymbol extends ResolvedSymbol<ElfSymbol> {
+    /** File containing the symbol */
+    file: ElfSymbols
+}
+
+/** Executable mapping of a process, from `/proc/<pid>/maps` */
+export interface ProcessMapping {
+    start: bigint
+    end: bigint
+    /** Offset into the file of the start of the mapping */
+    fileOffset: bigint
+    path: string
+}
+
+/**
+ * Parse the executable, file-backed mappings of a process.
+ * 
+ * @param pid Process ID
+ * @returns Mappings, sorted by address
+ */
+export function readProcessMappings(pid: number): ProcessMapping[] {
+    const maps = readFileSync(`/proc/${pid}/maps`, 'latin1')
+    const result: ProcessMapping[] = []
+    for (const line of maps.split('\n')) {
+        const m = /^([0-9a-f]+)-([0-9a-f]+) ..x. ([0-9a-f]+) \S+ \d+\s+(\/.*)$/.exec(line)
+        if (m && !m[4].endsWith(' (deleted)'))
+            result.push({
+                start: BigInt('0x' + m[1]),
+                end: BigInt('0x' + m[2]),
+                fileOffset: BigInt('0x' + m[3]),
+                path: m[4],
+            })
+    }
+    return result
+}
+
+/**
+ * Resolves userspace addresses to symbols of the ELF files
+ * mapped by a process. Only symbol tables are used (no DWARF),
+ * so binaries must not be stripped.
+ * 
+ * Files are loaded on first use and cached by inode, and also
+ * by build ID so that stacks collected with `STACK_BUILD_ID`
+ * can be resolved (see [[resolveBuildIdStack]]). Mappings of
+ * each process are cached as well; call [[forget]] when a
+ * process exits or execs.
+ */
+export class UserSymbolizer {
+    private readonly files = new Map<string, ElfSymbols | null>()
+    private readonly buildIds = new Map<string, ElfSymbols>()
+    // mappings of each process, with the file of each mapping (resolved on first use)
+    private readonly processes = new Map<number, { mappings: ProcessMapping[], files: (ElfSymbols | null)[] }>()
+
+    /**
+     * Load an ELF file (or get it from the cache), registering
+     * it by build ID.
+     * 
+     * @param path File path
+     * @returns Loaded file, or `undefined` if it couldn't be loaded
+     */
+    addFile(path: string): ElfSymbols | undefined {
+        let key: string
+        try {
+            const st = statSync(path)
+            key = `${st.dev}:${st.ino}:${st.mtimeMs}`
+        } catch (e) {
+            return undefined
+        }
+        let file = this.files.get(key)
+        if (file === undefined) {
+            try {
+                file = new ElfSymbols(path)
+            } catch (e) {
+                file = null
+            }
+            this.files.set(key, file)
+            if (file && file.buildId)
+                this.buildIds.set(file.buildId.toString('hex'), file)
+        }
+        return file || undefined
+    }
+
+    /**
+     * Get a file registered with the given build ID.
+     * 
+     * @param buildId Build ID
+     */
+    getByBuildId(buildId: Buffer): ElfSymbols | undefined {
+        return this.buildIds.get(buildId.toString('hex'))
+    }
+
+    /**
+     * Get the (cached) executable mappings of a process.
+     * 
+     * @param pid Process ID
+     */
+    getMappings(pid: number): ProcessMapping[] {
+        return this.getProcess(pid).mappings
+    }
+
+    private getProcess(pid: number) {
+        let entry = this.processes.get(pid)
+        if (entry === undefined) {
+            entry = { mappings: readProcessMappings(pid), files: [] }
+            this.processes.set(pid, entry)
+        }
+        return entry
+    }
+
+    /**
+     * Drop the cached mappings of a process (and the files
+     * found for them, so they're checked again). Loaded files
+     * are kept.
+     * 
+     * @param pid Process ID (default: all processes)
+     */
+    forget(pid?: number): void {
+        pid === undefined ? this.processes.clear() : this.processes.delete(pid)
+    }
+
+    private findMapping(mappings: ProcessMapping[], addr: bigint): number {
+        let lo = 0, hi = mappings.length
+        while (lo < hi) {
+            const mid = (lo + hi) >> 1
+            if (mappings[mid].end <= addr)
+                lo = mid + 1
+            else
+                hi = mid
+        }
+        return lo < mappings.length && mappings[lo].start <= addr ? lo : -1
+    }
+
+    // Resolves the file offsets of each file in one native call
+    private resolveGrouped(groups: Map<ElfSymbols, [number, bigint][]>, count: number) {
+        const result: (ResolvedUserSymbol | undefined)[] = new Array(count).fill(undefined)
+        for (const [ file, items ] of groups) {
+            const { indexes, offsets } = file.resolveBatch(BigUint64Array.from(items, x => x[1]))
+            items.forEach(([ i ], j) => {
+                if (indexes[j] !== NO_SYMBOL)
+                    result[i] = { symbol: file.symbol(indexes[j]), offset: offsets[j], file }
+            })
+        }
+        return result
+    }
+
+    /**
+     * Resolve the frames of a userspace stack.
+     * 
+     * Files are accessed through `/proc/<pid>/root`, so this
+     * works for processes in other mount namespaces.
+     * 
+     * @param pid Process the stack belongs to
+     * @param frames Addresses
+     * @returns Symbol and offset of each frame (`undefined`
+     * for frames that weren't found)
+     */
+    resolveStack(pid: number, frames: ArrayLike<bigint>): (ResolvedUserSymbol | undefined)[] {
+        const { mappings, files } = this.getProcess(pid)
+        const groups = new Map<ElfSymbols, [number, bigint][]>()
+        for (let i = 0; i < frames.length; i++) {
+            const addr = frames[i]
+            const m = this.findMapping(mappings, addr)
+            if (m < 0)
+                continue
+            const mapping = mappings[m]
+            if (files[m] === undefined)
+                files[m] = this.addFile(`/proc/${pid}/root${mapping.path}`) || null
+            const file = files[m]
+            if (file) {
+                const items = groups.get(file) || []
+                items.push([ i, addr - mapping.start + mapping.fileOffset ])
+                groups.set(file, items)
+            }
+        }
+        return this.resolveGrouped(groups, frames.length)
+    }
+
+    /**
+     * Resolve the frames of a stack collected with `STACK_BUILD_ID`.
+     * Only files already loaded (through [[addFile]] or
+     * [[resolveStack]]) can be found.
+     * 
+     * @param frames Build ID frames
+     * @returns Symbol and offset of each frame (`undefined`
+     * for frames that weren't found)
+     */
+    resolveBuildIdStack(frames: BuildIdFrame[]): (ResolvedUserSymbol | undefined)[] {
+        const groups = new Map<ElfSymbols, [number, bigint][]>()
+        frames.forEach((frame, i) => {
+            const file = frame.status === StackBuildIdStatus.VALID ?
+                this.getByBuildId(frame.buildId!) : undefined
+            if (file) {
+                const items = groups.get(file) || []
+                items.push([ i, frame.offset! ])
+                groups.set(file, items)
+            }
+        })
+        return this.resolveGrouped(groups, frames.length)
+    }
+}
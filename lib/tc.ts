@@ -0,0 +1,190 @@
+import { constants } from 'os'
+import { native } from './util'
+import { checkStatus } from './exception'
+import { TcAttachPoint } from './constants'
+import { ProgramRef } from './program'
+const { EEXIST, ENOENT } = constants.errno
+
+/** Identifies a filter attached to a [[TcHook]] */
+export interface TcFilterId {
+    /** Filter handle */
+    handle: number
+    /** Filter priority (1 to 65535) */
+    priority: number
+}
+
+/** Information about a filter attached to a [[TcHook]] */
+export interface TcFilter extends TcFilterId {
+    /** ID of the attached program */
+    progId: number
+}
+
+export interface TcAttachOptions {
+    /** Filter handle. If not set, the kernel allocates one. */
+    handle?: number
+    /**
+     * Filter priority (1 to 65535), lower values run first.
+     * If not set, the kernel allocates one.
+     */
+    priority?: number
+    /**
+     * Replace the filter with the same handle and priority,
+     * if it exists (otherwise attaching fails with `EEXIST`)
+     */
+    replace?: boolean
+}
+
+/** libbpf's `BPF_TC_F_REPLACE` */
+const TC_F_REPLACE = 1 << 0
+
+/**
+ * A TC hook (a `clsact` qdisc, or a custom parent qdisc) on a
+ * network device, where `SCHED_CLS` programs can be attached as
+ * direct-action `bpf` filters.
+ * 
+ * Attachments aren't tied to any FD: they stay until detached
+ * or the hook is destroyed.
+ * 
+ * Since Linux 4.5 (`clsact`).
+ */
+export class TcHook {
+    /** Network interface index, see [[ifNameToIndex]] */
+    readonly ifindex: number
+    /** Attach point */
+    readonly attachPoint: TcAttachPoint
+    /** For `CUSTOM` attach point: parent qdisc handle (major:minor) */
+    readonly parent: number
+
+    /**
+     * Construct a hook object. This doesn't create anything on the
+     * device yet, see [[create]].
+     * 
+     * @param ifindex Network interface index, see [[ifNameToIndex]]
+     * @param attachPoint Attach point (for [[create]] and [[destroy]],
+     * `INGRESS | EGRESS` is also accepted)
+     * @param parent For `CUSTOM` attach point: parent qdisc handle
+     */
+    constructor(ifindex: number, attachPoint: TcAttachPoint, parent: number = 0) {
+        this.ifindex = ifindex
+        this.attachPoint = attachPoint
+        this.parent = parent
+    }
+
+    /**
+     * Create the `clsact` qdisc on the device, if it doesn't exist.
+     * 
+     * @param exclusive Throw `EEXIST` if it already exists
+     */
+    create(exclusive: boolean = false): this {
+        const status = native.tcHookCreate(this)
+        if (!(status === -EEXIST && !exclusive))
+            checkStatus('bpf_tc_hook_create', status)
+        return this
+    }
+
+    /**
+     * Destroy the hook, detaching all of its filters. If the
+     * attach point is `INGRESS | EGRESS`, the `clsact` qdisc
+     * itself is deleted.
+     */
+    destroy(): void {
+        const status = native.tcHookDestroy(this)
+        checkStatus('bpf_tc_hook_destroy', status)
+    }
+
+    /**
+     * Attach a `SCHED_CLS` program (in direct-action mode).
+     * The hook must have been created.
+     * 
+     * @param prog Program to attach
+     * @param options Attach options
+     * @returns Filter information, including allocated handle
+     * and priority
+     */
+    attach(prog: ProgramRef, options?: TcAttachOptions): TcFilter {
+        const [ status, filter ] = native.tcAttach(this, {
+            progFd: prog.fd,
+            handle: options?.handle,
+            priority: options?.priority,
+            flags: options?.replace ? TC_F_REPLACE : 0,
+        })
+        checkStatus('bpf_tc_attach', status)
+        return filter
+    }
+
+    /**
+     * Detach a filter.
+     * 
+     * @param filter Handle and priority of the filter
+     */
+    detach(filter: TcFilterId): void {
+        const { handle, priority } = filter
+        const status = native.tcDetach(this, { handle, priority })
+        checkStatus('bpf_tc_detach', status)
+    }
+
+    /**
+     * Query the program attached in a filter.
+     * 
+     * @param filter Handle and priority of the filter
+     * @returns Filter information, or `undefined` if it doesn't exist
+     */
+    query(filter: TcFilterId): TcFilter | undefined {
+        const { handle, priority } = filter
+        const [ status, result ] = native.tcQuery(this, { handle, priority })
+        if (status === -ENOENT)
+            return undefined
+        checkStatus('bpf_tc_query', status)
+        return result
+    }
+}
+
+/**
+ * Attach a `SCHED_CLS` program to the same attach point of many
+ * network devices, creating the `clsact` qdiscs as needed.
+ * 
+ * This is all-or-nothing: if any of the attachments fails,
+ * the ones already made are detached, and the `clsact` qdiscs
+ * created by this call are destroyed, before throwing.
+ * 
+ * @param ifindexes Network interface indexes, see [[ifNameToIndex]]
+ * @param attachPoint Attach point (`INGRESS` or `EGRESS`)
+ * @param prog Program to attach
+ * @param options Attach options, used for all devices
+ * @returns Hook and filter for each device, in the same order
+ */
+export function attachTcBulk(
+    ifindexes: number[],
+    attachPoint: TcAttachPoint,
+    prog: ProgramRef,
+    options?: TcAttachOptions,
+): [TcHook, TcFilter][] {
+    const result: [TcHook, TcFilter][] = []
+    const created = new Set<number>()
+    try {
+        for (const ifindex of ifindexes) {
+            const hook = new TcHook(ifindex, attachPoint)
+            const status = native.tcHookCreate(hook)
+            if (status !== -EEXIST) {
+                checkStatus('bpf_tc_hook_create', status)
+                created.add(ifindex)
+            }
+            result.push([ hook, hook.attach(prog, options) ])
+        }
+    } catch (e) {
+        for (const [ hook, filter ] of result) {
+            if (created.has(hook.ifindex))
+                continue
+            try {
+                hook.detach(filter)
+            } catch (e) {}
+        }
+        for (const ifindex of created) {
+            try {
+                new TcHook(ifindex, TcAttachPoint.INGRESS | TcAttachPoint.EGRESS).destroy()
+            } catch (e) {}
+        }
+        throw e
+    }
+    return result
+}
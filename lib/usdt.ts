@@ -0,0 +1,194 @@
+import { native } from './util'
+import { checkStatus } from './exception'
+import { ProgramRef } from './program'
+import { LinkRef, attachUprobe } from './link'
+import { Assembler, Reg, Size, AluOp, Helper } from './asm'
+
+/** Kind of location of a USDT argument */
+export enum UsdtArgKind {
+    /** Constant value (`value`) */
+    CONST,
+    /** Value of a register (`register`) */
+    REG,
+    /** Memory at a register plus an offset (`register`, `offset`) */
+    MEM,
+    /** Can't be fetched (e.g. it uses an index register) */
+    UNSUPPORTED,
+}
+
+/** Location of a USDT argument, parsed from its spec */
+export interface UsdtArgument {
+    /** Spec, as found in the note (e.g. `-4@-20(%rbp)`) */
+    spec: string
+    kind: UsdtArgKind
+    /** Size, in bytes */
+    size: number
+    signed: boolean
+    /** For `REG` and `MEM`: base register (64-bit name, e.g. `rdi`) */
+    register?: string
+    /** For `MEM`: offset to add to the register */
+    offset?: number
+    /** For `CONST`: value */
+    value?: bigint
+}
+
+/** USDT probe, as defined in the `.note.stapsdt` section of an ELF */
+export interface UsdtProbe {
+    provider: string
+    name: string
+    /** Address of the probe (adjusted if the file was prelinked) */
+    address: bigint
+    /** File offset of the probe, to attach uprobes */
+    fileOffset: number
+    /**
+     * Address of the semaphore, a counter that the program checks
+     * before evaluating the arguments (0 if the probe has none)
+     */
+    semaphore: bigint
+    /** File offset of the semaphore (0 if the probe has none) */
+    semaphoreOffset: number
+    args: UsdtArgument[]
+}
+
+// Offsets in `struct pt_regs` (x86-64)
+const PT_REGS: { [reg: string]: number } = {
+    r15: 0, r14: 8, r13: 16, r12: 24, rbp: 32, rbx: 40, r11: 48, r10: 56,
+    r9: 64, r8: 72, rax: 80, rcx: 88, rdx: 96, rsi: 104, rdi: 112, rip: 128, rsp: 152,
+}
+
+/** Map a register name of any size to its 64-bit name */
+function baseRegister(name: string): string | undefined {
+    if (name in PT_REGS)
+        return name
+    let m = /^(r(?:[89]|1[0-5]))[dwb]$/.exec(name)
+    if (m)
+        return m[1]
+    m = /^e?([abcd])x$|^([abcd])l$/.exec(name)
+    if (m)
+        return `r${m[1] || m[2]}x`
+    m = /^e?(si|di|bp|sp|ip)$|^(si|di|bp|sp)l$/.exec(name)
+    if (m)
+        return `r${m[1] || m[2]}`
+    return undefined
+}
+
+/**
+ * Parse the argument specs of a USDT probe, in the format generated
+ * by `sys/sdt.h` on x86-64 (e.g. `-4@%edi 8@-8(%rbp) 4@$5`).
+ * Arguments that can't be fetched have kind `UNSUPPORTED`.
+ * 
+ * @param specs Argument specs, separated by spaces
+ * @returns Parsed arguments
+ */
+export function parseUsdtArguments(specs: string): UsdtArgument[] {
+    return specs.split(' ').filter(x => x).map((spec): UsdtArgument => {
+        const m = /^(-?)(1|2|4|8)@(.+)$/.exec(spec)
+        if (!m)
+            return { spec, kind: UsdtArgKind.UNSUPPORTED, size: 8, signed: false }
+        const arg: UsdtArgument = { spec, kind: UsdtArgKind.UNSUPPORTED, size: Number(m[2]), signed: m[1] === '-' }
+        const loc = m[3]
+        let lm: RegExpExecArray | null
+        if ((lm = /^\$(-?(?:0x[0-9a-f]+|\d+))$/i.exec(loc))) {
+            const value = lm[1].startsWith('-') ? -BigInt(lm[1].substr(1)) : BigInt(lm[1])
+            return { ...arg, kind: UsdtArgKind.CONST, value }
+        }
+        if ((lm = /^%(\w+)$/.exec(loc))) {
+            const register = baseRegister(lm[1])
+            return register ? { ...arg, kind: UsdtArgKind.REG, register } : arg
+        }
+        if ((lm = /^(-?\d*)\(%(\w+)\)$/.exec(loc))) {
+            const register = baseRegister(lm[2])
+            const offset = lm[1] && lm[1] !== '-' ? Number(lm[1]) : 0
+            return register ? { ...arg, kind: UsdtArgKind.MEM, register, offset } : arg
+        }
+        return arg
+    })
+}
+
+/**
+ * Read the USDT probes defined by an ELF binary or library.
+ * 
+ * @param path Path of the ELF file
+ * @returns Probes (empty if the file has no `.note.stapsdt`)
+ */
+export function readUsdtProbes(path: string): UsdtProbe[] {
+    const [ status, notes ] = native.readUsdtNotes(path)
+    checkStatus('readUsdtNotes', status)
+    return (notes as any[]).map(([ provider, name, address, fileOffset, semaphore, semaphoreOffset, args ]) => ({
+        provider, name, address, fileOffset, semaphore, semaphoreOffset,
+        args: parseUsdtArguments(args),
+    }))
+}
+
+/**
+ * Find a USDT probe of an ELF binary or library.
+ * 
+ * @param path Path of the ELF file
+ * @param provider Provider name (e.g. `node`)
+ * @param name Probe name (e.g. `gc__start`)
+ * @returns Probe, or `undefined` if not found
+ */
+export function findUsdtProbe(path: string, provider: string, name: string): UsdtProbe | undefined {
+    return readUsdtProbes(path).find(x => x.provider === provider && x.name === name)
+}
+
+/**
+ * Emit instructions that fetch a USDT argument into a register,
+ * extended to 64 bits according to its size and sign. Registers
+ * R0 to R5 are clobbered, so `dst` and `ctx` should be R6 to R9.
+ * Memory arguments are read with `bpf_probe_read_user` (since
+ * Linux 5.5) through 8 bytes of stack at `stackOffset`.
+ * 
+ * @param asm Assembler to emit to (the probe is a `KPROBE` program)
+ * @param arg Argument to fetch
+ * @param dst Register to store the value in
+ * @param ctx Register holding the context (`struct pt_regs *`)
+ * @param stackOffset Offset of the stack slot to use (default: -8)
+ */
+export function fetchUsdtArgument(asm: Assembler, arg: UsdtArgument, dst: Reg, ctx: Reg, stackOffset: number = -8): Assembler {
+    if (arg.kind === UsdtArgKind.CONST)
+        return asm.ldImm64(dst, arg.value!)
+    if (arg.kind === UsdtArgKind.UNSUPPORTED || PT_REGS[arg.register!] === undefined)
+        throw new Error(`Unsupported USDT argument: ${arg.spec}`)
+    if (arg.kind === UsdtArgKind.REG) {
+        asm.ldxMem(Size.DW, dst, ctx, PT_REGS[arg.register!])
+    } else {
+        asm.ldxMem(Size.DW, Reg.R3, ctx, PT_REGS[arg.register!])
+            .aluImm(AluOp.ADD, Reg.R3, arg.offset!)
+            .stMem(Size.DW, Reg.R10, stackOffset, 0)
+            .movReg(Reg.R1, Reg.R10)
+            .aluImm(AluOp.ADD, Reg.R1, stackOffset)
+            .movImm(Reg.R2, arg.size)
+            .call(Helper.PROBE_READ_USER)
+            .ldxMem(Size.DW, dst, Reg.R10, stackOffset)
+    }
+    if (arg.size < 8)
+        asm.aluImm(AluOp.LSH, dst, 64 - 8 * arg.size)
+            .aluImm(arg.signed ? AluOp.ARSH : AluOp.RSH, dst, 64 - 8 * arg.size)
+    return asm
+}
+
+/**
+ * Attach a `KPROBE` program to a USDT probe. If the probe has a
+ * semaphore, the kernel increments it while attached, so that the
+ * traced program evaluates the probe's arguments (since Linux 4.20;
+ * earlier kernels fail with `EINVAL`).
+ * 
+ * Since Linux 4.17 (requires the `uprobe` PMU). Programs that
+ * fetch memory arguments with [[fetchUsdtArgument]] need Linux 5.5
+ * (for `bpf_probe_read_user`).
+ * 
+ * @param prog Program to attach (see [[fetchUsdtArgument]])
+ * @param path Path of the ELF file defining the probe
+ * @param probe Probe, see [[readUsdtProbes]]
+ * @param options.pid Only trace this process
+ * @returns [[LinkRef]] for the attachment
+ */
+export function attachUsdt(prog: ProgramRef, path: string, probe: UsdtProbe, options?: { pid?: number }): LinkRef {
+    if (!probe.fileOffset)
+        throw new Error(`USDT probe ${probe.provider}:${probe.name} isn't in a loadable segment`)
+    return attachUprobe(prog, path, probe.fileOffset, {
+        pid: options?.pid,
+        refCtrOffset: probe.semaphoreOffset || undefined,
+    })
+}
@@ -1,3 +1,5 @@
+import { checkStatus } from './exception'
+
 export type FD = number
 
 export const native = require('node-gyp-build')(__dirname + '/..')
@@ -17,6 +19,32 @@ export const versions: {
 export const version: string = versions.libbpf
 
 
+/**
+ * Get the index of a network interface, to be used
+ * for XDP and TC attachment.
+ * 
+ * @param name Interface name
+ * @returns Interface index
+ */
+export function ifNameToIndex(name: string): number {
+    const status = native.ifNameToIndex(name)
+    checkStatus('if_nametoindex', status)
+    return status
+}
+
+/**
+ * Get the number of possible CPUs (which is the number
+ * of values in per-CPU maps, and the valid CPU indexes).
+ * 
+ * @returns Number of possible CPUs
+ */
+export function numPossibleCpus(): number {
+    const status = native.numPossibleCpus()
+    checkStatus('libbpf_num_possible_cpus', status)
+    return status
+}
+
+
 // TypedArray conversion utilities
 
 type TypedArray =
@@ -0,0 +1,108 @@
+import { native } from './util'
+import { checkStatus } from './exception'
+import { AttachType, XdpFlags, XdpAttachMode } from './constants'
+import { ProgramRef } from './program'
+import { LinkRef, createLinkRef } from './link'
+
+export interface XdpOptions {
+    /**
+     * Attach flags, see [[XdpFlags]]. Use them to select
+     * the mode (`SKB_MODE`, `DRV_MODE`, `HW_MODE`); if no mode
+     * is set, the kernel uses native mode if supported by the
+     * driver, generic mode otherwise.
+     */
+    flags?: number
+    /**
+     * Only replace the attached program if it's this one; fail
+     * with `EEXIST` otherwise. Pass `null` to require that no
+     * program is attached. (since Linux 5.7)
+     */
+    expected?: ProgramRef | null
+}
+
+/** XDP programs attached to a network device */
+export interface XdpInfo {
+    /** ID of the attached program, if attached in a single mode */
+    progId: number
+    /** ID of the program attached in native mode, or zero */
+    drvProgId: number
+    /** ID of the program attached in offload mode, or zero */
+    hwProgId: number
+    /** ID of the program attached in generic mode, or zero */
+    skbProgId: number
+    /** Mode(s) the programs are attached in */
+    attachMode: XdpAttachMode
+}
+
+function setXdp(ifindex: number, fd: number, options?: XdpOptions) {
+    let flags = options?.flags || 0
+    let oldFd: number | undefined
+    if (options?.expected === null) {
+        // UPDATE_IF_NOEXIST can't be combined with REPLACE
+        flags |= XdpFlags.UPDATE_IF_NOEXIST
+    } else if (options?.expected !== undefined) {
+        oldFd = options.expected.fd
+    }
+    const status = native.setLinkXdpFd(ifindex, fd, flags, oldFd)
+    checkStatus('bpf_set_link_xdp_fd_opts', status)
+}
+
+/**
+ * Attach an `XDP` program to a network device through netlink.
+ * The attachment isn't tied to any FD, it stays until replaced
+ * or detached through [[detachXdp]]. See [[attachXdpLink]] for
+ * an attachment that is released when closed.
+ * 
+ * Since Linux 4.8.
+ * 
+ * @param ifindex Network interface index, see [[ifNameToIndex]]
+ * @param prog Program to attach
+ * @param options Attach options
+ */
+export function attachXdp(ifindex: number, prog: ProgramRef, options?: XdpOptions): void {
+    setXdp(ifindex, prog.fd, options)
+}
+
+/**
+ * Detach the `XDP` program attached to a network device through
+ * netlink. The mode flags must match the ones used to attach it.
+ * 
+ * @param ifindex Network interface index, see [[ifNameToIndex]]
+ * @param options Detach options (`expected` can be used to
+ * only detach a certain program)
+ */
+export function detachXdp(ifindex: number, options?: XdpOptions): void {
+    setXdp(ifindex, -1, options)
+}
+
+/**
+ * Query the `XDP` programs attached to a network device.
+ * 
+ * @param ifindex Network interface index, see [[ifNameToIndex]]
+ * @param flags Mode flags, see [[XdpFlags]]
+ * @returns Attached programs
+ */
+export function getXdpInfo(ifindex: number, flags: number = 0): XdpInfo {
+    const [ status, info ] = native.getLinkXdpInfo(ifindex, flags)
+    checkStatus('bpf_get_link_xdp_info', status)
+    return info
+}
+
+/**
+ * Attach an `XDP` program to a network device through a `bpf_link`.
+ * The program is detached when the link is closed, and can be
+ * replaced atomically with [[updateLink]]. Netlink attachments
+ * (through [[attachXdp]]) can't replace a link attachment.
+ * 
+ * Since Linux 5.9.
+ * 
+ * @param ifindex Network interface index, see [[ifNameToIndex]]
+ * @param prog Program to attach
+ * @param flags Mode flags, see [[XdpFlags]]
+ * @returns [[LinkRef]] for the attachment
+ */
+export function attachXdpLink(ifindex: number, prog: ProgramRef, flags: number = 0): LinkRef {
+    const status = native.linkCreate(prog.fd, ifindex, AttachType.XDP, { flags })
+    checkStatus('bpf_link_create', status)
+    return createLinkRef(status)
+}
@@ -0,0 +1,330 @@
+import { native, FD } from './util'
+import { checkStatus } from './exception'
+import { XskBindFlags } from './constants'
+
+/**
+ * Options for creating an [[XdpSocket]]. Ring sizes must
+ * be powers of two.
+ */
+export interface XdpSocketOptions {
+    /** Size of each UMEM frame, in bytes (default: 4096) */
+    frameSize?: number
+    /** Number of frames in the UMEM (default: 4096) */
+    frameCount?: number
+    /** Headroom reserved at the start of each received frame, in bytes (default: 0) */
+    frameHeadroom?: number
+    /** Size of the fill ring (default: 2048) */
+    fillSize?: number
+    /** Size of the completion ring (default: 2048) */
+    compSize?: number
+    /** Size of the RX ring (default: 2048) */
+    rxSize?: number
+    /** Size of the TX ring (default: 2048) */
+    txSize?: number
+    /** Flags for attaching the XDP program, see [[XdpFlags]] */
+    xdpFlags?: number
+    /** Flags for binding the socket, see [[XskBindFlags]] */
+    bindFlags?: number
+    /**
+     * Don't attach libbpf's XDP program (which redirects every
+     * packet to the socket of its RX queue). Use this if you're
+     * attaching your own program, and place the socket in its
+     * `XSKMAP` yourself.
+     */
+    inhibitProgLoad?: boolean
+}
+
+/** Descriptor of a packet in the UMEM */
+export interface XdpDesc {
+    /** Offset of the packet data in the UMEM */
+    addr: number
+    /** Length of the packet, in bytes */
+    len: number
+}
+
+/** Statistics of an [[XdpSocket]] */
+export interface XdpSocketStatistics {
+    /** Packets dropped for other reasons */
+    rxDropped: bigint
+    /** Packets dropped because of an invalid descriptor */
+    rxInvalidDescs: bigint
+    /** TX descriptors that were invalid */
+    txInvalidDescs: bigint
+    /** Packets dropped because the RX ring was full (reported since Linux 5.9) */
+    rxRingFull?: bigint
+    /** Times the fill ring was found empty (reported since Linux 5.9) */
+    rxFillRingEmptyDescs?: bigint
+    /** Times the TX ring was found empty (reported since Linux 5.9) */
+    txRingEmptyDescs?: bigint
+}
+
+/** Events reported to [[XdpSocket.poll]] callbacks */
+export interface XdpPollEvents {
+    /** There are packets in the RX ring */
+    readable: boolean
+    /** There's room in the TX ring */
+    writable: boolean
+}
+
+const UV_READABLE = 1, UV_WRITABLE = 2
+
+/**
+ * AF_XDP socket, which receives packets redirected to it by an
+ * XDP program, and transmits packets directly to the driver,
+ * bypassing the network stack.
+ * 
+ * Packets live in the UMEM, a memory area shared with the kernel
+ * and exposed here as an `ArrayBuffer` (see [[umem]]), divided in
+ * frames of [[frameSize]] bytes. Frames are handed over through
+ * four rings, referring to them by their offset (*address*)
+ * in the UMEM:
+ * 
+ *  - **fill**: frames given to the kernel to receive packets in ([[fill]])
+ *  - **RX**: received packets ([[receive]])
+ *  - **TX**: packets to transmit ([[transmit]])
+ *  - **completion**: frames of transmitted packets, given back ([[complete]])
+ * 
+ * For high packet rates, use the batched variants ([[fillBatch]],
+ * [[rxBatch]], [[txBatch]], [[completeBatch]]), which move
+ * thousands of packets per call.
+ * 
+ * It's up to the user to keep track of which frames are owned by
+ * the kernel. Use [[poll]] to get notified through the event loop
+ * instead of busy-polling.
+ * 
+ * Since Linux 4.18.
+ */
+export class XdpSocket {
+    private readonly native: any
+    private readonly useNeedWakeup: boolean
+    private rxDescs = new Uint32Array(0)
+    private compAddrs = new Uint32Array(0)
+    /** UMEM memory, shared with the kernel while the socket is open */
+    readonly umem: ArrayBuffer
+    /** Size of each UMEM frame, in bytes */
+    readonly frameSize: number
+    /** Number of frames in the UMEM */
+    readonly frameCount: number
+
+    /**
+     * Create a socket bound to a queue of a network device,
+     * together with its UMEM.
+     * 
+     * @param ifname Name of the network device
+     * @param queueId RX queue to bind to
+     * @param options Socket options
+     */
+    constructor(ifname: string, queueId: number, options?: XdpSocketOptions) {
+        this.frameSize = options?.frameSize || 4096
+        this.frameCount = options?.frameCount || 4096
+        this.useNeedWakeup = !!((options?.bindFlags || 0) & XskBindFlags.USE_NEED_WAKEUP)
+        this.native = new native.XskSocket()
+        const status = this.native.create(ifname, queueId, {
+            ...options,
+            frameSize: this.frameSize,
+            frameCount: this.frameCount,
+            libbpfFlags: options?.inhibitProgLoad ? 1 : 0,
+        })
+        checkStatus('xsk_socket__create', status)
+        this.umem = this.native.umem
+    }
+
+    /**
+     * Readonly property holding the socket FD (i.e. to place it
+     * in an `XSKMAP`). Throws if the socket was closed.
+     */
+    get fd(): FD {
+        return this.native.fd
+    }
+
+    /**
+     * Get a `Buffer` for a packet, sharing memory with the UMEM.
+     * 
+     * @param addr Packet address
+     * @param len Packet length
+     * @returns View over the packet data
+     */
+    frame(addr: number, len: number = this.frameSize): Buffer {
+        return Buffer.from(this.umem, addr, len)
+    }
+
+    /**
+     * Give frames to the kernel, to receive packets in.
+     * 
+     * @param addrs Frame addresses
+     * @returns Number of frames given (less than requested
+     * if the fill ring is full)
+     */
+    fill(addrs: number[]): number {
+        return this.native.fill(addrs)
+    }
+
+    /**
+     * Consume received packets from the RX ring. Their frames
+     * are now owned by the user.
+     * 
+     * @param max Max number of packets to consume
+     * @returns Received packets
+     */
+    receive(max: number): XdpDesc[] {
+        return this.native.receive(max)
+    }
+
+    /**
+     * Queue packets for transmission, waking up the kernel if
+     * needed. Their frames are owned by the kernel until they
+     * are returned through [[complete]].
+     * 
+     * @param descs Packets to transmit
+     * @returns Number of packets queued (less than requested
+     * if the TX ring is full)
+     */
+    transmit(descs: XdpDesc[]): number {
+        const count = this.native.transmit(descs)
+        if (count > 0)
+            this.wakeup()
+        return count
+    }
+
+    /**
+     * Consume frames of transmitted packets from the completion
+     * ring. They're now owned by the user.
+     * 
+     * @param max Max number of frames to consume
+     * @returns Frame addresses
+     */
+    complete(max: number): number[] {
+        return this.native.complete(max)
+    }
+
+    // Batched operations: these move many descriptors per call
+    // through typed arrays, without allocating objects per packet
+
+    /**
+     * Batched version of [[fill]].
+     * 
+     * @param addrs Frame addresses
+     * @param count Number of addresses to take from `addrs`
+     * @returns Number of frames given (less than requested
+     * if the fill ring is full)
+     */
+    fillBatch(addrs: Uint32Array, count: number = addrs.length): number {
+        return this.native.fillBatch(addrs, count)
+    }
+
+    /**
+     * Batched version of [[receive]]. Descriptors are packed as
+     * `addr, len` pairs in a `Uint32Array` owned by the socket,
+     * which is overwritten by the next call, so process (or
+     * copy) them first.
+     * 
+     * @param max Max number of packets to consume
+     * @returns Packed descriptors (its length is twice the
+     * number of packets received)
+     */
+    rxBatch(max: number): Uint32Array {
+        if (this.rxDescs.length < 2 * max)
+            this.rxDescs = new Uint32Array(2 * max)
+        const count = this.native.rxBatch(this.rxDescs, max)
+        return this.rxDescs.subarray(0, 2 * count)
+    }
+
+    /**
+     * Batched version of [[transmit]], waking up the kernel
+     * if needed.
+     * 
+     * @param descs Packets to transmit, packed as `addr, len` pairs
+     * @param count Number of packets to take from `descs`
+     * @returns Number of packets queued (less than requested
+     * if the TX ring is full)
+     */
+    txBatch(descs: Uint32Array, count: number = descs.length / 2): number {
+        const queued = this.native.txBatch(descs, count)
+        if (queued > 0)
+            this.wakeup()
+        return queued
+    }
+
+    /**
+     * Batched version of [[complete]]. Like [[rxBatch]], the
+     * returned array is owned by the socket.
+     * 
+     * @param max Max number of frames to consume
+     * @returns Frame addresses
+     */
+    completeBatch(max: number): Uint32Array {
+        if (this.compAddrs.length < max)
+            this.compAddrs = new Uint32Array(max)
+        const count = this.native.completeBatch(this.compAddrs, max)
+        return this.compAddrs.subarray(0, count)
+    }
+
+    /**
+     * Whether the kernel must be woken up to process the ring,
+     * when bound with `USE_NEED_WAKEUP`. For the TX ring, call
+     * [[wakeup]]. For the fill ring, wait for the socket to be
+     * readable (i.e. through [[poll]]).
+     * 
+     * @param ring Ring to check
+     */
+    needsWakeup(ring: 'tx' | 'fill'): boolean {
+        return this.native.needsWakeup(ring === 'tx')
+    }
+
+    /**
+     * Wake up the kernel to process the TX ring. When bound with
+     * `USE_NEED_WAKEUP`, this is skipped unless the kernel asks
+     * for it.
+     */
+    wakeup(): void {
+        if (!this.useNeedWakeup || this.needsWakeup('tx')) {
+            const status = this.native.kick()
+            checkStatus('sendto', status)
+        }
+    }
+
+    /** Get socket statistics */
+    getStatistics(): XdpSocketStatistics {
+        const [ status, stats ] = this.native.getStatistics()
+        checkStatus('getsockopt', status)
+        return stats
+    }
+
+    /**
+     * Start watching the socket from the event loop, calling
+     * `callback` whenever it's readable (there are packets in
+     * the RX ring) or writable, as requested. Calling it again
+     * replaces the callback and events. The socket isn't garbage
+     * collected while being watched.
+     * 
+     * @param callback Called with the socket events
+     * @param events Events to watch (default: only readable)
+     */
+    poll(callback: (events: XdpPollEvents) => void, events?: Partial<XdpPollEvents>): void {
+        const { readable = true, writable = false } = events || {}
+        const mask = (readable ? UV_READABLE : 0) | (writable ? UV_WRITABLE : 0)
+        const status = this.native.pollStart(mask, (status: number, events: number) => {
+            checkStatus('uv_poll', status)
+            callback({
+                readable: !!(events & UV_READABLE),
+                writable: !!(events & UV_WRITABLE),
+            })
+        })
+        checkStatus('uv_poll_start', status)
+    }
+
+    /** Stop watching the socket */
+    stopPoll(): void {
+        this.native.pollStop()
+    }
+
+    /**
+     * Close the socket, detaching it from the device. The UMEM
+     * memory is released once [[umem]] is garbage collected.
+     * 
+     * Calling it a second time does nothing.
+     */
+    close(): void {
+        this.native.close()
+    }
+}
@@ -1,18 +1,43 @@
 #include <memory>
+#include <algorithm>
 #include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
 #include <sstream>
 #include <cassert>
+#include <cstring>
 #include <stdio.h>
 #include <fcntl.h>
 
 #include <unistd.h>
 #include <linux/btf.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <sys/utsname.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+
+#ifndef SO_DETACH_REUSEPORT_BPF
+#define SO_DETACH_REUSEPORT_BPF 68
+#endif
 
 #include <bpf.h>
+#include <libbpf.h>
+#include <btf.h>
+#include <xsk.h>
 #include <errno.h>
+#include <libelf.h>
+#include <gelf.h>
 
 #include <napi.h>
+#include <uv.h>
 
 using Napi::CallbackInfo;
 
@@ -37,6 +62,10 @@ bool GetBoolean(Napi::Env env, Napi::Value value) {
     return Napi::Boolean(env, value);
 }
 
+bool GetBoolean(Napi::Env env, Napi::Value value, bool def) {
+    return value.IsUndefined() ? def : GetBoolean(env, value);
+}
+
 uint64_t GetUint64(Napi::Env env, Napi::Value value) {
     bool lossless;
     uint64_t result = Napi::BigInt(env, value).Uint64Value(&lossless);
@@ -123,6 +152,12 @@ class FDRef : public Napi::ObjectWrap<FDRef> {
     }
 };
 
+Napi::Value NumPossibleCpus(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    // returns negative error code directly
+    return Napi::Number::New(env, libbpf_num_possible_cpus());
+}
+
 Napi::Value Dup(const CallbackInfo& info) {
     Napi::Env env = info.Env();
     auto fd = GetNumber<int>(env, info[0]);
@@ -254,6 +289,59 @@ Napi::Value MapUpdateBatch(const CallbackInfo& info) {
     return ret;
 }
 
+// Stack trace maps don't support batched operations, so do the
+// per-id syscalls here and pack the frames of all stacks together.
+// A stack ends at the first zeroed frame (zero IP or build ID status).
+Napi::Value StackMapLookupBatch(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto fd = GetNumber<int>(env, info[a++]);
+    Napi::TypedArrayOf<uint32_t> ids (env, info[a++]);
+    auto count = GetNumber<uint32_t>(env, info[a++]);
+    auto value_size = GetNumber<uint32_t>(env, info[a++]);
+    auto frame_size = GetNumber<uint32_t>(env, info[a++]);
+    auto out = GetOptionalBuffer(env, info[a++]);
+    auto offsets = info[a].IsUndefined() ? nullptr : Napi::TypedArrayOf<uint32_t>(env, info[a]).Data(); a++;
+    auto del = GetBoolean(env, info[a++]);
+    if (count > ids.ElementLength())
+        throw Napi::RangeError::New(env, "Count exceeds ids length");
+
+    std::unique_ptr<uint8_t[]> value (new uint8_t[value_size]);
+    uint32_t max_frames = value_size / frame_size;
+    uint32_t total = 0, i = 0;
+    int status = 0;
+    if (offsets) offsets[0] = 0;
+    for (; i < count; i++) {
+        uint32_t id = ids.Data()[i];
+        uint32_t frames = 0;
+        if (out) {
+            status = bpf_map_lookup_elem(fd, &id, value.get());
+            if (status && errno != ENOENT) break;
+            // the kernel zero-fills unused frames
+            if (!status) {
+                for (; frames < max_frames; frames++) {
+                    uint8_t* frame = value.get() + frames * frame_size;
+                    if (frame_size == sizeof(uint64_t) ? !*(uint64_t*) frame : !((bpf_stack_build_id*) frame)->status)
+                        break;
+                }
+                memcpy(out + (size_t) total * frame_size, value.get(), (size_t) frames * frame_size);
+            }
+        }
+        if (del) {
+            status = bpf_map_delete_elem(fd, &id);
+            if (status && errno != ENOENT) break;
+        }
+        status = 0;
+        total += frames;
+        if (offsets) offsets[i + 1] = total;
+    }
+
+    auto ret = Napi::Array::New(env);
+    ret[0U] = ToStatus(env, status);
+    ret[1U] = Napi::Number::New(env, i);
+    return ret;
+}
+
 Napi::Value CreateMap(const CallbackInfo& info) {
     Napi::Env env = info.Env();
     Napi::Object desc (env, info[0]);
@@ -266,6 +354,9 @@ Napi::Value CreateMap(const CallbackInfo& info) {
     attr.numa_node = GetNumber<uint32_t>(env, desc["numaNode"], 0);
     attr.inner_map_fd = GetNumber<uint32_t>(env, desc["innerMap"], 0);
     attr.map_ifindex = GetNumber<uint32_t>(env, desc["ifindex"], 0);
+    attr.btf_fd = GetNumber<uint32_t>(env, desc["btf"], 0);
+    attr.btf_key_type_id = GetNumber<uint32_t>(env, desc["btfKeyTypeId"], 0);
+    attr.btf_value_type_id = GetNumber<uint32_t>(env, desc["btfValueTypeId"], 0);
     std::string name;
     if (desc.Has("name")) {
         name = GetString(env, desc["name"]);
@@ -297,6 +388,11 @@ Napi::Value GetMapInfo(const CallbackInfo& info) {
         obj["netnsDev"] = Napi::BigInt::New(env, (uint64_t) map_info.netns_dev);
     if (info_size >= offsetof(bpf_map_info, netns_ino) + sizeof(map_info.netns_ino))
         obj["netnsIno"] = Napi::BigInt::New(env, (uint64_t) map_info.netns_ino);
+    if (info_size >= offsetof(bpf_map_info, btf_value_type_id) + sizeof(map_info.btf_value_type_id)) {
+        obj["btfId"] = Napi::Number::New(env, map_info.btf_id);
+        obj["btfKeyTypeId"] = Napi::Number::New(env, map_info.btf_key_type_id);
+        obj["btfValueTypeId"] = Napi::Number::New(env, map_info.btf_value_type_id);
+    }
     ret[1U] = obj;
     return ret;
 }
@@ -308,6 +404,14 @@ Napi::Value MapGetFdById(const CallbackInfo& info) {
     return ToStatus(env, bpf_map_get_fd_by_id(id));
 }
 
+Napi::Value BpfObjPin(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto fd = GetNumber<int>(env, info[a++]);
+    auto path = GetString(env, info[a++]);
+    return ToStatus(env, bpf_obj_pin(fd, path.c_str()));
+}
+
 Napi::Value BpfObjGet(const CallbackInfo& info) {
     Napi::Env env = info.Env();
     size_t a = 0;
@@ -315,36 +419,2109 @@ Napi::Value BpfObjGet(const CallbackInfo& info) {
     return ToStatus(env, bpf_obj_get(path.c_str()));
 }
 
-#define EXPOSE_FUNCTION(NAME, METHOD) exports.Set(NAME, Napi::Function::New(env, METHOD, NAME))
+// Programs
 
-Napi::Object Init(Napi::Env env, Napi::Object exports) {
-    auto versions = Napi::Object::New(env);
-    // Keep synchronized with deps
-    versions["libelf"] = Napi::String::New(env, "0.185");
-    versions["libbpf"] = Napi::String::New(env, "0.4.0");
-    versions["btf"] = Napi::Number::New(env, BTF_VERSION);
+uint32_t GetKernelVersion() {
     utsname kernel_info;
-    if (!uname(&kernel_info))
-        versions["kernel"] = Napi::String::New(env, kernel_info.release);
-    exports["versions"] = versions;
+    int major, minor, patch;
+    if (uname(&kernel_info) || sscanf(kernel_info.release, "%d.%d.%d", &major, &minor, &patch) != 3)
+        return 0;
+    // sublevel is clamped to 255 by the kernel too, since 4.9.256
+    return (major << 16) + (minor << 8) + (patch > 255 ? 255 : patch);
+}
 
-    FDRef::Init(env, exports);
-    EXPOSE_FUNCTION("dup", Dup);
+Napi::Value LoadProgram(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Object desc (env, info[0]);
+    Napi::TypedArrayOf<uint8_t> insns (env, desc["insns"]);
+    auto log = Napi::TypedArrayOf<uint8_t>(env, info[1]);
+    bpf_load_program_attr attr {};
+    attr.prog_type = (bpf_prog_type) GetNumber<uint32_t>(env, desc["type"]);
+    attr.expected_attach_type = (bpf_attach_type) GetNumber<uint32_t>(env, desc["expectedAttachType"], 0);
+    attr.insns = (const bpf_insn*) insns.Data();
+    attr.insns_cnt = insns.ByteLength() / sizeof(bpf_insn);
+    std::string license = GetString(env, desc["license"]);
+    attr.license = license.c_str();
+    attr.kern_version = GetNumber<uint32_t>(env, desc["kernVersion"], GetKernelVersion());
+    if (!desc.Get("attachProgFd").IsUndefined())
+        attr.attach_prog_fd = GetNumber<uint32_t>(env, desc["attachProgFd"]);
+    attr.prog_ifindex = GetNumber<uint32_t>(env, desc["ifindex"], 0);
+    if (!desc.Get("attachBtfId").IsUndefined())
+        attr.attach_btf_id = GetNumber<uint32_t>(env, desc["attachBtfId"]);
+    attr.log_level = GetNumber<uint32_t>(env, desc["logLevel"], 0);
+    attr.prog_flags = GetNumber<uint32_t>(env, desc["flags"], 0);
+    std::string name;
+    if (desc.Has("name")) {
+        name = GetString(env, desc["name"]);
+        attr.name = name.c_str();
+    }
+    log.Data()[0] = 0;
+    return ToStatus(env, bpf_load_program_xattr(&attr, (char*) log.Data(), log.ByteLength()));
+}
 
-    EXPOSE_FUNCTION("mapUpdateElem", MapUpdateElem);
-    EXPOSE_FUNCTION("mapLookupElem", MapLookupElem);
-    EXPOSE_FUNCTION("mapLookupAndDeleteElem", MapLookupAndDeleteElem);
-    EXPOSE_FUNCTION("mapDeleteElem", MapDeleteElem);
-    EXPOSE_FUNCTION("mapGetNextKey", MapGetNextKey);
-    EXPOSE_FUNCTION("mapFreeze", MapFreeze);
-    EXPOSE_FUNCTION("mapDeleteBatch", MapDeleteBatch);
-    EXPOSE_FUNCTION("mapLookupBatch", MapLookupBatch);
-    EXPOSE_FUNCTION("mapLookupAndDeleteBatch", MapLookupAndDeleteBatch);
-    EXPOSE_FUNCTION("mapUpdateBatch", MapUpdateBatch);
-    EXPOSE_FUNCTION("createMap", CreateMap);
-    EXPOSE_FUNCTION("getMapInfo", GetMapInfo);
-    EXPOSE_FUNCTION("mapGetFdById", MapGetFdById);
-    EXPOSE_FUNCTION("bpfObjGet", BpfObjGet);
+Napi::Value GetProgInfo(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto fd = GetNumber<int>(env, info[0]);
+    bpf_prog_info prog_info {};
+    uint32_t info_size = sizeof(prog_info);
+    auto ret = Napi::Array::New(env);
+    ret[0U] = ToStatus(env, bpf_obj_get_info_by_fd(fd, &prog_info, &info_size));
+    auto obj = Napi::Object::New(env);
+    obj["type"] = Napi::Number::New(env, prog_info.type);
+    obj["id"] = Napi::Number::New(env, prog_info.id);
+    static const char hex_digits [] = "0123456789abcdef";
+    std::string tag;
+    for (size_t i = 0; i < sizeof(prog_info.tag); i++) {
+        tag += hex_digits[prog_info.tag[i] >> 4];
+        tag += hex_digits[prog_info.tag[i] & 0xF];
+    }
+    obj["tag"] = Napi::String::New(env, tag);
+    obj["loadTime"] = Napi::BigInt::New(env, (uint64_t) prog_info.load_time);
+    obj["createdByUid"] = Napi::Number::New(env, prog_info.created_by_uid);
+    if (info_size >= offsetof(bpf_prog_info, name) + sizeof(prog_info.name))
+        obj["name"] = Napi::String::New(env, prog_info.name);
+    if (info_size >= offsetof(bpf_prog_info, ifindex) + sizeof(prog_info.ifindex))
+        obj["ifindex"] = Napi::Number::New(env, prog_info.ifindex);
+    // gpl_compatible is a bitfield right after ifindex
+    if (info_size >= offsetof(bpf_prog_info, ifindex) + 2 * sizeof(prog_info.ifindex))
+        obj["gplCompatible"] = Napi::Boolean::New(env, prog_info.gpl_compatible);
+    if (info_size >= offsetof(bpf_prog_info, netns_dev) + sizeof(prog_info.netns_dev))
+        obj["netnsDev"] = Napi::BigInt::New(env, (uint64_t) prog_info.netns_dev);
+    if (info_size >= offsetof(bpf_prog_info, netns_ino) + sizeof(prog_info.netns_ino))
+        obj["netnsIno"] = Napi::BigInt::New(env, (uint64_t) prog_info.netns_ino);
+    if (info_size >= offsetof(bpf_prog_info, btf_id) + sizeof(prog_info.btf_id))
+        obj["btfId"] = Napi::Number::New(env, prog_info.btf_id);
+    ret[1U] = obj;
+    return ret;
+}
+
+Napi::Value GetProgMapIds(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto fd = GetNumber<int>(env, info[0]);
+    bpf_prog_info prog_info {};
+    uint32_t info_size = sizeof(prog_info);
+    auto ret = Napi::Array::New(env);
+    int status = bpf_obj_get_info_by_fd(fd, &prog_info, &info_size);
+    // map count may change between calls, so retry until it fits
+    auto map_ids = Napi::TypedArrayOf<uint32_t>::New(env, 0);
+    while (!status && prog_info.nr_map_ids > map_ids.ElementLength()) {
+        map_ids = Napi::TypedArrayOf<uint32_t>::New(env, prog_info.nr_map_ids);
+        prog_info = {};
+        prog_info.nr_map_ids = map_ids.ElementLength();
+        prog_info.map_ids = (uint64_t) (uintptr_t) map_ids.Data();
+        info_size = sizeof(prog_info);
+        status = bpf_obj_get_info_by_fd(fd, &prog_info, &info_size);
+    }
+    ret[0U] = ToStatus(env, status);
+    ret[1U] = map_ids;
+    ret[2U] = Napi::Number::New(env, prog_info.nr_map_ids);
+    return ret;
+}
+
+Napi::Value ProgGetFdById(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto id = GetNumber<uint32_t>(env, info[a++]);
+    return ToStatus(env, bpf_prog_get_fd_by_id(id));
+}
+
+// Attachment (perf event based, mirrors the static helpers in libbpf.c)
+
+int ParseUintFromFile(const char* file, const char* fmt) {
+    FILE* f = fopen(file, "r");
+    if (!f)
+        return -errno;
+    int value;
+    int ret = fscanf(f, fmt, &value);
+    fclose(f);
+    return (ret == 1) ? value : -EINVAL;
+}
+
+int OpenProbe(bool uprobe, bool retprobe, const char* name, uint64_t offset, int pid,
+        uint64_t ref_ctr_offset = 0) {
+    const std::string base = uprobe ?
+        "/sys/bus/event_source/devices/uprobe/" : "/sys/bus/event_source/devices/kprobe/";
+    perf_event_attr attr {};
+    int type = ParseUintFromFile((base + "type").c_str(), "%d\n");
+    if (type < 0)
+        return type;
+    if (retprobe) {
+        int bit = ParseUintFromFile((base + "format/retprobe").c_str(), "config:%d\n");
+        if (bit < 0)
+            return bit;
+        attr.config |= 1 << bit;
+    }
+    if (ref_ctr_offset) {
+        // the kernel increments the semaphore at this file offset (4.20+)
+        int bit = ParseUintFromFile((base + "format/ref_ctr_offset").c_str(), "config:%d-63\n");
+        if (bit < 0)
+            return bit;
+        attr.config |= ref_ctr_offset << bit;
+    }
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config1 = (uint64_t) (uintptr_t) name; // kprobe_func or uprobe_path
+    attr.config2 = offset;                      // kprobe_addr or probe_offset
+
+    // pid filter is meaningful only for uprobes
+    int pfd = syscall(__NR_perf_event_open, &attr,
+        pid < 0 ? -1 : pid, pid == -1 ? 0 : -1, -1, PERF_FLAG_FD_CLOEXEC);
+    return pfd < 0 ? -errno : pfd;
+}
+
+int DetermineTracepointId(const std::string& category, const std::string& name) {
+    static const char* const roots [] = { "/sys/kernel/tracing", "/sys/kernel/debug/tracing" };
+    int ret = -ENOENT;
+    for (auto root : roots) {
+        std::string file = std::string(root) + "/events/" + category + "/" + name + "/id";
+        ret = ParseUintFromFile(file.c_str(), "%d\n");
+        if (ret != -ENOENT)
+            break;
+    }
+    return ret;
+}
+
+Napi::Value PerfEventOpenProbe(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto uprobe = GetBoolean(env, info[a++]);
+    auto retprobe = GetBoolean(env, info[a++]);
+    auto name = GetString(env, info[a++]);
+    auto offset = GetNumber<int64_t>(env, info[a++], 0);
+    auto pid = GetNumber<int>(env, info[a++], -1);
+    auto ref_ctr_offset = GetNumber<int64_t>(env, info[a++], 0);
+    return Napi::Number::New(env, OpenProbe(uprobe, retprobe, name.c_str(), offset, pid, ref_ctr_offset));
+}
+
+Napi::Value PerfEventOpenTracepoint(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto category = GetString(env, info[a++]);
+    auto name = GetString(env, info[a++]);
+    int id = DetermineTracepointId(category, name);
+    if (id < 0)
+        return Napi::Number::New(env, id);
+    perf_event_attr attr {};
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = id;
+    int pfd = syscall(__NR_perf_event_open, &attr, -1, 0, -1, PERF_FLAG_FD_CLOEXEC);
+    return Napi::Number::New(env, pfd < 0 ? -errno : pfd);
+}
+
+Napi::Value PerfEventOpen(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    Napi::Object obj (env, info[a++]);
+    auto pid = GetNumber<int>(env, info[a++], -1);
+    auto cpu = GetNumber<int>(env, info[a++], -1);
+    auto group_fd = GetNumber<int>(env, info[a++], -1);
+    perf_event_attr attr {};
+    attr.size = sizeof(attr);
+    attr.type = GetNumber<uint32_t>(env, obj["type"]);
+    attr.config = GetNumber<int64_t>(env, obj["config"], 0);
+    if (!obj.Get("sampleFreq").IsUndefined()) {
+        attr.freq = 1;
+        attr.sample_freq = GetNumber<int64_t>(env, obj["sampleFreq"]);
+    } else {
+        attr.sample_period = GetNumber<int64_t>(env, obj["samplePeriod"], 0);
+    }
+    attr.sample_type = GetNumber<int64_t>(env, obj["sampleType"], 0);
+    attr.wakeup_events = GetNumber<uint32_t>(env, obj["wakeupEvents"], 0);
+    attr.disabled = GetBoolean(env, obj["disabled"], false);
+    attr.inherit = GetBoolean(env, obj["inherit"], false);
+    attr.exclude_kernel = GetBoolean(env, obj["excludeKernel"], false);
+    attr.exclude_user = GetBoolean(env, obj["excludeUser"], false);
+    attr.exclude_hv = GetBoolean(env, obj["excludeHv"], false);
+    attr.exclude_idle = GetBoolean(env, obj["excludeIdle"], false);
+    int pfd = syscall(__NR_perf_event_open, &attr, pid, cpu, group_fd, PERF_FLAG_FD_CLOEXEC);
+    return Napi::Number::New(env, pfd < 0 ? -errno : pfd);
+}
+
+Napi::Value PerfEventAttach(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto pfd = GetNumber<int>(env, info[a++]);
+    auto prog_fd = GetNumber<int>(env, info[a++]);
+    if (ioctl(pfd, PERF_EVENT_IOC_SET_BPF, prog_fd) < 0)
+        return ToStatus(env, -1);
+    return ToStatus(env, ioctl(pfd, PERF_EVENT_IOC_ENABLE, 0));
+}
+
+Napi::Value RawTracepointOpen(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    std::string name;
+    bool has_name = !info[a].IsUndefined();
+    if (has_name)
+        name = GetString(env, info[a]);
+    a++;
+    auto prog_fd = GetNumber<int>(env, info[a++]);
+    return ToStatus(env, bpf_raw_tracepoint_open(has_name ? name.c_str() : nullptr, prog_fd));
+}
+
+// Attachment (BPF_PROG_ATTACH)
+
+Napi::Value ProgAttach(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto prog_fd = GetNumber<int>(env, info[a++]);
+    auto target_fd = GetNumber<int>(env, info[a++]);
+    auto attach_type = (bpf_attach_type) GetNumber<uint32_t>(env, info[a++]);
+    Napi::Object obj (env, info[a++]);
+    bpf_prog_attach_opts opts {};
+    opts.sz = sizeof(opts);
+    opts.flags = GetNumber<uint32_t>(env, obj["flags"], 0);
+    opts.replace_prog_fd = GetNumber<int>(env, obj["replaceProgFd"], 0);
+    return ToStatus(env, bpf_prog_attach_xattr(prog_fd, target_fd, attach_type, &opts));
+}
+
+Napi::Value ProgDetach(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto target_fd = GetNumber<int>(env, info[a++]);
+    auto attach_type = (bpf_attach_type) GetNumber<uint32_t>(env, info[a++]);
+    if (info[a].IsUndefined())
+        return ToStatus(env, bpf_prog_detach(target_fd, attach_type));
+    auto prog_fd = GetNumber<int>(env, info[a++]);
+    return ToStatus(env, bpf_prog_detach2(prog_fd, target_fd, attach_type));
+}
+
+Napi::Value ProgQuery(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto target_fd = GetNumber<int>(env, info[a++]);
+    auto attach_type = (bpf_attach_type) GetNumber<uint32_t>(env, info[a++]);
+    auto query_flags = GetNumber<uint32_t>(env, info[a++]);
+    auto ret = Napi::Array::New(env);
+    uint32_t attach_flags = 0, prog_cnt = 0;
+    int status = bpf_prog_query(target_fd, attach_type, query_flags, &attach_flags, NULL, &prog_cnt);
+    // program count may change between calls, so retry until it fits
+    auto prog_ids = Napi::TypedArrayOf<uint32_t>::New(env, 0);
+    while (!status && prog_cnt > prog_ids.ElementLength()) {
+        prog_ids = Napi::TypedArrayOf<uint32_t>::New(env, prog_cnt);
+        status = bpf_prog_query(target_fd, attach_type, query_flags, &attach_flags, prog_ids.Data(), &prog_cnt);
+        if (status && errno == ENOSPC)
+            status = 0;
+    }
+    ret[0U] = ToStatus(env, status);
+    ret[1U] = Napi::Number::New(env, attach_flags);
+    ret[2U] = prog_ids;
+    ret[3U] = Napi::Number::New(env, prog_cnt);
+    return ret;
+}
+
+// Links
+
+Napi::Value LinkCreate(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto prog_fd = GetNumber<int>(env, info[a++]);
+    auto target_fd = GetNumber<int>(env, info[a++]);
+    auto attach_type = (bpf_attach_type) GetNumber<uint32_t>(env, info[a++]);
+    Napi::Object obj (env, info[a++]);
+    bpf_link_create_opts opts {};
+    opts.sz = sizeof(opts);
+    opts.flags = GetNumber<uint32_t>(env, obj["flags"], 0);
+    if (!obj.Get("iterInfo").IsUndefined()) {
+        Napi::TypedArrayOf<uint8_t> iter_info (env, obj["iterInfo"]);
+        opts.iter_info = (bpf_iter_link_info*) iter_info.Data();
+        opts.iter_info_len = iter_info.ByteLength();
+    }
+    opts.target_btf_id = GetNumber<uint32_t>(env, obj["targetBtfId"], 0);
+    return ToStatus(env, bpf_link_create(prog_fd, target_fd, attach_type, &opts));
+}
+
+Napi::Value IterCreate(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto link_fd = GetNumber<int>(env, info[a++]);
+    return ToStatus(env, bpf_iter_create(link_fd));
+}
+
+Napi::Value LinkUpdate(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto link_fd = GetNumber<int>(env, info[a++]);
+    auto new_prog_fd = GetNumber<int>(env, info[a++]);
+    Napi::Object obj (env, info[a++]);
+    bpf_link_update_opts opts {};
+    opts.sz = sizeof(opts);
+    opts.flags = GetNumber<uint32_t>(env, obj["flags"], 0);
+    if (!obj.Get("oldProgFd").IsUndefined()) {
+        opts.flags |= BPF_F_REPLACE;
+        opts.old_prog_fd = GetNumber<uint32_t>(env, obj["oldProgFd"]);
+    }
+    return ToStatus(env, bpf_link_update(link_fd, new_prog_fd, &opts));
+}
+
+Napi::Value GetLinkInfo(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto fd = GetNumber<int>(env, info[0]);
+    bpf_link_info link_info {};
+    uint32_t info_size = sizeof(link_info);
+    auto ret = Napi::Array::New(env);
+    ret[0U] = ToStatus(env, bpf_obj_get_info_by_fd(fd, &link_info, &info_size));
+    auto obj = Napi::Object::New(env);
+    obj["type"] = Napi::Number::New(env, link_info.type);
+    obj["id"] = Napi::Number::New(env, link_info.id);
+    obj["progId"] = Napi::Number::New(env, link_info.prog_id);
+    switch (link_info.type) {
+        case BPF_LINK_TYPE_TRACING:
+            obj["attachType"] = Napi::Number::New(env, link_info.tracing.attach_type);
+            obj["targetObjId"] = Napi::Number::New(env, link_info.tracing.target_obj_id);
+            obj["targetBtfId"] = Napi::Number::New(env, link_info.tracing.target_btf_id);
+            break;
+        case BPF_LINK_TYPE_CGROUP:
+            obj["attachType"] = Napi::Number::New(env, link_info.cgroup.attach_type);
+            obj["cgroupId"] = Napi::BigInt::New(env, (uint64_t) link_info.cgroup.cgroup_id);
+            break;
+        case BPF_LINK_TYPE_ITER:
+            obj["mapId"] = Napi::Number::New(env, link_info.iter.map.map_id);
+            break;
+        case BPF_LINK_TYPE_NETNS:
+            obj["attachType"] = Napi::Number::New(env, link_info.netns.attach_type);
+            obj["netnsIno"] = Napi::Number::New(env, link_info.netns.netns_ino);
+            break;
+        case BPF_LINK_TYPE_XDP:
+            obj["ifindex"] = Napi::Number::New(env, link_info.xdp.ifindex);
+            break;
+    }
+    ret[1U] = obj;
+    return ret;
+}
+
+Napi::Value FindVmlinuxBtfId(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto name = GetString(env, info[a++]);
+    auto attach_type = (bpf_attach_type) GetNumber<uint32_t>(env, info[a++]);
+    // returns negative error code directly, without setting errno
+    return Napi::Number::New(env, libbpf_find_vmlinux_btf_id(name.c_str(), attach_type));
+}
+
+Napi::Value LoadBtf(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto data = Napi::TypedArrayOf<uint8_t>(env, info[a++]);
+    auto log = Napi::TypedArrayOf<uint8_t>(env, info[a++]);
+    log.Data()[0] = 0;
+    // the load is retried with logging enabled if it fails
+    return ToStatus(env, bpf_load_btf(data.Data(), data.ByteLength(), (char*) log.Data(), log.ByteLength(), false));
+}
+
+// Opens and loads an ELF object through libbpf, relocating it (CO-RE)
+// against a custom BTF if a path is given. Returns [status, maps,
+// programs] where maps and programs are [name, fd] pairs; the FDs are
+// duplicated, so the object itself is closed before returning.
+Napi::Value LoadObject(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    Napi::Value file = info[a++];
+    auto name = info[a].IsUndefined() ? std::string() : GetString(env, info[a]); a++;
+    auto target_btf = info[a].IsUndefined() ? std::string() : GetString(env, info[a]); a++;
+    auto log_level = GetNumber<int>(env, info[a++], 0);
+
+    bpf_object_open_opts opts {};
+    opts.sz = sizeof(opts);
+    opts.object_name = name.empty() ? nullptr : name.c_str();
+    bpf_object* obj;
+    if (file.IsBuffer()) {
+        auto buf = file.As<Napi::Buffer<uint8_t>>();
+        obj = bpf_object__open_mem(buf.Data(), buf.Length(), &opts);
+    } else {
+        obj = bpf_object__open_file(GetString(env, file).c_str(), &opts);
+    }
+    auto ret = Napi::Array::New(env);
+    long err = libbpf_get_error(obj);
+    if (err) {
+        ret[0U] = Napi::Number::New(env, err);
+        return ret;
+    }
+
+    bpf_object_load_attr attr {};
+    attr.obj = obj;
+    attr.log_level = log_level;
+    attr.target_btf_path = target_btf.empty() ? nullptr : target_btf.c_str();
+    int status = bpf_object__load_xattr(&attr);
+    auto maps = Napi::Array::New(env);
+    auto progs = Napi::Array::New(env);
+    std::vector<int> fds;
+    uint32_t n = 0;
+    bpf_map* map;
+    bpf_object__for_each_map(map, obj) {
+        if (status < 0)
+            break;
+        int fd = fcntl(bpf_map__fd(map), F_DUPFD_CLOEXEC, 0);
+        if (fd < 0) {
+            status = -errno;
+            break;
+        }
+        fds.push_back(fd);
+        auto pair = Napi::Array::New(env);
+        pair[0U] = Napi::String::New(env, bpf_map__name(map));
+        pair[1U] = Napi::Number::New(env, fd);
+        maps[n++] = pair;
+    }
+    n = 0;
+    bpf_program* prog;
+    bpf_object__for_each_program(prog, obj) {
+        if (status < 0)
+            break;
+        int fd = fcntl(bpf_program__fd(prog), F_DUPFD_CLOEXEC, 0);
+        if (fd < 0) {
+            status = -errno;
+            break;
+        }
+        fds.push_back(fd);
+        auto pair = Napi::Array::New(env);
+        pair[0U] = Napi::String::New(env, bpf_program__name(prog));
+        pair[1U] = Napi::Number::New(env, fd);
+        progs[n++] = pair;
+    }
+    bpf_object__close(obj);
+    if (status < 0) {
+        // don't leak the FDs we got before failing
+        for (int fd : fds)
+            close(fd);
+    }
+    ret[0U] = Napi::Number::New(env, status);
+    ret[1U] = maps;
+    ret[2U] = progs;
+    return ret;
+}
+
+// Networking
+
+Napi::Value IfNameToIndex(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto name = GetString(env, info[0]);
+    unsigned int ifindex = if_nametoindex(name.c_str());
+    return Napi::Number::New(env, ifindex ? (int) ifindex : -errno);
+}
+
+// Moves the calling thread (only) to the network namespace at fd
+Napi::Value SetNetns(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto fd = GetNumber<int>(env, info[0]);
+    return ToStatus(env, setns(fd, CLONE_NEWNET));
+}
+
+Napi::Value SetLinkXdpFd(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto ifindex = GetNumber<int>(env, info[a++]);
+    auto fd = GetNumber<int>(env, info[a++]);
+    auto flags = GetNumber<uint32_t>(env, info[a++]);
+    // libbpf sets XDP_FLAGS_REPLACE if old_fd is present in opts
+    bpf_xdp_set_link_opts opts {};
+    opts.sz = sizeof(opts);
+    opts.old_fd = GetNumber<int>(env, info[a], -1);
+    auto opts_ptr = info[a++].IsUndefined() ? nullptr : &opts;
+    // netlink functions return a negative error code directly
+    return Napi::Number::New(env, bpf_set_link_xdp_fd_opts(ifindex, fd, flags, opts_ptr));
+}
+
+Napi::Value GetLinkXdpInfo(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto ifindex = GetNumber<int>(env, info[a++]);
+    auto flags = GetNumber<uint32_t>(env, info[a++]);
+    xdp_link_info xdp_info {};
+    auto ret = Napi::Array::New(env);
+    ret[0U] = Napi::Number::New(env, bpf_get_link_xdp_info(ifindex, &xdp_info, sizeof(xdp_info), flags));
+    auto obj = Napi::Object::New(env);
+    obj["progId"] = Napi::Number::New(env, xdp_info.prog_id);
+    obj["drvProgId"] = Napi::Number::New(env, xdp_info.drv_prog_id);
+    obj["hwProgId"] = Napi::Number::New(env, xdp_info.hw_prog_id);
+    obj["skbProgId"] = Napi::Number::New(env, xdp_info.skb_prog_id);
+    obj["attachMode"] = Napi::Number::New(env, xdp_info.attach_mode);
+    ret[1U] = obj;
+    return ret;
+}
+
+bpf_tc_hook GetTcHook(Napi::Env env, Napi::Value x) {
+    Napi::Object obj (env, x);
+    bpf_tc_hook ret {};
+    ret.sz = sizeof(ret);
+    ret.ifindex = GetNumber<int>(env, obj["ifindex"]);
+    ret.attach_point = (bpf_tc_attach_point) GetNumber<uint32_t>(env, obj["attachPoint"]);
+    ret.parent = GetNumber<uint32_t>(env, obj["parent"], 0);
+    return ret;
+}
+
+bpf_tc_opts GetTcOpts(Napi::Env env, Napi::Value x) {
+    Napi::Object obj (env, x);
+    bpf_tc_opts ret {};
+    ret.sz = sizeof(ret);
+    ret.prog_fd = GetNumber<int>(env, obj["progFd"], 0);
+    ret.flags = GetNumber<uint32_t>(env, obj["flags"], 0);
+    ret.handle = GetNumber<uint32_t>(env, obj["handle"], 0);
+    ret.priority = GetNumber<uint32_t>(env, obj["priority"], 0);
+    return ret;
+}
+
+Napi::Object TcOptsToObject(Napi::Env env, const bpf_tc_opts& opts) {
+    auto obj = Napi::Object::New(env);
+    obj["handle"] = Napi::Number::New(env, opts.handle);
+    obj["priority"] = Napi::Number::New(env, opts.priority);
+    obj["progId"] = Napi::Number::New(env, opts.prog_id);
+    return obj;
+}
+
+Napi::Value TcHookCreate(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto hook = GetTcHook(env, info[0]);
+    return Napi::Number::New(env, bpf_tc_hook_create(&hook));
+}
+
+Napi::Value TcHookDestroy(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto hook = GetTcHook(env, info[0]);
+    return Napi::Number::New(env, bpf_tc_hook_destroy(&hook));
+}
+
+Napi::Value TcAttach(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto hook = GetTcHook(env, info[0]);
+    auto opts = GetTcOpts(env, info[1]);
+    auto ret = Napi::Array::New(env);
+    ret[0U] = Napi::Number::New(env, bpf_tc_attach(&hook, &opts));
+    ret[1U] = TcOptsToObject(env, opts);
+    return ret;
+}
+
+Napi::Value TcDetach(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto hook = GetTcHook(env, info[0]);
+    auto opts = GetTcOpts(env, info[1]);
+    return Napi::Number::New(env, bpf_tc_detach(&hook, &opts));
+}
+
+Napi::Value TcQuery(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto hook = GetTcHook(env, info[0]);
+    auto opts = GetTcOpts(env, info[1]);
+    auto ret = Napi::Array::New(env);
+    ret[0U] = Napi::Number::New(env, bpf_tc_query(&hook, &opts));
+    ret[1U] = TcOptsToObject(env, opts);
+    return ret;
+}
+
+// Sockets
+
+Napi::Value AttachSocketFilter(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto fd = GetNumber<int>(env, info[a++]);
+    auto prog_fd = GetNumber<int>(env, info[a++]);
+    return ToStatus(env, setsockopt(fd, SOL_SOCKET, SO_ATTACH_BPF, &prog_fd, sizeof(prog_fd)));
+}
+
+Napi::Value AttachReuseportProgram(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto fd = GetNumber<int>(env, info[a++]);
+    auto prog_fd = GetNumber<int>(env, info[a++]);
+    return ToStatus(env, setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF, &prog_fd, sizeof(prog_fd)));
+}
+
+Napi::Value DetachReuseportProgram(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto fd = GetNumber<int>(env, info[a++]);
+    int dummy = 0;
+    return ToStatus(env, setsockopt(fd, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF, &dummy, sizeof(dummy)));
+}
+
+// Creates a TCP socket with SO_REUSEPORT, bound to the given address (not listening yet)
+Napi::Value BindReuseport(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto host = GetString(env, info[a++]);
+    auto port = GetNumber<uint32_t>(env, info[a++]);
+    sockaddr_in6 addr6 {};
+    sockaddr_in addr4 {};
+    sockaddr* addr = (sockaddr*) &addr4;
+    socklen_t addrlen = sizeof(addr4);
+    if (inet_pton(AF_INET, host.c_str(), &addr4.sin_addr) == 1) {
+        addr4.sin_family = AF_INET;
+        addr4.sin_port = htons(port);
+    } else if (inet_pton(AF_INET6, host.c_str(), &addr6.sin6_addr) == 1) {
+        addr6.sin6_family = AF_INET6;
+        addr6.sin6_port = htons(port);
+        addr = (sockaddr*) &addr6;
+        addrlen = sizeof(addr6);
+    } else {
+        return Napi::Number::New(env, -EINVAL);
+    }
+    int fd = socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return Napi::Number::New(env, -errno);
+    int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 || bind(fd, addr, addrlen) < 0) {
+        int err = errno;
+        close(fd);
+        return Napi::Number::New(env, -err);
+    }
+    return Napi::Number::New(env, fd);
+}
+
+Napi::Value DetachSocketFilter(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto fd = GetNumber<int>(env, info[a++]);
+    int dummy = 0;
+    return ToStatus(env, setsockopt(fd, SOL_SOCKET, SO_DETACH_BPF, &dummy, sizeof(dummy)));
+}
+
+// AF_XDP
+
+// UMEM memory, shared between the socket and the ArrayBuffer
+// exposing it (whichever goes away last unmaps it)
+struct UmemArea {
+    void* data;
+    size_t size;
+
+    UmemArea(void* data, size_t size) : data(data), size(size) {}
+    ~UmemArea() {
+        munmap(data, size);
+    }
+};
+
+// Reserve up to max slots of a producer ring (xsk_ring_prod__reserve is all-or-nothing)
+static uint32_t ReserveUpTo(xsk_ring_prod* ring, size_t max, uint32_t* idx) {
+    uint32_t n = std::min(max, (size_t) xsk_prod_nb_free(ring, max));
+    return xsk_ring_prod__reserve(ring, n, idx);
+}
+
+class XskSocket : public Napi::ObjectWrap<XskSocket> {
+  public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports) {
+        Napi::Function func = DefineClass(env, "XskSocket", {
+            InstanceMethod<&XskSocket::Create>("create"),
+            InstanceMethod<&XskSocket::Close>("close"),
+            InstanceAccessor("fd", &XskSocket::GetFD, nullptr),
+            InstanceAccessor("umem", &XskSocket::GetUmem, nullptr),
+            InstanceMethod<&XskSocket::Fill>("fill"),
+            InstanceMethod<&XskSocket::Receive>("receive"),
+            InstanceMethod<&XskSocket::Transmit>("transmit"),
+            InstanceMethod<&XskSocket::Complete>("complete"),
+            InstanceMethod<&XskSocket::FillBatch>("fillBatch"),
+            InstanceMethod<&XskSocket::RxBatch>("rxBatch"),
+            InstanceMethod<&XskSocket::TxBatch>("txBatch"),
+            InstanceMethod<&XskSocket::CompleteBatch>("completeBatch"),
+            InstanceMethod<&XskSocket::NeedsWakeup>("needsWakeup"),
+            InstanceMethod<&XskSocket::Kick>("kick"),
+            InstanceMethod<&XskSocket::GetStatistics>("getStatistics"),
+            InstanceMethod<&XskSocket::PollStart>("pollStart"),
+            InstanceMethod<&XskSocket::PollStop>("pollStop"),
+        });
+        exports["XskSocket"] = func;
+        return exports;
+    }
+
+    XskSocket(const CallbackInfo& info) : Napi::ObjectWrap<XskSocket>(info) {}
+
+    ~XskSocket() {
+        doClose();
+    }
+
+    void doClose() {
+        doPollStop();
+        if (poll != nullptr) {
+            uv_close((uv_handle_t*) poll, [](uv_handle_t* handle) {
+                delete (uv_poll_t*) handle;
+            });
+            poll = nullptr;
+        }
+        pollCallback.Reset();
+        if (xsk != nullptr) {
+            xsk_socket__delete(xsk);
+            xsk = nullptr;
+        }
+        if (umem != nullptr) {
+            xsk_umem__delete(umem);
+            umem = nullptr;
+        }
+        umemBuffer.Reset();
+        area.reset();
+    }
+
+  private:
+    std::shared_ptr<UmemArea> area;
+    Napi::Reference<Napi::ArrayBuffer> umemBuffer;
+    xsk_umem* umem = nullptr;
+    xsk_socket* xsk = nullptr;
+    xsk_ring_prod fillRing {}, txRing {};
+    xsk_ring_cons compRing {}, rxRing {};
+    uv_poll_t* poll = nullptr;
+    bool polling = false;
+    Napi::FunctionReference pollCallback;
+    std::unique_ptr<Napi::AsyncContext> asyncContext;
+
+    void CheckOpen(Napi::Env env) {
+        if (xsk == nullptr)
+            throw Napi::Error::New(env, "Socket is not open");
+    }
+
+    Napi::Value Create(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        size_t a = 0;
+        auto ifname = GetString(env, info[a++]);
+        auto queue_id = GetNumber<uint32_t>(env, info[a++]);
+        Napi::Object obj (env, info[a++]);
+        if (area)
+            throw Napi::Error::New(env, "Socket was already created");
+
+        xsk_umem_config umem_config {};
+        umem_config.fill_size = GetNumber<uint32_t>(env, obj["fillSize"], XSK_RING_PROD__DEFAULT_NUM_DESCS);
+        umem_config.comp_size = GetNumber<uint32_t>(env, obj["compSize"], XSK_RING_CONS__DEFAULT_NUM_DESCS);
+        umem_config.frame_size = GetNumber<uint32_t>(env, obj["frameSize"], XSK_UMEM__DEFAULT_FRAME_SIZE);
+        umem_config.frame_headroom = GetNumber<uint32_t>(env, obj["frameHeadroom"], XSK_UMEM__DEFAULT_FRAME_HEADROOM);
+        auto frame_count = GetNumber<uint32_t>(env, obj["frameCount"]);
+        xsk_socket_config config {};
+        config.rx_size = GetNumber<uint32_t>(env, obj["rxSize"], XSK_RING_CONS__DEFAULT_NUM_DESCS);
+        config.tx_size = GetNumber<uint32_t>(env, obj["txSize"], XSK_RING_PROD__DEFAULT_NUM_DESCS);
+        config.libbpf_flags = GetNumber<uint32_t>(env, obj["libbpfFlags"], 0);
+        config.xdp_flags = GetNumber<uint32_t>(env, obj["xdpFlags"], 0);
+        config.bind_flags = GetNumber<uint32_t>(env, obj["bindFlags"], 0);
+
+        // page-aligned, as required by the kernel
+        size_t size = (size_t) umem_config.frame_size * frame_count;
+        if (size > ((size_t) 1 << 32))
+            throw Napi::RangeError::New(env, "UMEM size must not exceed 4GiB");
+        void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED)
+            return ToStatus(env, -1);
+        area = std::make_shared<UmemArea>(data, size);
+
+        // these return negative error codes directly
+        int ret = xsk_umem__create(&umem, data, size, &fillRing, &compRing, &umem_config);
+        if (ret) {
+            umem = nullptr;
+            area.reset();
+            return Napi::Number::New(env, ret);
+        }
+        ret = xsk_socket__create(&xsk, ifname.c_str(), queue_id, umem, &rxRing, &txRing, &config);
+        if (ret) {
+            xsk = nullptr;
+            doClose();
+            return Napi::Number::New(env, ret);
+        }
+
+        auto hint = new std::shared_ptr<UmemArea>(area);
+        auto buffer = Napi::ArrayBuffer::New(env, data, size, [](Napi::Env env, void* data, std::shared_ptr<UmemArea>* hint) {
+            delete hint;
+        }, hint);
+        umemBuffer = Napi::Persistent(buffer);
+        return Napi::Number::New(env, 0);
+    }
+
+    void Close(const CallbackInfo& info) {
+        doClose();
+    }
+
+    Napi::Value GetFD(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        return Napi::Number::New(env, xsk_socket__fd(xsk));
+    }
+
+    Napi::Value GetUmem(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        return umemBuffer.Value();
+    }
+
+    // Ring operations
+
+    Napi::Value Fill(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        Napi::Array array (env, info[0]);
+        // convert everything first: throwing with slots reserved would corrupt the ring
+        std::vector<uint64_t> addrs (array.Length());
+        for (uint32_t i = 0; i < addrs.size(); i++)
+            addrs[i] = GetNumber<int64_t>(env, array.Get(i));
+        uint32_t idx;
+        uint32_t count = ReserveUpTo(&fillRing, addrs.size(), &idx);
+        for (uint32_t i = 0; i < count; i++)
+            *xsk_ring_prod__fill_addr(&fillRing, idx + i) = addrs[i];
+        xsk_ring_prod__submit(&fillRing, count);
+        return Napi::Number::New(env, count);
+    }
+
+    Napi::Value Receive(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        auto max = GetNumber<uint32_t>(env, info[0]);
+        uint32_t idx;
+        uint32_t count = xsk_ring_cons__peek(&rxRing, max, &idx);
+        auto descs = Napi::Array::New(env, count);
+        for (uint32_t i = 0; i < count; i++) {
+            auto desc = xsk_ring_cons__rx_desc(&rxRing, idx + i);
+            auto obj = Napi::Object::New(env);
+            obj["addr"] = Napi::Number::New(env, desc->addr);
+            obj["len"] = Napi::Number::New(env, desc->len);
+            descs[i] = obj;
+        }
+        xsk_ring_cons__release(&rxRing, count);
+        return descs;
+    }
+
+    Napi::Value Transmit(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        Napi::Array array (env, info[0]);
+        // same as Fill: convert first, then reserve
+        std::vector<xdp_desc> descs (array.Length());
+        for (uint32_t i = 0; i < descs.size(); i++) {
+            Napi::Object obj (env, array.Get(i));
+            descs[i].addr = GetNumber<int64_t>(env, obj["addr"]);
+            descs[i].len = GetNumber<uint32_t>(env, obj["len"]);
+            descs[i].options = 0;
+        }
+        uint32_t idx;
+        uint32_t count = ReserveUpTo(&txRing, descs.size(), &idx);
+        for (uint32_t i = 0; i < count; i++)
+            *xsk_ring_prod__tx_desc(&txRing, idx + i) = descs[i];
+        xsk_ring_prod__submit(&txRing, count);
+        return Napi::Number::New(env, count);
+    }
+
+    Napi::Value Complete(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        auto max = GetNumber<uint32_t>(env, info[0]);
+        uint32_t idx;
+        uint32_t count = xsk_ring_cons__peek(&compRing, max, &idx);
+        auto addrs = Napi::Array::New(env, count);
+        for (uint32_t i = 0; i < count; i++)
+            addrs[i] = Napi::Number::New(env, *xsk_ring_cons__comp_addr(&compRing, idx + i));
+        xsk_ring_cons__release(&compRing, count);
+        return addrs;
+    }
+
+    // Batched ring operations (addresses are 32-bit, since the UMEM is smaller than 4GiB)
+
+    Napi::Value FillBatch(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        size_t a = 0;
+        Napi::TypedArrayOf<uint32_t> addrs (env, info[a++]);
+        auto max = std::min((size_t) GetNumber<uint32_t>(env, info[a++]), addrs.ElementLength());
+        uint32_t idx;
+        uint32_t count = ReserveUpTo(&fillRing, max, &idx);
+        const uint32_t* data = addrs.Data();
+        for (uint32_t i = 0; i < count; i++)
+            *xsk_ring_prod__fill_addr(&fillRing, idx + i) = data[i];
+        xsk_ring_prod__submit(&fillRing, count);
+        return Napi::Number::New(env, count);
+    }
+
+    Napi::Value RxBatch(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        size_t a = 0;
+        Napi::TypedArrayOf<uint32_t> out (env, info[a++]);
+        auto max = std::min((size_t) GetNumber<uint32_t>(env, info[a++]), out.ElementLength() / 2);
+        uint32_t idx;
+        uint32_t count = xsk_ring_cons__peek(&rxRing, max, &idx);
+        uint32_t* data = out.Data();
+        for (uint32_t i = 0; i < count; i++) {
+            auto desc = xsk_ring_cons__rx_desc(&rxRing, idx + i);
+            data[2*i] = desc->addr;
+            data[2*i + 1] = desc->len;
+        }
+        xsk_ring_cons__release(&rxRing, count);
+        return Napi::Number::New(env, count);
+    }
+
+    Napi::Value TxBatch(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        size_t a = 0;
+        Napi::TypedArrayOf<uint32_t> descs (env, info[a++]);
+        auto max = std::min((size_t) GetNumber<uint32_t>(env, info[a++]), descs.ElementLength() / 2);
+        uint32_t idx;
+        uint32_t count = ReserveUpTo(&txRing, max, &idx);
+        const uint32_t* data = descs.Data();
+        for (uint32_t i = 0; i < count; i++) {
+            auto desc = xsk_ring_prod__tx_desc(&txRing, idx + i);
+            desc->addr = data[2*i];
+            desc->len = data[2*i + 1];
+            desc->options = 0;
+        }
+        xsk_ring_prod__submit(&txRing, count);
+        return Napi::Number::New(env, count);
+    }
+
+    Napi::Value CompleteBatch(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        size_t a = 0;
+        Napi::TypedArrayOf<uint32_t> out (env, info[a++]);
+        auto max = std::min((size_t) GetNumber<uint32_t>(env, info[a++]), out.ElementLength());
+        uint32_t idx;
+        uint32_t count = xsk_ring_cons__peek(&compRing, max, &idx);
+        uint32_t* data = out.Data();
+        for (uint32_t i = 0; i < count; i++)
+            data[i] = *xsk_ring_cons__comp_addr(&compRing, idx + i);
+        xsk_ring_cons__release(&compRing, count);
+        return Napi::Number::New(env, count);
+    }
+
+    Napi::Value NeedsWakeup(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        auto tx = GetBoolean(env, info[0]);
+        return Napi::Boolean::New(env, xsk_ring_prod__needs_wakeup(tx ? &txRing : &fillRing));
+    }
+
+    Napi::Value Kick(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        int ret = sendto(xsk_socket__fd(xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+        // these mean the kernel is busy and will process the ring anyway
+        if (ret < 0 && (errno == EAGAIN || errno == EBUSY || errno == ENOBUFS || errno == ENETDOWN))
+            ret = 0;
+        return ToStatus(env, ret);
+    }
+
+    Napi::Value GetStatistics(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        xdp_statistics stats {};
+        socklen_t optlen = sizeof(stats);
+        auto ret = Napi::Array::New(env);
+        int status = getsockopt(xsk_socket__fd(xsk), SOL_XDP, XDP_STATISTICS, &stats, &optlen);
+        ret[0U] = ToStatus(env, status);
+        if (status) return ret;
+        auto obj = Napi::Object::New(env);
+        obj["rxDropped"] = Napi::BigInt::New(env, (uint64_t) stats.rx_dropped);
+        obj["rxInvalidDescs"] = Napi::BigInt::New(env, (uint64_t) stats.rx_invalid_descs);
+        obj["txInvalidDescs"] = Napi::BigInt::New(env, (uint64_t) stats.tx_invalid_descs);
+        // reported since Linux 5.9
+        if (optlen == sizeof(stats)) {
+            obj["rxRingFull"] = Napi::BigInt::New(env, (uint64_t) stats.rx_ring_full);
+            obj["rxFillRingEmptyDescs"] = Napi::BigInt::New(env, (uint64_t) stats.rx_fill_ring_empty_descs);
+            obj["txRingEmptyDescs"] = Napi::BigInt::New(env, (uint64_t) stats.tx_ring_empty_descs);
+        }
+        ret[1U] = obj;
+        return ret;
+    }
+
+    // Wakeups
+
+    static void OnPoll(uv_poll_t* handle, int status, int events) {
+        auto self = (XskSocket*) handle->data;
+        Napi::Env env = self->Env();
+        Napi::HandleScope scope(env);
+        try {
+            self->pollCallback.MakeCallback(self->Value(), {
+                Napi::Number::New(env, status),
+                Napi::Number::New(env, events),
+            }, *self->asyncContext);
+        } catch (const Napi::Error& e) {
+            napi_fatal_exception(env, e.Value());
+        }
+    }
+
+    Napi::Value PollStart(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckOpen(env);
+        size_t a = 0;
+        auto events = GetNumber<int>(env, info[a++]);
+        Napi::Function callback (env, info[a++]);
+        if (poll == nullptr) {
+            uv_loop_t* loop;
+            napi_get_uv_event_loop(env, &loop);
+            poll = new uv_poll_t;
+            // uv returns negative error codes directly
+            int ret = uv_poll_init(loop, poll, xsk_socket__fd(xsk));
+            if (ret) {
+                delete poll;
+                poll = nullptr;
+                return Napi::Number::New(env, ret);
+            }
+            poll->data = this;
+            asyncContext.reset(new Napi::AsyncContext(env, "XskSocket"));
+        }
+        pollCallback = Napi::Persistent(callback);
+        int ret = uv_poll_start(poll, events, OnPoll);
+        // keep the socket alive while polling
+        if (!ret && !polling) {
+            polling = true;
+            Ref();
+        }
+        return Napi::Number::New(env, ret);
+    }
+
+    void doPollStop() {
+        if (polling) {
+            uv_poll_stop(poll);
+            polling = false;
+            Unref();
+        }
+    }
+
+    void PollStop(const CallbackInfo& info) {
+        doPollStop();
+    }
+};
+
+// Symbolization
+
+// Kernel symbol table, parsed from /proc/kallsyms into arrays sorted
+// by address, with names stored in a string arena. Core kernel symbols
+// never change, so refreshing only re-parses the module (and BPF) ones.
+class Kallsyms : public Napi::ObjectWrap<Kallsyms> {
+  public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports) {
+        Napi::Function func = DefineClass(env, "Kallsyms", {
+            InstanceMethod<&Kallsyms::Load>("load"),
+            InstanceMethod<&Kallsyms::Refresh>("refresh"),
+            InstanceMethod<&Kallsyms::Resolve>("resolve"),
+            InstanceMethod<&Kallsyms::GetSymbol>("getSymbol"),
+            InstanceAccessor("coreCount", &Kallsyms::GetCoreCount, nullptr),
+            InstanceAccessor("count", &Kallsyms::GetCount, nullptr),
+        });
+        exports["Kallsyms"] = func;
+        return exports;
+    }
+
+    Kallsyms(const CallbackInfo& info) : Napi::ObjectWrap<Kallsyms>(info) {}
+
+    // Appends the name of the symbol containing addr, if found
+    bool Symbolize(uint64_t addr, std::string& out) const {
+        const Symbol* c = core.find(addr);
+        const Symbol* m = modules.find(addr);
+        if (c && (!m || c->addr >= m->addr))
+            out += core.arena.c_str() + c->name;
+        else if (m)
+            out += modules.arena.c_str() + m->name;
+        return c || m;
+    }
+
+  private:
+    struct Symbol {
+        uint64_t addr;
+        uint32_t name; // offset into the arena
+        uint32_t module; // offset into the arena, or NONE
+    };
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Table {
+        std::vector<Symbol> symbols;
+        std::string arena;
+        // addresses where no symbol extends past: non-text symbols,
+        // end of core text, end of each module
+        std::vector<uint64_t> ends;
+
+        void clear() {
+            symbols.clear();
+            arena.clear();
+            ends.clear();
+        }
+
+        uint32_t intern(const char* str, size_t len) {
+            uint32_t offset = arena.size();
+            arena.append(str, len);
+            arena.push_back('\0');
+            return offset;
+        }
+
+        // sort, keeping the first symbol seen for each address
+        void sort() {
+            std::stable_sort(symbols.begin(), symbols.end(),
+                [](const Symbol& a, const Symbol& b) { return a.addr < b.addr; });
+            symbols.erase(std::unique(symbols.begin(), symbols.end(),
+                [](const Symbol& a, const Symbol& b) { return a.addr == b.addr; }), symbols.end());
+            std::sort(ends.begin(), ends.end());
+        }
+
+        // last symbol at or before addr, unless an end lies between them
+        const Symbol* find(uint64_t addr) const {
+            auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+                [](uint64_t addr, const Symbol& s) { return addr < s.addr; });
+            if (it == symbols.begin())
+                return nullptr;
+            const Symbol* sym = &*(it - 1);
+            auto end = std::upper_bound(ends.begin(), ends.end(), addr);
+            if (end != ends.begin() && end[-1] > sym->addr)
+                return nullptr;
+            return sym;
+        }
+    };
+
+    std::string kallsymsPath, modulesPath;
+    Table core, modules;
+    // module names and load addresses, to detect changes
+    std::string modulesSignature;
+    std::vector<uint64_t> moduleEnds;
+
+    int ReadModulesSignature(std::string& signature, std::vector<uint64_t>& ends) {
+        FILE* file = fopen(modulesPath.c_str(), "re");
+        if (file == nullptr)
+            return -1;
+        char* line = nullptr;
+        size_t capacity = 0;
+        char name[64];
+        unsigned long long size, addr;
+        while (getline(&line, &capacity, file) != -1) {
+            if (sscanf(line, "%63s %llu %*s %*s %*s %llx", name, &size, &addr) == 3) {
+                ends.push_back(addr + size);
+                signature += name;
+                signature += ' ';
+                signature += std::to_string(addr);
+                signature += '\n';
+            }
+        }
+        free(line);
+        fclose(file);
+        return 0;
+    }
+
+    // Only text symbols are kept, other symbols (and _etext) just
+    // bound the previous one. Module symbols (lines with a
+    // "\t[module]" suffix) go to their own table.
+    int Parse(bool withCore) {
+        FILE* file = fopen(kallsymsPath.c_str(), "re");
+        if (file == nullptr)
+            return -1;
+        if (withCore) core.clear();
+        modules.clear();
+        std::string lastModule;
+        uint32_t lastModuleOffset = NONE;
+        bool anyAddress = false;
+
+        char* line = nullptr;
+        size_t capacity = 0;
+        ssize_t len;
+        while ((len = getline(&line, &capacity, file)) != -1) {
+            char* end = line + len;
+            if (end > line && end[-1] == '\n') *--end = '\0';
+            char* tab = (char*) memchr(line, '\t', end - line);
+            if (tab == nullptr && !withCore) continue;
+
+            char* pos;
+            uint64_t addr = strtoull(line, &pos, 16);
+            if (pos[0] != ' ' || !pos[1] || pos[2] != ' ') continue;
+            char type = pos[1] | 0x20;
+            const char* name = pos + 3;
+            size_t name_len = (tab ? tab : end) - name;
+            anyAddress |= addr != 0;
+            if ((type != 't' && type != 'w') || (tab == nullptr && !strcmp(name, "_etext"))) {
+                (tab ? modules : core).ends.push_back(addr);
+                continue;
+            }
+
+            if (tab == nullptr) {
+                core.symbols.push_back({ addr, core.intern(name, name_len), NONE });
+                continue;
+            }
+            // "\t[module]"
+            const char* module = tab + 2;
+            const char* module_end = end > module && end[-1] == ']' ? end - 1 : end;
+            if (lastModuleOffset == NONE || lastModule.compare(0, std::string::npos, module, module_end - module)) {
+                lastModule.assign(module, module_end - module);
+                lastModuleOffset = modules.intern(module, module_end - module);
+            }
+            modules.symbols.push_back({ addr, modules.intern(name, name_len), lastModuleOffset });
+        }
+        free(line);
+        fclose(file);
+
+        // addresses are hidden (kptr_restrict)
+        if (withCore && !anyAddress && !core.symbols.empty()) {
+            core.clear();
+            modules.clear();
+            errno = EPERM;
+            return -1;
+        }
+        modules.ends.insert(modules.ends.end(), moduleEnds.begin(), moduleEnds.end());
+        if (withCore) core.sort();
+        modules.sort();
+        return 0;
+    }
+
+    Napi::Value Load(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        size_t a = 0;
+        kallsymsPath = GetString(env, info[a++]);
+        modulesPath = GetString(env, info[a++]);
+        modulesSignature.clear();
+        moduleEnds.clear();
+        // a missing modules file just disables change detection
+        ReadModulesSignature(modulesSignature, moduleEnds);
+        return ToStatus(env, Parse(true));
+    }
+
+    // Returns 1 if the module symbols were re-read, 0 if modules
+    // didn't change (unless forced, i.e. to pick up BPF programs)
+    Napi::Value Refresh(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        auto force = GetBoolean(env, info[0]);
+        std::string signature;
+        std::vector<uint64_t> ends;
+        if (ReadModulesSignature(signature, ends) == 0 && signature == modulesSignature && !force)
+            return Napi::Number::New(env, 0);
+        modulesSignature = signature;
+        moduleEnds = ends;
+        int status = Parse(false);
+        return ToStatus(env, status ? status : 1);
+    }
+
+    // Symbol indexes cover the core table first, then the module one
+    Napi::Value Resolve(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        size_t a = 0;
+        Napi::TypedArrayOf<uint64_t> addrs (env, info[a++]);
+        auto count = GetNumber<uint32_t>(env, info[a++]);
+        Napi::TypedArrayOf<uint32_t> indexes (env, info[a++]);
+        Napi::TypedArrayOf<uint64_t> offsets (env, info[a++]);
+        if (count > addrs.ElementLength() || count > indexes.ElementLength() || count > offsets.ElementLength())
+            throw Napi::RangeError::New(env, "Count exceeds array length");
+
+        uint32_t found = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t addr = addrs.Data()[i];
+            const Symbol* c = core.find(addr);
+            const Symbol* m = modules.find(addr);
+            uint32_t index = NONE;
+            const Symbol* sym = nullptr;
+            if (c && (!m || c->addr >= m->addr))
+                sym = c, index = c - core.symbols.data();
+            else if (m)
+                sym = m, index = core.symbols.size() + (m - modules.symbols.data());
+            indexes.Data()[i] = index;
+            offsets.Data()[i] = sym ? addr - sym->addr : 0;
+            found += sym != nullptr;
+        }
+        return Napi::Number::New(env, found);
+    }
+
+    Napi::Value GetSymbol(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        auto index = GetNumber<uint32_t>(env, info[0]);
+        bool inCore = index < core.symbols.size();
+        const Table& table = inCore ? core : modules;
+        if (!inCore) index -= core.symbols.size();
+        if (index >= table.symbols.size())
+            throw Napi::RangeError::New(env, "Invalid symbol index");
+        const Symbol& sym = table.symbols[index];
+        auto ret = Napi::Array::New(env);
+        ret[0U] = Napi::String::New(env, table.arena.c_str() + sym.name);
+        ret[1U] = Napi::BigInt::New(env, sym.addr);
+        if (sym.module != NONE)
+            ret[2U] = Napi::String::New(env, table.arena.c_str() + sym.module);
+        return ret;
+    }
+
+    Napi::Value GetCoreCount(const CallbackInfo& info) {
+        return Napi::Number::New(info.Env(), core.symbols.size());
+    }
+
+    Napi::Value GetCount(const CallbackInfo& info) {
+        return Napi::Number::New(info.Env(), core.symbols.size() + modules.symbols.size());
+    }
+};
+
+// Function symbols of an ELF file (from .symtab and .dynsym), sorted
+// by address, plus its build ID and loadable segments (to translate
+// file offsets, as found in /proc/<pid>/maps or build ID stack frames,
+// into symbol addresses). The file isn't kept open.
+class ElfSymbols : public Napi::ObjectWrap<ElfSymbols> {
+  public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports) {
+        Napi::Function func = DefineClass(env, "ElfSymbols", {
+            InstanceMethod<&ElfSymbols::Load>("load"),
+            InstanceMethod<&ElfSymbols::Resolve>("resolve"),
+            InstanceMethod<&ElfSymbols::GetSymbol>("getSymbol"),
+            InstanceMethod<&ElfSymbols::FindSymbol>("findSymbol"),
+            InstanceAccessor("buildId", &ElfSymbols::GetBuildId, nullptr),
+            InstanceAccessor("count", &ElfSymbols::GetCount, nullptr),
+        });
+        exports["ElfSymbols"] = func;
+        return exports;
+    }
+
+    ElfSymbols(const CallbackInfo& info) : Napi::ObjectWrap<ElfSymbols>(info) {}
+
+  private:
+    struct Symbol {
+        uint64_t addr;
+        uint32_t size;
+        uint32_t name; // offset into the arena
+    };
+    struct Segment {
+        uint64_t vaddr;
+        uint64_t offset;
+        uint64_t size;
+    };
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    std::vector<Symbol> symbols;
+    std::vector<Segment> segments;
+    std::string arena;
+    std::string buildId;
+
+    void ReadSymbols(Elf* elf, Elf_Scn* scn, const GElf_Shdr& shdr) {
+        Elf_Data* data = elf_getdata(scn, nullptr);
+        if (data == nullptr || shdr.sh_entsize == 0)
+            return;
+        size_t count = shdr.sh_size / shdr.sh_entsize;
+        for (size_t i = 0; i < count; i++) {
+            GElf_Sym sym;
+            if (gelf_getsym(data, i, &sym) == nullptr)
+                continue;
+            int type = GELF_ST_TYPE(sym.st_info);
+            if ((type != STT_FUNC && type != STT_GNU_IFUNC) || !sym.st_value || sym.st_shndx == SHN_UNDEF)
+                continue;
+            const char* name = elf_strptr(elf, shdr.sh_link, sym.st_name);
+            if (name == nullptr || !*name)
+                continue;
+            uint32_t offset = arena.size();
+            arena.append(name);
+            arena.push_back('\0');
+            uint32_t size = std::min<uint64_t>(sym.st_size, UINT32_MAX);
+            symbols.push_back({ sym.st_value, size, offset });
+        }
+    }
+
+    void ReadBuildId(Elf_Scn* scn) {
+        Elf_Data* data = elf_getdata(scn, nullptr);
+        if (data == nullptr)
+            return;
+        GElf_Nhdr nhdr;
+        size_t offset = 0, name_offset, desc_offset;
+        while ((offset = gelf_getnote(data, offset, &nhdr, &name_offset, &desc_offset)) > 0) {
+            if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == sizeof(ELF_NOTE_GNU) &&
+                    !memcmp((char*) data->d_buf + name_offset, ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU))) {
+                buildId.assign((char*) data->d_buf + desc_offset, nhdr.n_descsz);
+                return;
+            }
+        }
+    }
+
+    int Parse(Elf* elf) {
+        if (elf_kind(elf) != ELF_K_ELF) {
+            errno = ENOEXEC;
+            return -1;
+        }
+        size_t phnum;
+        if (elf_getphdrnum(elf, &phnum) == 0) {
+            for (size_t i = 0; i < phnum; i++) {
+                GElf_Phdr phdr;
+                if (gelf_getphdr(elf, i, &phdr) && phdr.p_type == PT_LOAD)
+                    segments.push_back({ phdr.p_vaddr, phdr.p_offset, phdr.p_filesz });
+            }
+        }
+        // .symtab is read first, so its names win for duplicate addresses
+        for (Elf64_Word wanted : { SHT_SYMTAB, SHT_DYNSYM, SHT_NOTE }) {
+            Elf_Scn* scn = nullptr;
+            while ((scn = elf_nextscn(elf, scn)) != nullptr) {
+                GElf_Shdr shdr;
+                if (gelf_getshdr(scn, &shdr) == nullptr || shdr.sh_type != wanted)
+                    continue;
+                if (wanted == SHT_NOTE)
+                    ReadBuildId(scn);
+                else
+                    ReadSymbols(elf, scn, shdr);
+            }
+        }
+        std::stable_sort(symbols.begin(), symbols.end(),
+            [](const Symbol& a, const Symbol& b) { return a.addr < b.addr; });
+        symbols.erase(std::unique(symbols.begin(), symbols.end(),
+            [](const Symbol& a, const Symbol& b) { return a.addr == b.addr; }), symbols.end());
+        return 0;
+    }
+
+    Napi::Value Load(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        auto path = GetString(env, info[0]);
+        if (!arena.empty() || !symbols.empty())
+            throw Napi::Error::New(env, "ELF was already loaded");
+        elf_version(EV_CURRENT);
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return ToStatus(env, fd);
+        Elf* elf = elf_begin(fd, ELF_C_READ_MMAP, nullptr);
+        int status = -1;
+        if (elf == nullptr)
+            errno = ENOEXEC;
+        else
+            status = Parse(elf);
+        int err = errno;
+        elf_end(elf);
+        close(fd);
+        errno = err;
+        return ToStatus(env, status);
+    }
+
+    // Translates file offsets to addresses, then finds the symbol
+    // containing each one (symbols without a size extend up
+    // to the next symbol)
+    Napi::Value Resolve(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        size_t a = 0;
+        Napi::TypedArrayOf<uint64_t> fileOffsets (env, info[a++]);
+        auto count = GetNumber<uint32_t>(env, info[a++]);
+        Napi::TypedArrayOf<uint32_t> indexes (env, info[a++]);
+        Napi::TypedArrayOf<uint64_t> offsets (env, info[a++]);
+        if (count > fileOffsets.ElementLength() || count > indexes.ElementLength() || count > offsets.ElementLength())
+            throw Napi::RangeError::New(env, "Count exceeds array length");
+
+        uint32_t found = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t off = fileOffsets.Data()[i];
+            indexes.Data()[i] = NONE;
+            offsets.Data()[i] = 0;
+            auto seg = std::find_if(segments.begin(), segments.end(),
+                [off](const Segment& s) { return off >= s.offset && off - s.offset < s.size; });
+            if (seg == segments.end())
+                continue;
+            uint64_t addr = seg->vaddr + (off - seg->offset);
+            auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+                [](uint64_t addr, const Symbol& s) { return addr < s.addr; });
+            if (it == symbols.begin())
+                continue;
+            --it;
+            if (it->size && addr - it->addr >= it->size)
+                continue;
+            indexes.Data()[i] = it - symbols.begin();
+            offsets.Data()[i] = addr - it->addr;
+            found++;
+        }
+        return Napi::Number::New(env, found);
+    }
+
+    Napi::Value GetSymbol(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        auto index = GetNumber<uint32_t>(env, info[0]);
+        if (index >= symbols.size())
+            throw Napi::RangeError::New(env, "Invalid symbol index");
+        const Symbol& sym = symbols[index];
+        auto ret = Napi::Array::New(env);
+        ret[0U] = Napi::String::New(env, arena.c_str() + sym.name);
+        ret[1U] = Napi::BigInt::New(env, sym.addr);
+        ret[2U] = Napi::Number::New(env, sym.size);
+        return ret;
+    }
+
+    // Returns the address and file offset of a symbol, by name
+    Napi::Value FindSymbol(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        auto name = GetString(env, info[0]);
+        for (const Symbol& sym : symbols) {
+            if (name != arena.c_str() + sym.name)
+                continue;
+            auto seg = std::find_if(segments.begin(), segments.end(),
+                [&sym](const Segment& s) { return sym.addr >= s.vaddr && sym.addr - s.vaddr < s.size; });
+            if (seg == segments.end())
+                break;
+            auto ret = Napi::Array::New(env);
+            ret[0U] = Napi::BigInt::New(env, sym.addr);
+            ret[1U] = Napi::Number::New(env, seg->offset + (sym.addr - seg->vaddr));
+            return ret;
+        }
+        return env.Undefined();
+    }
+
+    Napi::Value GetBuildId(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        if (buildId.empty())
+            return env.Undefined();
+        return Napi::Buffer<char>::Copy(env, buildId.data(), buildId.size());
+    }
+
+    Napi::Value GetCount(const CallbackInfo& info) {
+        return Napi::Number::New(info.Env(), symbols.size());
+    }
+};
+
+// Reads the USDT probes of an ELF file (.note.stapsdt). Returns
+// [status, probes], each probe being [provider, name, address, file
+// offset, semaphore address, semaphore file offset, argument specs].
+// Addresses are adjusted for prelinking through .stapsdt.base, and
+// translated into file offsets (to attach uprobes) through the
+// loadable segments. A semaphore offset of 0 means there's none.
+Napi::Value ReadUsdtNotes(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    auto path = GetString(env, info[0]);
+    elf_version(EV_CURRENT);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        auto ret = Napi::Array::New(env);
+        ret[0U] = ToStatus(env, fd);
+        return ret;
+    }
+    Elf* elf = elf_begin(fd, ELF_C_READ_MMAP, nullptr);
+    auto probes = Napi::Array::New(env);
+    int status = 0;
+    size_t shstrndx;
+    if (elf == nullptr || elf_kind(elf) != ELF_K_ELF || elf_getshdrstrndx(elf, &shstrndx)) {
+        status = -ENOEXEC;
+    } else {
+        bool is64 = gelf_getclass(elf) == ELFCLASS64;
+        struct Segment { uint64_t vaddr, offset, size; };
+        std::vector<Segment> segments;
+        size_t phnum;
+        if (elf_getphdrnum(elf, &phnum) == 0) {
+            for (size_t i = 0; i < phnum; i++) {
+                GElf_Phdr phdr;
+                if (gelf_getphdr(elf, i, &phdr) && phdr.p_type == PT_LOAD)
+                    segments.push_back({ phdr.p_vaddr, phdr.p_offset, phdr.p_filesz });
+            }
+        }
+        auto toOffset = [&segments](uint64_t addr) -> uint64_t {
+            for (auto& seg : segments)
+                if (addr >= seg.vaddr && addr - seg.vaddr < seg.size)
+                    return seg.offset + (addr - seg.vaddr);
+            return 0;
+        };
+
+        Elf_Scn* notes = nullptr;
+        uint64_t base_addr = 0;
+        bool has_base = false;
+        Elf_Scn* scn = nullptr;
+        while ((scn = elf_nextscn(elf, scn)) != nullptr) {
+            GElf_Shdr shdr;
+            const char* name;
+            if (gelf_getshdr(scn, &shdr) == nullptr ||
+                    (name = elf_strptr(elf, shstrndx, shdr.sh_name)) == nullptr)
+                continue;
+            if (shdr.sh_type == SHT_NOTE && !strcmp(name, ".note.stapsdt"))
+                notes = scn;
+            else if (!strcmp(name, ".stapsdt.base"))
+                base_addr = shdr.sh_addr, has_base = true;
+        }
+
+        Elf_Data* data = notes ? elf_getdata(notes, nullptr) : nullptr;
+        GElf_Nhdr nhdr;
+        size_t offset = 0, name_offset, desc_offset;
+        uint32_t n = 0;
+        size_t addr_size = is64 ? 8 : 4;
+        while (data && (offset = gelf_getnote(data, offset, &nhdr, &name_offset, &desc_offset)) > 0) {
+            const char* desc = (const char*) data->d_buf + desc_offset;
+            if (nhdr.n_type != 3 || nhdr.n_namesz != sizeof("stapsdt") ||
+                    memcmp((char*) data->d_buf + name_offset, "stapsdt", sizeof("stapsdt")) ||
+                    nhdr.n_descsz < 3 * addr_size || desc[nhdr.n_descsz - 1] != '\0')
+                continue;
+            uint64_t addrs [3] = {};
+            for (int i = 0; i < 3; i++) {
+                if (is64) {
+                    memcpy(&addrs[i], desc + i * addr_size, addr_size);
+                } else {
+                    uint32_t addr;
+                    memcpy(&addr, desc + i * addr_size, addr_size);
+                    addrs[i] = addr;
+                }
+            }
+            uint64_t pc = addrs[0], sem = addrs[2];
+            if (has_base)
+                pc += base_addr - addrs[1];
+            const char* provider = desc + 3 * addr_size;
+            const char* end = desc + nhdr.n_descsz;
+            const char* name = provider + strnlen(provider, end - provider) + 1;
+            if (name >= end)
+                continue;
+            const char* args = name + strnlen(name, end - name) + 1;
+            auto probe = Napi::Array::New(env);
+            probe[0U] = Napi::String::New(env, provider);
+            probe[1U] = Napi::String::New(env, name);
+            probe[2U] = Napi::BigInt::New(env, pc);
+            probe[3U] = Napi::Number::New(env, toOffset(pc));
+            probe[4U] = Napi::BigInt::New(env, sem);
+            probe[5U] = Napi::Number::New(env, sem ? toOffset(sem) : 0);
+            probe[6U] = Napi::String::New(env, args < end ? args : "");
+            probes[n++] = probe;
+        }
+    }
+    elf_end(elf);
+    close(fd);
+    auto ret = Napi::Array::New(env);
+    ret[0U] = Napi::Number::New(env, status);
+    ret[1U] = probes;
+    return ret;
+}
+
+// Reads all entries of a map, through batched syscalls if supported
+// (Linux 5.6), optionally deleting them. Without batching, entries
+// are deleted after iterating (deleting while iterating restarts it).
+int ReadAllEntries(int fd, uint32_t key_size, uint32_t value_size, bool del,
+        std::vector<uint8_t>& keys, std::vector<uint8_t>& values) {
+    bpf_map_batch_opts opts {};
+    opts.sz = sizeof(opts);
+    uint64_t in_batch = 0, out_batch = 0;
+    uint32_t batch_size = 1024;
+    size_t n = 0;
+    for (bool first = true;; first = false) {
+        keys.resize((n + batch_size) * key_size);
+        values.resize((n + batch_size) * value_size);
+        uint32_t count = batch_size;
+        int ret = (del ? bpf_map_lookup_and_delete_batch : bpf_map_lookup_batch)(fd,
+            first ? nullptr : &in_batch, &out_batch, keys.data() + n * key_size,
+            values.data() + n * value_size, &count, &opts);
+        int err = ret ? errno : 0;
+        if (err && err != ENOENT && err != ENOSPC) {
+            if (first && (err == EINVAL || err == EOPNOTSUPP || err == 524 /* ENOTSUPP */))
+                break;
+            return -err;
+        }
+        n += count;
+        if (err == ENOENT) {
+            keys.resize(n * key_size);
+            values.resize(n * value_size);
+            return 0;
+        }
+        // a hash bucket didn't fit, retry with a bigger batch
+        if (err == ENOSPC && !count)
+            batch_size *= 2;
+        in_batch = out_batch;
+    }
+
+    keys.clear();
+    values.clear();
+    std::vector<uint8_t> key (key_size), value (value_size);
+    bool has_key = false;
+    while (bpf_map_get_next_key(fd, has_key ? key.data() : nullptr, key.data()) == 0) {
+        has_key = true;
+        if (bpf_map_lookup_elem(fd, key.data(), value.data()))
+            continue;
+        keys.insert(keys.end(), key.begin(), key.end());
+        values.insert(values.end(), value.begin(), value.end());
+    }
+    if (errno != ENOENT)
+        return -errno;
+    for (size_t i = 0; del && i < keys.size(); i += key_size)
+        bpf_map_delete_elem(fd, keys.data() + i);
+    return 0;
+}
+
+// Folds the stacks counted in a map keyed by (tgid, kernel stack ID,
+// user stack ID), as built by the profiling programs, into the format
+// used by flame graph tools: "pid;user frames;kernel frames value".
+// Frames go from outermost to innermost; kernel frames are symbolized
+// if a Kallsyms instance is passed, user frames are always addresses.
+Napi::Value FoldStackCounts(const CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    size_t a = 0;
+    auto counts_fd = GetNumber<int>(env, info[a++]);
+    auto stacks_fd = GetNumber<int>(env, info[a++]);
+    auto stack_size = GetNumber<uint32_t>(env, info[a++]);
+    auto del = GetBoolean(env, info[a++]);
+    const Kallsyms* kallsyms = info[a].IsUndefined() ? nullptr : Kallsyms::Unwrap(info[a].As<Napi::Object>()); a++;
+
+    const uint32_t key_size = 16, value_size = 8;
+    std::vector<uint8_t> keys, values;
+    int status = ReadAllEntries(counts_fd, key_size, value_size, del, keys, values);
+    auto ret = Napi::Array::New(env);
+    ret[0U] = Napi::Number::New(env, status);
+    if (status)
+        return ret;
+
+    // stack ID -> frames (innermost first), empty if it was lost
+    std::unordered_map<int32_t, std::vector<uint64_t>> stacks;
+    std::vector<uint64_t> buffer (stack_size / sizeof(uint64_t));
+    auto getStack = [&](int32_t id) -> const std::vector<uint64_t>& {
+        auto it = stacks.find(id);
+        if (it != stacks.end())
+            return it->second;
+        auto& frames = stacks[id];
+        if (!bpf_map_lookup_elem(stacks_fd, &id, buffer.data()))
+            for (uint64_t ip : buffer) {
+                if (!ip) break;
+                frames.push_back(ip);
+            }
+        return frames;
+    };
+    auto appendHex = [](std::string& out, uint64_t x) {
+        char buf[20];
+        snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long) x);
+        out += buf;
+    };
+
+    std::map<std::string, uint64_t> folded;
+    std::string line;
+    for (size_t i = 0; i * key_size < keys.size(); i++) {
+        const uint8_t* key = keys.data() + i * key_size;
+        uint32_t tgid = *(uint32_t*) key;
+        int32_t kernel_id = *(int32_t*) (key + 4);
+        int32_t user_id = *(int32_t*) (key + 8);
+        line = std::to_string(tgid);
+        if (user_id >= 0) {
+            auto& frames = getStack(user_id);
+            if (frames.empty()) line += ";[lost]";
+            for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+                line += ';';
+                appendHex(line, *it);
+            }
+        }
+        if (kernel_id >= 0) {
+            auto& frames = getStack(kernel_id);
+            if (frames.empty()) line += ";[lost]";
+            for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+                line += ';';
+                if (!kallsyms || !kallsyms->Symbolize(*it, line))
+                    appendHex(line, *it);
+            }
+        }
+        folded[line] += *(uint64_t*) (values.data() + i * value_size);
+    }
+    if (del)
+        for (auto& item : stacks)
+            bpf_map_delete_elem(stacks_fd, &item.first);
+
+    std::string out;
+    for (auto& item : folded) {
+        out += item.first;
+        out += ' ';
+        out += std::to_string(item.second);
+        out += '\n';
+    }
+    ret[1U] = Napi::String::New(env, out);
+    return ret;
+}
+
+// BTF
+
+// Parsed BTF blob (e.g. the vmlinux one), through libbpf. Loading costs
+// a read and a single pass over the types (done by btf__new, which keeps
+// its own copy of the data); the name index is built on the first lookup
+// by name, and types are converted to JS values only when asked for.
+class Btf : public Napi::ObjectWrap<Btf> {
+  public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports) {
+        Napi::Function func = DefineClass(env, "Btf", {
+            InstanceMethod<&Btf::Load>("load"),
+            InstanceMethod<&Btf::LoadFromId>("loadFromId"),
+            InstanceMethod<&Btf::DumpC>("dumpC"),
+            InstanceMethod<&Btf::Find>("find"),
+            InstanceMethod<&Btf::GetType>("getType"),
+            InstanceMethod<&Btf::ResolveSize>("resolveSize"),
+            InstanceMethod<&Btf::ResolveType>("resolveType"),
+            InstanceAccessor("count", &Btf::GetCount, nullptr),
+        });
+        exports["Btf"] = func;
+        return exports;
+    }
+
+    Btf(const CallbackInfo& info) : Napi::ObjectWrap<Btf>(info) {}
+
+    ~Btf() {
+        btf__free(btf);
+    }
+
+  private:
+    struct CStrHash {
+        size_t operator()(const char* s) const {
+            size_t h = 14695981039346656037ULL; // FNV-1a
+            for (; *s; s++)
+                h = (h ^ (unsigned char) *s) * 1099511628211ULL;
+            return h;
+        }
+    };
+    struct CStrEq {
+        bool operator()(const char* a, const char* b) const { return !strcmp(a, b); }
+    };
+
+    struct btf* btf = nullptr;
+    // names point into the BTF string section, which outlives the index
+    std::unordered_multimap<const char*, uint32_t, CStrHash, CStrEq> index;
+    bool indexed = false;
+
+    void CheckLoaded(Napi::Env env) {
+        if (btf == nullptr)
+            throw Napi::Error::New(env, "BTF isn't loaded");
+    }
+
+    const btf_type* CheckType(Napi::Env env, Napi::Value value) {
+        CheckLoaded(env);
+        auto id = GetNumber<uint32_t>(env, value);
+        if (id > btf__get_nr_types(btf))
+            throw Napi::RangeError::New(env, "Invalid type ID");
+        return btf__type_by_id(btf, id);
+    }
+
+    // Raw BTF files are read and handed to btf__new (which copies them, so
+    // the buffer is only needed during the call); ELF files are parsed by libbpf
+    Napi::Value Load(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        auto path = GetString(env, info[0]);
+        if (btf != nullptr)
+            throw Napi::Error::New(env, "BTF was already loaded");
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return ToStatus(env, fd);
+        struct stat st;
+        // sysfs may report a wrong size, so read until EOF anyway
+        std::vector<char> buf (fstat(fd, &st) == 0 && st.st_size > 0 ? st.st_size + 1 : 1 << 20);
+        size_t size = 0;
+        ssize_t n;
+        while ((n = read(fd, buf.data() + size, buf.size() - size)) > 0)
+            if ((size += n) == buf.size())
+                buf.resize(buf.size() * 2);
+        int err = errno;
+        close(fd);
+        if (n < 0)
+            return Napi::Number::New(env, -err);
+        struct btf* ret;
+        if (size >= SELFMAG && !memcmp(buf.data(), ELFMAG, SELFMAG))
+            ret = btf__parse_elf(path.c_str(), nullptr);
+        else
+            ret = btf__new(buf.data(), size);
+        long status = libbpf_get_error(ret);
+        if (status)
+            return Napi::Number::New(env, status);
+        btf = ret;
+        return Napi::Number::New(env, 0);
+    }
+
+    // Loads a BTF object from the kernel (e.g. the one of a map or program)
+    Napi::Value LoadFromId(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        auto id = GetNumber<uint32_t>(env, info[0]);
+        if (btf != nullptr)
+            throw Napi::Error::New(env, "BTF was already loaded");
+        struct btf* ret = nullptr;
+        int err = btf__get_from_id(id, &ret);
+        if (err)
+            return Napi::Number::New(env, err < 0 ? err : -EINVAL);
+        if (ret == nullptr)
+            return Napi::Number::New(env, -ENOENT);
+        btf = ret;
+        return Napi::Number::New(env, 0);
+    }
+
+    static void DumpPrintf(void* ctx, const char* fmt, va_list args) {
+        std::string& out = *(std::string*) ctx;
+        va_list copy;
+        va_copy(copy, args);
+        int n = vsnprintf(nullptr, 0, fmt, copy);
+        va_end(copy);
+        if (n <= 0)
+            return;
+        size_t pos = out.size();
+        out.resize(pos + n + 1);
+        vsnprintf(&out[pos], n + 1, fmt, args);
+        out.resize(pos + n);
+    }
+
+    // Returns C declarations of a type and the types it depends on,
+    // through btf_dump, or [status] if it fails
+    Napi::Value DumpC(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckType(env, info[0]);
+        auto id = GetNumber<uint32_t>(env, info[0]);
+        std::string out;
+        btf_dump_opts opts {};
+        opts.ctx = &out;
+        btf_dump* d = btf_dump__new(btf, nullptr, &opts, DumpPrintf);
+        long err = libbpf_get_error(d);
+        if (!err) {
+            err = btf_dump__dump_type(d, id);
+            btf_dump__free(d);
+        }
+        if (err)
+            return Napi::Number::New(env, err);
+        return Napi::String::New(env, out);
+    }
+
+    // Returns the lowest ID of a type with the given name and kind
+    // (any kind if negative), or -ENOENT
+    Napi::Value Find(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        size_t a = 0;
+        auto name = GetString(env, info[a++]);
+        auto kind = GetNumber<int>(env, info[a++], -1);
+        CheckLoaded(env);
+        if (!indexed) {
+            uint32_t count = btf__get_nr_types(btf);
+            index.reserve(count);
+            for (uint32_t id = 1; id <= count; id++) {
+                const btf_type* t = btf__type_by_id(btf, id);
+                if (t->name_off)
+                    index.emplace(btf__name_by_offset(btf, t->name_off), id);
+            }
+            indexed = true;
+        }
+        int ret = -ENOENT;
+        auto range = index.equal_range(name.c_str());
+        for (auto it = range.first; it != range.second; ++it) {
+            if ((kind < 0 || btf_kind(btf__type_by_id(btf, it->second)) == kind) &&
+                    (ret < 0 || it->second < (uint32_t) ret))
+                ret = it->second;
+        }
+        return Napi::Number::New(env, ret);
+    }
+
+    // Returns [kind, name, size or type, kind_flag, details], where
+    // details depends on the kind (see lib/btf.ts)
+    Napi::Value GetType(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        const btf_type* t = CheckType(env, info[0]);
+        uint16_t kind = btf_kind(t), vlen = btf_vlen(t);
+        auto name = [this, &env](uint32_t off) {
+            return Napi::String::New(env, btf__name_by_offset(btf, off));
+        };
+        auto tuple = [&env](std::initializer_list<Napi::Value> values) {
+            auto ret = Napi::Array::New(env);
+            uint32_t i = 0;
+            for (auto& v : values)
+                ret[i++] = v;
+            return ret;
+        };
+        auto num = [&env](double v) { return Napi::Number::New(env, v); };
+
+        Napi::Value details = env.Undefined();
+        auto items = Napi::Array::New(env);
+        switch (kind) {
+        case BTF_KIND_INT:
+            details = tuple({ num(btf_int_encoding(t)), num(btf_int_offset(t)), num(btf_int_bits(t)) });
+            break;
+        case BTF_KIND_ARRAY: {
+            const struct btf_array* arr = btf_array(t);
+            details = tuple({ num(arr->type), num(arr->index_type), num(arr->nelems) });
+            break;
+        }
+        case BTF_KIND_STRUCT:
+        case BTF_KIND_UNION: {
+            const struct btf_member* m = btf_members(t);
+            for (uint32_t i = 0; i < vlen; i++, m++)
+                items[i] = tuple({ name(m->name_off), num(m->type),
+                    num(btf_member_bit_offset(t, i)), num(btf_member_bitfield_size(t, i)) });
+            details = items;
+            break;
+        }
+        case BTF_KIND_ENUM: {
+            const struct btf_enum* e = btf_enum(t);
+            for (uint32_t i = 0; i < vlen; i++, e++)
+                items[i] = tuple({ name(e->name_off), num(e->val) });
+            details = items;
+            break;
+        }
+        case BTF_KIND_FUNC_PROTO: {
+            const struct btf_param* p = btf_params(t);
+            for (uint32_t i = 0; i < vlen; i++, p++)
+                items[i] = tuple({ name(p->name_off), num(p->type) });
+            details = items;
+            break;
+        }
+        case BTF_KIND_FUNC:
+            details = num(vlen); // linkage
+            break;
+        case BTF_KIND_VAR:
+            details = num(btf_var(t)->linkage);
+            break;
+        case BTF_KIND_DATASEC: {
+            const struct btf_var_secinfo* v = btf_var_secinfos(t);
+            for (uint32_t i = 0; i < vlen; i++, v++)
+                items[i] = tuple({ num(v->type), num(v->offset), num(v->size) });
+            details = items;
+            break;
+        }
+        }
+        return tuple({ num(kind), name(t->name_off), num(t->size), Napi::Boolean::New(env, btf_kflag(t)), details });
+    }
+
+    Napi::Value ResolveSize(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckType(env, info[0]);
+        return Napi::Number::New(env, btf__resolve_size(btf, GetNumber<uint32_t>(env, info[0])));
+    }
+
+    Napi::Value ResolveType(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        CheckType(env, info[0]);
+        return Napi::Number::New(env, btf__resolve_type(btf, GetNumber<uint32_t>(env, info[0])));
+    }
+
+    Napi::Value GetCount(const CallbackInfo& info) {
+        Napi::Env env = info.Env();
+        return Napi::Number::New(env, btf ? btf__get_nr_types(btf) : 0);
+    }
+};
+
+#define EXPOSE_FUNCTION(NAME, METHOD) exports.Set(NAME, Napi::Function::New(env, METHOD, NAME))
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    auto versions = Napi::Object::New(env);
+    // Keep synchronized with deps
+    versions["libelf"] = Napi::String::New(env, "0.185");
+    versions["libbpf"] = Napi::String::New(env, "0.4.0");
+    versions["btf"] = Napi::Number::New(env, BTF_VERSION);
+    utsname kernel_info;
+    if (!uname(&kernel_info))
+        versions["kernel"] = Napi::String::New(env, kernel_info.release);
+    exports["versions"] = versions;
+
+    FDRef::Init(env, exports);
+    XskSocket::Init(env, exports);
+    Kallsyms::Init(env, exports);
+    ElfSymbols::Init(env, exports);
+    Btf::Init(env, exports);
+    EXPOSE_FUNCTION("dup", Dup);
+    EXPOSE_FUNCTION("numPossibleCpus", NumPossibleCpus);
+
+    EXPOSE_FUNCTION("mapUpdateElem", MapUpdateElem);
+    EXPOSE_FUNCTION("mapLookupElem", MapLookupElem);
+    EXPOSE_FUNCTION("mapLookupAndDeleteElem", MapLookupAndDeleteElem);
+    EXPOSE_FUNCTION("mapDeleteElem", MapDeleteElem);
+    EXPOSE_FUNCTION("mapGetNextKey", MapGetNextKey);
+    EXPOSE_FUNCTION("mapFreeze", MapFreeze);
+    EXPOSE_FUNCTION("mapDeleteBatch", MapDeleteBatch);
+    EXPOSE_FUNCTION("mapLookupBatch", MapLookupBatch);
+    EXPOSE_FUNCTION("mapLookupAndDeleteBatch", MapLookupAndDeleteBatch);
+    EXPOSE_FUNCTION("mapUpdateBatch", MapUpdateBatch);
+    EXPOSE_FUNCTION("stackMapLookupBatch", StackMapLookupBatch);
+    EXPOSE_FUNCTION("foldStackCounts", FoldStackCounts);
+    EXPOSE_FUNCTION("createMap", CreateMap);
+    EXPOSE_FUNCTION("getMapInfo", GetMapInfo);
+    EXPOSE_FUNCTION("mapGetFdById", MapGetFdById);
+    EXPOSE_FUNCTION("bpfObjPin", BpfObjPin);
+    EXPOSE_FUNCTION("bpfObjGet", BpfObjGet);
+
+    EXPOSE_FUNCTION("loadProgram", LoadProgram);
+    EXPOSE_FUNCTION("getProgInfo", GetProgInfo);
+    EXPOSE_FUNCTION("progGetFdById", ProgGetFdById);
+    EXPOSE_FUNCTION("getProgMapIds", GetProgMapIds);
+
+    EXPOSE_FUNCTION("perfEventOpenProbe", PerfEventOpenProbe);
+    EXPOSE_FUNCTION("perfEventOpenTracepoint", PerfEventOpenTracepoint);
+    EXPOSE_FUNCTION("perfEventOpen", PerfEventOpen);
+    EXPOSE_FUNCTION("readUsdtNotes", ReadUsdtNotes);
+    EXPOSE_FUNCTION("perfEventAttach", PerfEventAttach);
+    EXPOSE_FUNCTION("rawTracepointOpen", RawTracepointOpen);
+
+    EXPOSE_FUNCTION("progAttach", ProgAttach);
+    EXPOSE_FUNCTION("progDetach", ProgDetach);
+    EXPOSE_FUNCTION("progQuery", ProgQuery);
+
+    EXPOSE_FUNCTION("linkCreate", LinkCreate);
+    EXPOSE_FUNCTION("linkUpdate", LinkUpdate);
+    EXPOSE_FUNCTION("getLinkInfo", GetLinkInfo);
+    EXPOSE_FUNCTION("iterCreate", IterCreate);
+    EXPOSE_FUNCTION("findVmlinuxBtfId", FindVmlinuxBtfId);
+    EXPOSE_FUNCTION("loadBtf", LoadBtf);
+    EXPOSE_FUNCTION("loadObject", LoadObject);
+
+    EXPOSE_FUNCTION("ifNameToIndex", IfNameToIndex);
+    EXPOSE_FUNCTION("setNetns", SetNetns);
+    EXPOSE_FUNCTION("setLinkXdpFd", SetLinkXdpFd);
+    EXPOSE_FUNCTION("getLinkXdpInfo", GetLinkXdpInfo);
+    EXPOSE_FUNCTION("tcHookCreate", TcHookCreate);
+    EXPOSE_FUNCTION("tcHookDestroy", TcHookDestroy);
+    EXPOSE_FUNCTION("tcAttach", TcAttach);
+    EXPOSE_FUNCTION("tcDetach", TcDetach);
+    EXPOSE_FUNCTION("tcQuery", TcQuery);
+
+    EXPOSE_FUNCTION("attachSocketFilter", AttachSocketFilter);
+    EXPOSE_FUNCTION("detachSocketFilter", DetachSocketFilter);
+    EXPOSE_FUNCTION("attachReuseportProgram", AttachReuseportProgram);
+    EXPOSE_FUNCTION("detachReuseportProgram", DetachReuseportProgram);
+    EXPOSE_FUNCTION("bindReuseport", BindReuseport);
 
     return exports;
 }
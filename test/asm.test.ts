@@ -0,0 +1,41 @@
+import { Assembler, Reg, Size, JmpOp, AluOp, Helper } from '../lib'
+import { returnConstant } from './util'
+
+describe('assembler', () => {
+
+    it('encodes instructions', () => {
+        expect(new Assembler().movImm(Reg.R0, 42).exit().build())
+            .toStrictEqual(returnConstant(42))
+        expect(new Assembler().movImm(Reg.R0, -1).build().toString('hex'))
+            .toBe('b7000000ffffffff')
+        expect(new Assembler().ldxMem(Size.W, Reg.R0, Reg.R1, 4).build().toString('hex'))
+            .toBe('6110040000000000')
+        expect(new Assembler().stxMem(Size.DW, Reg.R10, Reg.R1, -8).build().toString('hex'))
+            .toBe('7b1af8ff00000000')
+        expect(new Assembler().aluImm(AluOp.ADD, Reg.R2, -4).build().toString('hex'))
+            .toBe('07020000fcffffff')
+        expect(new Assembler().call(Helper.MAP_LOOKUP_ELEM).build().toString('hex'))
+            .toBe('8500000001000000')
+        expect(new Assembler().ldMapFd(Reg.R1, 5).build().toString('hex'))
+            .toBe('18110000050000000000000000000000')
+        expect(new Assembler().ldImm64(Reg.R3, BigInt('0x1122334455667788')).build().toString('hex'))
+            .toBe('18030000887766550000000044332211')
+    })
+
+    it('resolves labels', () => {
+        const asm = new Assembler()
+            .jmpImm(JmpOp.JEQ, Reg.R1, 0, 'out')
+            .ldImm64(Reg.R0, BigInt(1))
+            .label('out')
+            .ja('out')
+            .exit()
+        expect(asm.length).toBe(5)
+        const insns = asm.build()
+        expect(insns.readInt16LE(2)).toBe(2)
+        expect(insns.readInt16LE(3 * 8 + 2)).toBe(-1)
+
+        expect(() => new Assembler().ja('missing').build()).toThrow()
+        expect(() => new Assembler().label('a').label('a')).toThrow()
+    })
+
+})
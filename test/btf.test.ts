@@ -0,0 +1,64 @@
+import { mkdtempSync, writeFileSync, rmdirSync, existsSync } from 'fs'
+import { tmpdir } from 'os'
+import { join } from 'path'
+import { Btf, BtfKind, BtfIntEncoding, VMLINUX_BTF_PATH } from '../lib'
+import { conditionalTest, testBtf } from './util'
+
+describe('BTF tests', () => {
+    let dir: string
+    let btf: Btf
+    beforeEach(() => {
+        dir = mkdtempSync(join(tmpdir(), 'nbpf-'))
+        writeFileSync(join(dir, 'test.btf'), testBtf)
+        btf = new Btf(join(dir, 'test.btf'))
+    })
+    afterEach(() => rmdirSync(dir, { recursive: true }))
+
+    it('finds and describes types', () => {
+        expect(btf.length).toBe(5)
+        expect(btf.findType('s')).toBe(3)
+        expect(btf.findType('s', BtfKind.UNION)).toBeUndefined()
+        expect(btf.findType('nonexistent')).toBeUndefined()
+        expect(btf.getType(1)).toStrictEqual({
+            id: 1, kind: BtfKind.INT, name: 'int', size: 4,
+            int: { encoding: BtfIntEncoding.SIGNED, offset: 0, bits: 32 },
+        })
+        expect(btf.getType(4)).toStrictEqual({ id: 4, kind: BtfKind.TYPEDEF, name: 's_t', type: 3 })
+        expect(btf.getType(3).members![1]).toStrictEqual({ name: 'b', type: 1, bitOffset: 32, bitSize: 3 })
+        expect(btf.resolveType(4)).toBe(3)
+        expect(btf.sizeOf(4)).toBe(12)
+        expect(() => btf.getType(6)).toThrow(RangeError)
+    })
+
+    it('resolves struct layouts', () => {
+        const layout = btf.structLayout(4)
+        expect(layout).toBe(btf.structLayout('s'))
+        expect(layout.size).toBe(12)
+        expect(layout.fields.map(x => [ x.name, x.offset, x.size, x.bitOffset, x.bitSize ])).toStrictEqual([
+            [ 'a', 0, 4, 0, 0 ],
+            [ 'b', 4, 4, 32, 3 ],
+            [ 'c', 8, 4, 64, 0 ],
+        ])
+        const field = btf.fieldLayout('t', 'inner.c')
+        expect([ field.name, field.offset, field.size ]).toStrictEqual([ 'inner.c', 12, 4 ])
+        expect(btf.fieldLayout('t', 'inner.b').bitOffset).toBe(64)
+        expect(() => btf.fieldLayout('t', 'inner.d')).toThrow()
+        expect(() => btf.structLayout(1)).toThrow()
+    })
+
+    it('rejects invalid files', () => {
+        writeFileSync(join(dir, 'bad.btf'), Buffer.from('not BTF'))
+        expect(() => new Btf(join(dir, 'bad.btf'))).toThrow()
+        expect(() => new Btf(join(dir, 'nonexistent'))).toThrow()
+    })
+
+    conditionalTest(existsSync(VMLINUX_BTF_PATH), 'loads vmlinux BTF', () => {
+        const vmlinux = Btf.vmlinux()
+        expect(Btf.vmlinux()).toBe(vmlinux)
+        expect(vmlinux.length).toBeGreaterThan(1000)
+        const pid = vmlinux.fieldLayout('task_struct', 'pid')
+        expect(pid.size).toBe(4)
+        expect(vmlinux.structLayout('task_struct').fields.length).toBeGreaterThan(10)
+    })
+
+})
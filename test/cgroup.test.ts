@@ -0,0 +1,72 @@
+import * as fs from 'fs'
+import { loadProgram, ProgramType, AttachType, AttachFlags, QueryFlags, attachCgroup, detachCgroup,
+    queryCgroup, attachCgroupLink, openProgram } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnConstant } from './util'
+
+const cgroupRoot = '/sys/fs/cgroup'
+const hasCgroup2 = (() => {
+    try {
+        return fs.existsSync(`${cgroupRoot}/cgroup.controllers`)
+    } catch (e) {
+        return false
+    }
+})()
+
+const withTestCgroup = async (fn: (path: string) => Promise<void> | void) => {
+    const path = fs.mkdtempSync(`${cgroupRoot}/node_bpf_test_`)
+    try {
+        await fn(path)
+    } finally {
+        fs.rmdirSync(path)
+    }
+}
+
+const skbProgram = (value: number) =>
+    loadProgram({ type: ProgramType.CGROUP_SKB, insns: returnConstant(value), license: 'GPL' })
+
+describe('cgroup tests', () => {
+
+    conditionalTest(isRoot && hasCgroup2 && kernelAtLeast('5.6'), 'attach, replace and detach', () => withTestCgroup(path => {
+        const type = AttachType.CGROUP_INET_EGRESS
+        const prog1 = skbProgram(1), prog2 = skbProgram(1), prog3 = skbProgram(1)
+        try {
+            expect(queryCgroup(path, type).progIds).toStrictEqual([])
+
+            attachCgroup(path, prog1, type, { flags: AttachFlags.ALLOW_MULTI })
+            attachCgroup(path, prog2, type, { flags: AttachFlags.ALLOW_MULTI })
+            let result = queryCgroup(path, type)
+            expect(result.attachFlags).toBe(AttachFlags.ALLOW_MULTI)
+            expect(result.progIds).toStrictEqual([ prog1.id, prog2.id ])
+            expect(queryCgroup(path, type, QueryFlags.EFFECTIVE).progIds).toContain(prog1.id)
+
+            attachCgroup(path, prog3, type, { flags: AttachFlags.ALLOW_MULTI, replace: prog1 })
+            expect(queryCgroup(path, type).progIds).toStrictEqual([ prog3.id, prog2.id ])
+            const opened = openProgram(prog3.id)
+            expect(opened.type).toBe(ProgramType.CGROUP_SKB)
+            opened.close()
+
+            detachCgroup(path, type, prog2)
+            detachCgroup(path, type, prog3)
+            expect(queryCgroup(path, type).progIds).toStrictEqual([])
+            expect(() => detachCgroup(path, type, prog3)).toThrow()
+        } finally {
+            prog1.close()
+            prog2.close()
+            prog3.close()
+        }
+    }))
+
+    conditionalTest(isRoot && hasCgroup2 && kernelAtLeast('5.7'), 'link attachment', () => withTestCgroup(path => {
+        const type = AttachType.CGROUP_INET_INGRESS
+        const prog = skbProgram(1)
+        try {
+            const link = attachCgroupLink(path, prog, type)
+            expect(queryCgroup(path, type).progIds).toStrictEqual([ prog.id ])
+            link.close()
+            expect(queryCgroup(path, type).progIds).toStrictEqual([])
+        } finally {
+            prog.close()
+        }
+    }))
+
+})
@@ -0,0 +1,78 @@
+import { mkdtempSync, writeFileSync, rmdirSync } from 'fs'
+import { tmpdir } from 'os'
+import { join } from 'path'
+import { transpileModule, ModuleKind, ScriptTarget } from 'typescript'
+import { Btf, generateTypeScript, generateMapTypeScript, loadBtf, createMap, MapType } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, testBtf } from './util'
+
+describe('codegen tests', () => {
+    let dir: string
+    let btf: Btf
+    beforeEach(() => {
+        dir = mkdtempSync(join(tmpdir(), 'nbpf-'))
+        writeFileSync(join(dir, 'test.btf'), testBtf)
+        btf = new Btf(join(dir, 'test.btf'))
+    })
+    afterEach(() => rmdirSync(dir, { recursive: true }))
+
+    it('generates declarations', () => {
+        const source = generateTypeScript(btf, [ 't' ], { declarations: true })
+        expect(source).toContain('export interface T {')
+        expect(source).toContain('export interface S {')
+        expect(source).toContain('    inner: S\n')
+        expect(source).toContain('export const T_SIZE = 16')
+        expect(source).toContain('parseS(buf, offset + 4)')
+        expect(source).toContain('struct s {')
+        expect(generateTypeScript(btf, [ 4 ])).not.toContain('```c')
+        expect(() => generateTypeScript(btf, [ 'int' ])).toThrow()
+    })
+
+    it('generates working codecs', () => {
+        const source = generateTypeScript(btf, [ 't' ])
+        const { outputText } = transpileModule(source, {
+            compilerOptions: { module: ModuleKind.CommonJS, target: ScriptTarget.ES2018 },
+        })
+        const exports: any = {}
+        new Function('exports', 'require', outputText)(exports, require)
+
+        const value = { x: 1, inner: { a: -2, b: -3, c: 7 } }
+        const buf = exports.formatT(value)
+        expect(buf.length).toBe(16)
+        expect(buf.readInt32LE(4)).toBe(-2)
+        expect(buf.readInt32LE(12)).toBe(7)
+        expect(exports.parseT(buf)).toStrictEqual(value)
+        expect(exports.parseS(buf, 4)).toStrictEqual(value.inner)
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.18'), 'generates declarations for maps', () => {
+        const loaded = loadBtf(testBtf)
+        const ref = createMap({
+            type: MapType.HASH,
+            keySize: 4,
+            valueSize: 16,
+            maxEntries: 4,
+            btf: loaded,
+            btfKeyTypeId: 1,
+            btfValueTypeId: 5,
+        })
+        loaded.close()
+        const plain = createMap({ type: MapType.HASH, keySize: 4, valueSize: 16, maxEntries: 4 })
+        try {
+            // BTF of the map, as loaded in the kernel
+            const btf = new Btf({ id: ref.btfId! })
+            expect(btf.path).toBeUndefined()
+            expect(btf.findType('t')).toBe(5)
+
+            // the key is a plain int, only the value gets declarations
+            const source = generateMapTypeScript(ref)
+            expect(source).toBe(generateTypeScript(btf, [ 5 ]))
+            expect(source).toContain('export interface T {')
+            expect(source).toContain('export interface S {')
+            expect(source).not.toContain('```c')
+            expect(() => generateMapTypeScript(plain)).toThrow('has no BTF')
+        } finally {
+            ref.close()
+            plain.close()
+        }
+    })
+})
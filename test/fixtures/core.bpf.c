@@ -0,0 +1,35 @@
+// Object used by test/object.test.ts, built with:
+//   clang -O2 -g -target bpf -c core.bpf.c -o core.bpf.o
+//
+// The socket filter keeps as many bytes of each packet as the offset
+// of task_struct.pid, as relocated (CO-RE) against the target BTF.
+
+struct bpf_map_def {
+    unsigned int type;
+    unsigned int key_size;
+    unsigned int value_size;
+    unsigned int max_entries;
+    unsigned int map_flags;
+};
+
+struct bpf_map_def hits __attribute__((section("maps"), used)) = {
+    .type = 2, // BPF_MAP_TYPE_ARRAY
+    .key_size = 4,
+    .value_size = 8,
+    .max_entries = 1,
+};
+
+struct task_struct {
+    int pid;
+} __attribute__((preserve_access_index));
+
+struct __sk_buff;
+
+__attribute__((section("socket"), used))
+int core_offset(struct __sk_buff *skb)
+{
+    struct task_struct *task = 0;
+    return __builtin_preserve_field_info(task->pid, 0 /* BPF_FIELD_BYTE_OFFSET */);
+}
+
+char _license[] __attribute__((section("license"), used)) = "GPL";
@@ -0,0 +1,46 @@
+// USDT fixture used by test/usdt.test.ts (x86-64), built with:
+//   gcc -O2 -static -nostdlib -no-pie -o usdt usdt.c
+//
+// Defines the probe test:hit, with a semaphore and two arguments (an
+// int in a register and a long in memory), emitting the same note as
+// <sys/sdt.h>. The probe fires only while the semaphore is set (e.g.
+// a probe is attached), and the exit status is the semaphore's value.
+
+__attribute__((section(".probes"), used))
+volatile unsigned short test_hit_semaphore;
+
+#define TEST_HIT(a, b) __asm__ __volatile__ ( \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte test_hit_semaphore\n" \
+    ".asciz \"test\"\n" \
+    ".asciz \"hit\"\n" \
+    ".asciz \"-4@%0 -8@%1\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n" \
+    :: "r" (a), "m" (b))
+
+void _start(void)
+{
+    int a = 42;
+    volatile long b = -1;
+    if (test_hit_semaphore)
+        TEST_HIT(a, b);
+    long ret;
+    __asm__ __volatile__ ("syscall" : "=a" (ret) : "a" (60 /* exit */), "D" (test_hit_semaphore) : "rcx", "r11", "memory");
+    __builtin_unreachable();
+}
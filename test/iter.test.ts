@@ -0,0 +1,77 @@
+import { loadProgram, findVmlinuxBtfId, attachIter, readIter, readIterAll, AttachType, ProgramType,
+    createMap, MapType, ConvMap, u32type, Assembler, Reg, Size, JmpOp, AluOp, Helper } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnZero, sortKeys } from './util'
+
+// writes the (u32) key and value of each element:
+// struct bpf_iter__bpf_map_elem { meta, map, key, value }
+const dumpElements = new Assembler()
+    .ldxMem(Size.DW, Reg.R6, Reg.R1, 0) // meta
+    .ldxMem(Size.DW, Reg.R2, Reg.R1, 16) // key
+    .ldxMem(Size.DW, Reg.R3, Reg.R1, 24) // value
+    .jmpImm(JmpOp.JEQ, Reg.R2, 0, 'out') // NULL at the end of the iteration
+    .jmpImm(JmpOp.JEQ, Reg.R3, 0, 'out')
+    .ldxMem(Size.W, Reg.R4, Reg.R2, 0)
+    .stxMem(Size.W, Reg.R10, Reg.R4, -8)
+    .ldxMem(Size.W, Reg.R4, Reg.R3, 0)
+    .stxMem(Size.W, Reg.R10, Reg.R4, -4)
+    .ldxMem(Size.DW, Reg.R1, Reg.R6, 0) // meta->seq
+    .movReg(Reg.R2, Reg.R10)
+    .aluImm(AluOp.ADD, Reg.R2, -8)
+    .movImm(Reg.R3, 8)
+    .call(Helper.SEQ_WRITE)
+    .label('out')
+    .movImm(Reg.R0, 0)
+    .exit()
+    .build()
+
+describe('iterator tests', () => {
+
+    conditionalTest(isRoot && kernelAtLeast('5.8'), 'task iterator', async () => {
+        const prog = loadProgram({
+            type: ProgramType.TRACING,
+            expectedAttachType: AttachType.TRACE_ITER,
+            attachBtfId: findVmlinuxBtfId('task', AttachType.TRACE_ITER),
+            insns: returnZero,
+            license: 'GPL',
+        })
+        const link = attachIter(prog)
+        prog.close()
+
+        // program doesn't print anything
+        expect((await readIterAll(link)).length).toBe(0)
+        const chunks = []
+        for await (const chunk of readIter(link, { chunkSize: 4096 }))
+            chunks.push(chunk)
+        expect(chunks).toStrictEqual([])
+
+        link.close()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('5.9'), 'map element iterator', async () => {
+        const ref = createMap({ type: MapType.HASH, keySize: 4, valueSize: 4, maxEntries: 8 })
+        const map = new ConvMap(ref, u32type, u32type)
+        map.set(1, 10).set(2, 20).set(3, 30)
+        const prog = loadProgram({
+            type: ProgramType.TRACING,
+            expectedAttachType: AttachType.TRACE_ITER,
+            attachBtfId: findVmlinuxBtfId('bpf_map_elem', AttachType.TRACE_ITER),
+            insns: dumpElements,
+            license: 'GPL',
+        })
+        const link = attachIter(prog, { map: ref })
+        prog.close()
+        ref.close() // the link holds the map
+
+        const output = await readIterAll(link)
+        expect(output.length).toBe(3 * 8)
+        const entries = [ 0, 1, 2 ].map(i => [ output.readUInt32LE(i * 8), output.readUInt32LE(i * 8 + 4) ] as [number, number])
+        expect(sortKeys(entries)).toStrictEqual([ [ 1, 10 ], [ 2, 20 ], [ 3, 30 ] ])
+
+        link.close()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('5.8'), 'unknown targets throw', () => {
+        expect(() => findVmlinuxBtfId('nonexistent_target', AttachType.TRACE_ITER)).toThrow()
+    })
+
+})
@@ -0,0 +1,52 @@
+import { EventLoopProfiler, UV_PHASES, LOG2_SLOTS, latencyPrograms, findProcessFunctions, histogramPercentile, INSN_SIZE } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot } from './util'
+
+const sleep = (ms: number) => new Promise(resolve => setTimeout(resolve, ms))
+
+describe('event loop latency tests', () => {
+
+    it('builds the latency programs', () => {
+        const fake = { fd: 0 } as any
+        const { entry, exit } = latencyPrograms({ start: fake, histograms: fake }, 2)
+        expect(entry.length % INSN_SIZE).toBe(0)
+        expect(exit.length % INSN_SIZE).toBe(0)
+    })
+
+    it('estimates percentiles', () => {
+        const counts = new Array(LOG2_SLOTS).fill(0)
+        counts[3] = 9
+        counts[10] = 1
+        const hist = { counts, total: 10 }
+        expect(histogramPercentile(hist, 50)).toBe(16)
+        expect(histogramPercentile(hist, 90)).toBe(16)
+        expect(histogramPercentile(hist, 99)).toBe(2048)
+        expect(histogramPercentile({ counts: [], total: 0 }, 50)).toBe(0)
+    })
+
+    it('looks up functions in this process', () => {
+        const locations = findProcessFunctions(process.pid, [ ...UV_PHASES, 'no_such_function_here' ])
+        expect(locations[UV_PHASES.length]).toBeUndefined()
+        for (const location of locations.filter(x => x))
+            expect(location!.fileOffset).toBeGreaterThan(0)
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.17'), 'measures event loop phases', async () => {
+        if (findProcessFunctions(process.pid, [ 'uv__run_timers' ])[0] === undefined)
+            return  // stripped node binary
+        const profiler = new EventLoopProfiler({ functions: [ 'uv__run_timers', 'no_such_function_here' ] })
+        try {
+            expect(profiler.phases).toStrictEqual([ 'uv__run_timers' ])
+            expect(profiler.missing).toStrictEqual([ 'no_such_function_here' ])
+            for (let i = 0; i < 5; i++)
+                await sleep(5)
+            const { uv__run_timers: timers } = profiler.read()
+            expect(timers.counts.length).toBe(LOG2_SLOTS)
+            expect(timers.total).toBeGreaterThanOrEqual(5)
+            profiler.reset()
+            expect(profiler.read().uv__run_timers.total).toBe(0)
+        } finally {
+            profiler.close()
+        }
+    })
+
+})
@@ -0,0 +1,68 @@
+import { mkdtempSync, writeFileSync, readFileSync, rmdirSync, existsSync } from 'fs'
+import { tmpdir } from 'os'
+import { join } from 'path'
+import { Btf, LayoutCache, vmlinuxBtfKey, versions } from '../lib'
+import { testBtf } from './util'
+
+describe('layout cache tests', () => {
+    let dir: string
+    let loads: number
+    const btf = () => {
+        loads++
+        return new Btf(join(dir, 'test.btf'))
+    }
+    const noBtf = (): Btf => {
+        throw new Error('BTF was loaded')
+    }
+    beforeEach(() => {
+        dir = mkdtempSync(join(tmpdir(), 'nbpf-'))
+        writeFileSync(join(dir, 'test.btf'), testBtf)
+        loads = 0
+    })
+    afterEach(() => rmdirSync(dir, { recursive: true }))
+
+    it('persists layouts', () => {
+        const path = join(dir, 'cache', 'layouts.bin')
+        const first = new LayoutCache(path, { key: 'test', btf })
+        expect(first.loaded).toBe(false)
+        const layout = first.structLayout('s')
+        const field = first.fieldLayout('t', 'inner.c')
+        expect(first.structLayout('s')).toBe(layout)
+        expect(loads).toBe(1)
+        first.save()
+        expect(existsSync(path)).toBe(true)
+
+        const second = new LayoutCache(path, { key: 'test', btf: noBtf })
+        expect(second.loaded).toBe(true)
+        expect(second.size).toBe(2)
+        expect(second.structLayout('s')).toStrictEqual(layout)
+        expect(second.fieldLayout('t', 'inner.c')).toStrictEqual(field)
+
+        // new layouts are added, the old ones kept
+        const third = new LayoutCache(path, { key: 'test', btf })
+        third.structLayout('t')
+        third.save()
+        expect(new LayoutCache(path, { key: 'test', btf: noBtf }).size).toBe(3)
+    })
+
+    it('discards invalid caches', () => {
+        const path = join(dir, 'layouts.bin')
+        const cache = new LayoutCache(path, { key: 'test', btf })
+        cache.structLayout('s')
+        cache.save()
+        expect(new LayoutCache(path, { key: 'other', btf }).loaded).toBe(false)
+
+        const data = readFileSync(path)
+        data[data.length - 1] ^= 1
+        writeFileSync(path, data)
+        expect(new LayoutCache(path, { key: 'test', btf }).loaded).toBe(false)
+        writeFileSync(path, data.subarray(0, 10))
+        expect(new LayoutCache(path, { key: 'test', btf }).loaded).toBe(false)
+    })
+
+    it('keys caches by kernel', () => {
+        expect(vmlinuxBtfKey().startsWith(versions.kernel + ':')).toBe(true)
+        expect(vmlinuxBtfKey()).toBe(vmlinuxBtfKey())
+    })
+
+})
@@ -0,0 +1,127 @@
+import { loadProgram, ProgramType, AttachType, LinkType, attachKprobe, attachTracepoint, attachRawTracepoint, attachUprobe, attachIter, findVmlinuxBtfId, getLinkInfo, updateLink, migrateLink,
+    readIterAll, createArrayMap, u32type, Assembler, Reg, Size, JmpOp, AluOp, Helper } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnZero } from './util'
+
+describe('link tests', () => {
+
+    conditionalTest(isRoot && kernelAtLeast('4.17'), 'kprobe', () => {
+        const prog = loadProgram({ type: ProgramType.KPROBE, insns: returnZero, license: 'GPL' })
+        const link = attachKprobe(prog, 'vfs_read')
+        const retLink = attachKprobe(prog, 'vfs_read', { retprobe: true })
+        prog.close() // links keep the program alive
+        link.close()
+        retLink.close()
+        expect(() => link.fd).toThrow()
+
+        expect(() => attachKprobe(prog, 'vfs_read')).toThrow()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.17'), 'uprobe on missing binary', () => {
+        const prog = loadProgram({ type: ProgramType.KPROBE, insns: returnZero, license: 'GPL' })
+        expect(() => attachUprobe(prog, '/nonexistent/binary', 0)).toThrow()
+        prog.close()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.7'), 'tracepoint', () => {
+        const prog = loadProgram({ type: ProgramType.TRACEPOINT, insns: returnZero, license: 'GPL' })
+        expect(() => attachTracepoint(prog, 'nonexistent', 'nonexistent')).toThrow()
+        attachTracepoint(prog, 'sched', 'sched_switch').close()
+        prog.close()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.17'), 'raw tracepoint', () => {
+        const prog = loadProgram({ type: ProgramType.RAW_TRACEPOINT, insns: returnZero, license: 'GPL' })
+        const link = attachRawTracepoint(prog, 'sched_switch')
+        expect(typeof link.fd).toBe('number')
+        link.close()
+        prog.close()
+    })
+
+    const iterProgram = () => ({
+        type: ProgramType.TRACING,
+        expectedAttachType: AttachType.TRACE_ITER,
+        attachBtfId: findVmlinuxBtfId('task', AttachType.TRACE_ITER),
+        insns: returnZero,
+        license: 'GPL',
+    })
+    const loadIterProgram = () => loadProgram(iterProgram())
+
+    conditionalTest(isRoot && kernelAtLeast('5.8'), 'updateLink / migrateLink', () => {
+        const prog1 = loadIterProgram(), prog2 = loadIterProgram()
+        const link = attachIter(prog1)
+        const info = getLinkInfo(link)
+        expect(info.type).toBe(LinkType.ITER)
+        expect(info.progId).toBe(prog1.id)
+
+        // wrong expected program
+        expect(() => updateLink(link, prog2, { expected: prog2 })).toThrow()
+        expect(getLinkInfo(link).progId).toBe(prog1.id)
+
+        updateLink(link, prog2, { expected: prog1 })
+        expect(getLinkInfo(link).progId).toBe(prog2.id)
+        updateLink(link, prog1)
+        expect(getLinkInfo(link).progId).toBe(prog1.id)
+
+        const prog3 = migrateLink(link, maps => {
+            expect(maps).toStrictEqual([])
+            return iterProgram()
+        })
+        expect(getLinkInfo(link).progId).toBe(prog3.id)
+
+        // a failing build leaves the link untouched
+        expect(() => migrateLink(link, () => { throw Error('oops') })).toThrow('oops')
+        expect(getLinkInfo(link).progId).toBe(prog3.id)
+
+        link.close()
+        prog1.close()
+        prog2.close()
+        prog3.close()
+    })
+
+    // increments the counter at index 0 of an array map
+    const countingProgram = (mapFd: number) => ({
+        ...iterProgram(),
+        insns: new Assembler()
+            .stMem(Size.W, Reg.R10, -4, 0)
+            .ldMapFd(Reg.R1, mapFd)
+            .movReg(Reg.R2, Reg.R10)
+            .aluImm(AluOp.ADD, Reg.R2, -4)
+            .call(Helper.MAP_LOOKUP_ELEM)
+            .jmpImm(JmpOp.JEQ, Reg.R0, 0, 'out')
+            .movImm(Reg.R1, 1)
+            .atomicAdd(Size.W, Reg.R0, Reg.R1, 0)
+            .label('out')
+            .movImm(Reg.R0, 0)
+            .exit()
+            .build(),
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('5.8'), 'migrateLink keeps map state', async () => {
+        const map = createArrayMap(2, 4, u32type)
+        map.set(1, 42)
+        const oldProg = loadProgram(countingProgram(map.ref.fd))
+        const link = attachIter(oldProg)
+        oldProg.close()
+        await readIterAll(link)
+        const count = map.get(0)
+        expect(count).toBeGreaterThan(0)
+
+        const prog = migrateLink(link, maps => {
+            expect(maps.map(x => x.id)).toStrictEqual([ map.ref.id ])
+            return countingProgram(maps[0].fd)
+        })
+        expect(getLinkInfo(link).progId).toBe(prog.id)
+        expect(map.get(0)).toBe(count)
+        expect(map.get(1)).toBe(42)
+
+        // the new program keeps counting on the same map
+        await readIterAll(link)
+        expect(map.get(0)).toBeGreaterThan(count)
+        expect(map.get(1)).toBe(42)
+
+        link.close()
+        prog.close()
+        map.ref.close()
+    })
+
+})
@@ -1,6 +1,6 @@
-import { createMap, MapType, ConvMap, RawMap, u32type, MapFlags, MapDef, createMapRef, openMap } from '../lib'
+import { createMap, MapType, ConvMap, RawMap, u32type, MapFlags, MapDef, createMapRef, openMap, loadBtf, BtfKind, BtfIntEncoding, MapUpdateFlags, MapLookupFlags } from '../lib'
 import { asUint32Array } from '../lib/util'
-import { concat, sortKeys, conditionalTest, kernelAtLeast, isRoot } from './util'
+import { concat, sortKeys, conditionalTest, kernelAtLeast, isRoot, btfInfo, buildBtf } from './util'
 
 describe('RawMap tests', () => {
 
@@ -169,6 +169,34 @@ describe('RawMap tests', () => {
         expect(sortKeys(entries)).toStrictEqual([ [0, 4], [1, 10], [2, 8], [3, 7] ])
     })
 
+    conditionalTest(kernelAtLeast('5.1') && isRoot, 'BTF and spin locks', () => {
+        expect(() => loadBtf(Buffer.alloc(24))).toThrow('EINVAL')
+        const btf = loadBtf(buildBtf([
+            /* 1 */ [ 'int', btfInfo(BtfKind.INT), 4, (BtfIntEncoding.SIGNED << 24) | 32 ],
+            /* 2 */ [ 'bpf_spin_lock', btfInfo(BtfKind.STRUCT, 1), 4, 'val', 1, 0 ],
+            /* 3 */ [ 'stats', btfInfo(BtfKind.STRUCT, 3), 12, 'lock', 2, 0, 'count', 1, 32, 'sum', 1, 64 ],
+        ]))
+        const ref = createMap({
+            type: MapType.HASH,
+            keySize: 4,
+            valueSize: 12,
+            maxEntries: 5,
+            btf,
+            btfKeyTypeId: 1,
+            btfValueTypeId: 3,
+        })
+        btf.close() // the map keeps its own reference
+        expect(ref.btfKeyTypeId).toBe(1)
+        expect(ref.btfValueTypeId).toBe(3)
+        const map = new RawMap(ref)
+        const key = Buffer.from('01000000', 'hex')
+        map.set(key, Buffer.from('ffffffff0200000003000000', 'hex'), MapUpdateFlags.F_LOCK)
+        // the lock itself is neither written nor read
+        expect(map.get(key, MapLookupFlags.F_LOCK)!.toString('hex')).toBe('000000000200000003000000')
+        expect(() => map.set(key, Buffer.alloc(12), MapUpdateFlags.F_LOCK | MapUpdateFlags.NOEXIST)).toThrow('EEXIST')
+        ref.close()
+    })
+
 })
 
 describe('ConvMap tests', () => {
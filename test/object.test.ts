@@ -0,0 +1,111 @@
+import * as dgram from 'dgram'
+import { once } from 'events'
+import { mkdtempSync, writeFileSync, mkdirSync, rmdirSync, readdirSync, readFileSync, existsSync, chmodSync } from 'fs'
+import { tmpdir } from 'os'
+import { join } from 'path'
+import { loadObject, findArchivedBtf, TargetBtfCache, Btf, BtfKind, BtfIntEncoding, BPFError, MapType,
+    LoadedObject, attachSocketFilter, VMLINUX_BTF_PATH } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, testBtf, buildBtf, btfInfo } from './util'
+
+/** See fixtures/core.bpf.c */
+const coreObject = join(__dirname, 'fixtures', 'core.bpf.o')
+
+/** Target BTF where `task_struct.pid` sits at offset 12 */
+const customBtf = buildBtf([
+    /* 1 */ [ 'int', btfInfo(BtfKind.INT), 4, (BtfIntEncoding.SIGNED << 24) | 32 ],
+    /* 2 */ [ 'task_struct', btfInfo(BtfKind.STRUCT, 4), 16, 'a', 1, 0, 'b', 1, 32, 'c', 1, 64, 'pid', 1, 96 ],
+])
+
+/** Send a datagram through the object's filter, return how much of it was kept */
+const filteredLength = async (obj: LoadedObject) => {
+    const receiver = dgram.createSocket('udp4'), sender = dgram.createSocket('udp4')
+    try {
+        receiver.bind(0, '127.0.0.1')
+        await once(receiver, 'listening')
+        attachSocketFilter(receiver, obj.programs.core_offset)
+        const received = once(receiver, 'message')
+        sender.send(Buffer.alloc(4096), receiver.address().port, '127.0.0.1')
+        const [ msg ] = await received
+        return (msg as Buffer).length
+    } finally {
+        receiver.close()
+        sender.close()
+    }
+}
+
+describe('object loading tests', () => {
+    let dir: string
+    beforeEach(() => {
+        dir = mkdtempSync(join(tmpdir(), 'nbpf-'))
+    })
+    afterEach(() => rmdirSync(dir, { recursive: true }))
+
+    it('rejects invalid objects', () => {
+        expect(() => loadObject(Buffer.from('not an ELF'))).toThrow(BPFError)
+        expect(() => loadObject(join(dir, 'nonexistent.o'))).toThrow(BPFError)
+        const btfCache = new TargetBtfCache(join(dir, 'cache'))
+        expect(() => loadObject(Buffer.from('not an ELF'), { targetBtf: Buffer.from('not BTF'), btfCache })).toThrow()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('5.2') && existsSync(VMLINUX_BTF_PATH), 'loads an object', async () => {
+        const obj = loadObject(readFileSync(coreObject))
+        try {
+            expect(obj.maps.hits.type).toBe(MapType.ARRAY)
+            expect(obj.maps.hits.maxEntries).toBe(1)
+            const { offset } = Btf.vmlinux().fieldLayout('task_struct', 'pid')
+            expect(await filteredLength(obj)).toBe(Math.min(offset, 4096))
+        } finally {
+            obj.close()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('5.2'), 'relocates against a target BTF', async () => {
+        const btfCache = new TargetBtfCache(join(dir, 'cache'))
+        const obj = loadObject(coreObject, { targetBtf: customBtf, btfCache })
+        try {
+            expect(Object.keys(obj.programs)).toEqual([ 'core_offset' ])
+            expect(await filteredLength(obj)).toBe(12)
+        } finally {
+            obj.close()
+        }
+    })
+
+    it('caches target BTFs', () => {
+        const cache = new TargetBtfCache(join(dir, 'cache'))
+        const path = cache.resolve(testBtf)
+        expect(cache.resolve(Buffer.from(testBtf))).toBe(path)
+        expect(readdirSync(join(dir, 'cache'))).toHaveLength(1)
+        const btf = cache.get(path)
+        expect(btf).toBeInstanceOf(Btf)
+        expect(btf.findType('s')).toBe(3)
+        expect(cache.get(testBtf).findType('s')).toBe(3)
+        expect(cache.get(btf)).toBe(btf)
+        expect(cache.resolve(btf)).toBe(path)
+        expect(() => cache.resolve(Buffer.from('not BTF'))).toThrow()
+        expect(() => cache.resolve(testBtf.subarray(0, testBtf.length - 1))).toThrow('truncated')
+        writeFileSync(join(dir, 'bad.btf'), 'not BTF')
+        expect(() => cache.resolve(join(dir, 'bad.btf'))).toThrow()
+        expect(readdirSync(join(dir, 'cache'))).toHaveLength(1)
+    })
+
+    it('doesn\'t trust existing BTF files', () => {
+        const cache = new TargetBtfCache(join(dir, 'cache'))
+        const path = cache.resolve(testBtf)
+        writeFileSync(path, customBtf)
+        expect(new TargetBtfCache(join(dir, 'cache')).resolve(testBtf)).toBe(path)
+        expect(readFileSync(path).equals(testBtf)).toBe(true)
+        expect(readdirSync(join(dir, 'cache'))).toHaveLength(1)
+
+        chmodSync(join(dir, 'cache'), 0o777)
+        expect(() => new TargetBtfCache(join(dir, 'cache')).resolve(customBtf)).toThrow()
+    })
+
+    it('finds archived BTFs', () => {
+        expect(findArchivedBtf(dir, '1.2.3-test')).toBeUndefined()
+        writeFileSync(join(dir, '1.2.3-test.btf'), testBtf)
+        expect(findArchivedBtf(dir, '1.2.3-test')).toBe(join(dir, '1.2.3-test.btf'))
+        mkdirSync(join(dir, 'sub'))
+        expect(findArchivedBtf(join(dir, 'sub'), '1.2.3-test')).toBeUndefined()
+    })
+
+})
@@ -0,0 +1,92 @@
+import { execSync } from 'child_process'
+import { Profiler, OffCpuProfiler, KernelSymbolizer, stackSampleProgram, offCpuProgram, schedSwitchOffsets, tracepointFormat, attachPerfEvent, loadProgram, ProgramType, PerfType, PerfSwId, INSN_SIZE } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnZero } from './util'
+
+const busyLoop = (ms: number) => {
+    const end = Date.now() + ms
+    let x = 0
+    while (Date.now() < end) x += Math.sqrt(x + 1)
+    return x
+}
+
+describe('profiler tests', () => {
+
+    it('builds the sampling program', () => {
+        const fake = { fd: 0 } as any
+        const full = stackSampleProgram({ stacks: fake, counts: fake })
+        const kernelOnly = stackSampleProgram({ stacks: fake, counts: fake }, { user: false })
+        expect(full.length % INSN_SIZE).toBe(0)
+        expect(kernelOnly.length).toBeLessThan(full.length)
+        const offCpu = offCpuProgram({ stacks: fake, counts: fake, start: fake }, { pid: 1, cgroup: BigInt(1) }, { prevPid: 24, nextPid: 56 })
+        expect(offCpu.length % INSN_SIZE).toBe(0)
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.9'), 'attaches to a perf event', () => {
+        const prog = loadProgram({ type: ProgramType.PERF_EVENT, insns: returnZero, license: 'GPL' })
+        try {
+            const link = attachPerfEvent(prog, {
+                type: PerfType.SOFTWARE, config: PerfSwId.CPU_CLOCK, sampleFreq: 99,
+            }, { pid: process.pid })
+            link.close()
+            expect(() => attachPerfEvent(prog, { type: PerfType.SOFTWARE })).toThrow()
+        } finally {
+            prog.close()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.9'), 'samples stacks', () => {
+        const profiler = new Profiler({ frequency: 999, pid: process.pid })
+        try {
+            busyLoop(300)
+            const samples = profiler.read()
+            expect(samples.length).toBeGreaterThan(0)
+            const own = samples.filter(s => s.pid === process.pid)
+            expect(own.reduce((n, s) => n + s.count, 0)).toBeGreaterThan(0)
+            expect(own.some(s => s.userStack && s.userStack.length > 0)).toBe(true)
+        } finally {
+            profiler.close()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.9'), 'folds sampled stacks', () => {
+        const profiler = new Profiler({ frequency: 999, pid: process.pid })
+        try {
+            busyLoop(300)
+            const lines = profiler.readFolded().trim().split('\n')
+            expect(lines.length).toBeGreaterThan(0)
+            for (const line of lines)
+                expect(line).toMatch(new RegExp(`^${process.pid}(;.*)? \\d+$`))
+        } finally {
+            profiler.close()
+        }
+    })
+
+    conditionalTest(isRoot, 'reads the sched_switch format', () => {
+        const fields = tracepointFormat('sched', 'sched_switch')
+        const prevComm = fields.find(x => x.name === 'prev_comm')!
+        expect(prevComm.declaration).toBe('char prev_comm[16]')
+        expect(prevComm.size).toBe(16)
+        const { prevPid, nextPid } = schedSwitchOffsets()
+        expect(fields.find(x => x.name === 'prev_pid')!.offset).toBe(prevPid)
+        expect(nextPid).toBeGreaterThan(prevPid)
+        expect(() => tracepointFormat('sched', 'nonexistent')).toThrow()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.9'), 'accounts off-CPU time', () => {
+        const profiler = new OffCpuProfiler({ pid: process.pid })
+        try {
+            for (let i = 0; i < 5; i++)
+                execSync('sleep 0.02')
+            const samples = profiler.read(false)
+            const total = samples.reduce((n, s) => n + s.count, 0)
+            expect(total).toBeGreaterThan(50e6)
+            expect(samples.every(s => s.pid === process.pid)).toBe(true)
+
+            const folded = profiler.readFolded({ kernelSymbolizer: new KernelSymbolizer() })
+            expect(folded).toMatch(/schedule/)
+        } finally {
+            profiler.close()
+        }
+    })
+
+})
@@ -0,0 +1,44 @@
+import { loadProgram, ProgramType, createProgArrayMap, MapUpdateFlags } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnConstant } from './util'
+
+const filter = (value: number) =>
+    loadProgram({ type: ProgramType.SOCKET_FILTER, insns: returnConstant(value), license: 'GPL' })
+
+describe('prog array tests', () => {
+
+    conditionalTest(isRoot && kernelAtLeast('4.18'), 'slot operations', () => {
+        const map = createProgArrayMap(4)
+        const progs = [ filter(0), filter(1), filter(2) ]
+        const other = loadProgram({ type: ProgramType.SCHED_CLS, insns: returnConstant(0), license: 'GPL' })
+        try {
+            expect(map.length).toBe(4)
+            expect(map.getAllIds()).toStrictEqual([ undefined, undefined, undefined, undefined ])
+
+            map.set(0, progs[0])
+            expect(map.programType).toBe(ProgramType.SOCKET_FILTER)
+            expect(map.getId(0)).toBe(progs[0].id)
+            expect(() => map.set(1, other)).toThrow()
+            expect(() => map.set(4, progs[1])).toThrow(RangeError)
+            expect(() => map.set(0, progs[1], MapUpdateFlags.NOEXIST)).toThrow()
+
+            // atomic swap
+            map.set(0, progs[1])
+            expect(map.getId(0)).toBe(progs[1].id)
+
+            map.setMany([ [1, progs[2]], [2, progs[0]], [0, undefined] ])
+            expect(map.getAllIds()).toStrictEqual([ undefined, progs[2].id, progs[0].id, undefined ])
+
+            // invalid entries are rejected before any update
+            expect(() => map.setMany([ [3, progs[1]], [1, other] ])).toThrow()
+            expect(map.getId(3)).toBeUndefined()
+
+            expect(map.delete(1)).toBe(true)
+            expect(map.delete(1)).toBe(false)
+        } finally {
+            progs.forEach(p => p.close())
+            other.close()
+            map.ref.close()
+        }
+    })
+
+})
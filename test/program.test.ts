@@ -0,0 +1,56 @@
+import { loadProgram, openProgram, createProgramRef, ProgramType, BPFError } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnZero, invalidProgram } from './util'
+
+describe('program tests', () => {
+
+    it('rejects truncated bytecode', () => {
+        expect(() => loadProgram({
+            type: ProgramType.SOCKET_FILTER,
+            insns: returnZero.subarray(0, 12),
+            license: 'GPL',
+        })).toThrow('Bytecode length 12')
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.15'), 'load and query', () => {
+        const ref = loadProgram({
+            type: ProgramType.SOCKET_FILTER,
+            insns: returnZero,
+            license: 'GPL',
+            name: 'return_zero',
+        })
+        expect(ref.type).toBe(ProgramType.SOCKET_FILTER)
+        expect(ref.name).toBe('return_zero')
+        expect(ref.tag).toMatch(/^[0-9a-f]{16}$/)
+
+        const ref2 = openProgram(ref.id)
+        expect(ref2.fd).not.toBe(ref.fd)
+        expect(ref2.id).toBe(ref.id)
+        expect(ref2.tag).toBe(ref.tag)
+
+        const ref3 = createProgramRef(ref.fd)
+        expect(ref3.id).toBe(ref.id)
+
+        ref.close()
+        ref.close()
+        expect(() => ref.fd).toThrow()
+        ref2.close()
+        ref3.close()
+    })
+
+    conditionalTest(isRoot, 'verifier log is attached to errors', () => {
+        let error: BPFError | undefined
+        try {
+            loadProgram({
+                type: ProgramType.SOCKET_FILTER,
+                insns: invalidProgram,
+                license: 'GPL',
+            })
+        } catch (e) {
+            error = e
+        }
+        expect(error).toBeInstanceOf(BPFError)
+        expect(error!.code).toBe('EACCES')
+        expect(error!.log).toMatch(/R0/)
+    })
+
+})
@@ -0,0 +1,65 @@
+import { createCpuMap, createDevMap, createMap, MapType, DevMap, loadProgram, ProgramType, AttachType, numPossibleCpus } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnConstant } from './util'
+
+const xdpPass = (expectedAttachType: AttachType) => loadProgram({
+    type: ProgramType.XDP, insns: returnConstant(2), license: 'GPL', expectedAttachType,
+})
+
+describe('redirect map tests', () => {
+
+    conditionalTest(isRoot && kernelAtLeast('5.9'), 'cpumap', () => {
+        const map = createCpuMap()
+        const prog = xdpPass(AttachType.XDP_CPUMAP)
+        try {
+            expect(map.get(0)).toBeUndefined()
+            map.set(0, { qsize: 192 })
+            expect(map.get(0)).toStrictEqual({ qsize: 192, progId: 0 })
+            map.set(0, { qsize: 256, prog })
+            expect(map.get(0)).toStrictEqual({ qsize: 256, progId: prog.id })
+
+            map.setAll({ qsize: 64 })
+            for (let cpu = 0; cpu < numPossibleCpus(); cpu++)
+                expect(map.get(cpu)?.qsize).toBe(64)
+            expect(map.delete(0)).toBe(true)
+            expect(map.delete(0)).toBe(false)
+        } finally {
+            prog.close()
+            map.ref.close()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('5.8'), 'devmap', () => {
+        const map = createDevMap(4)
+        const hash = createDevMap(4, true)
+        const prog = xdpPass(AttachType.XDP_DEVMAP)
+        try {
+            map.set(0, { ifindex: 1 })
+            expect(map.get(0)).toStrictEqual({ ifindex: 1, progId: 0 })
+            map.setMany([ [1, { ifindex: 1, prog }] ])
+            expect(map.get(1)).toStrictEqual({ ifindex: 1, progId: prog.id })
+            expect(() => map.set(4, { ifindex: 1 })).toThrow()
+
+            hash.setMany([ { ifindex: 1 } ])
+            expect(hash.get(1)).toStrictEqual({ ifindex: 1, progId: 0 })
+            expect(hash.delete(1)).toBe(true)
+        } finally {
+            prog.close()
+            map.ref.close()
+            hash.ref.close()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.14'), 'devmap with 4-byte values', () => {
+        const map = new DevMap(createMap({ type: MapType.DEVMAP, keySize: 4, valueSize: 4, maxEntries: 2 }))
+        const prog = xdpPass(AttachType.XDP_DEVMAP)
+        try {
+            map.set(0, { ifindex: 1 })
+            expect(map.get(0)).toStrictEqual({ ifindex: 1 })
+            expect(() => map.set(1, { ifindex: 1, prog })).toThrow()
+        } finally {
+            prog.close()
+            map.ref.close()
+        }
+    })
+
+})
@@ -0,0 +1,75 @@
+import * as net from 'net'
+import { once } from 'events'
+import { ReuseportGroup, numPossibleCpus, bindReuseport } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot } from './util'
+
+const listen = async (port: number) => {
+    const server = net.createServer()
+    server.listen({ fd: bindReuseport(port, '127.0.0.1') })
+    await once(server, 'listening')
+    return server
+}
+
+describe('reuseport tests', () => {
+
+    it('numPossibleCpus', () => {
+        expect(numPossibleCpus()).toBeGreaterThan(0)
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.19'), 'group steering table', () => {
+        const group = ReuseportGroup.create(3)
+        try {
+            expect(group.size).toBe(3)
+            for (let cpu = 0; cpu < numPossibleCpus(); cpu++)
+                expect(group.getSteering(cpu)).toBe(cpu % 3)
+            group.steer(0, 2)
+            expect(group.getSteering(0)).toBe(2)
+            expect(group.remove(1)).toBe(false)
+        } finally {
+            group.close()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.19'), 'steers connections', async () => {
+        const group = ReuseportGroup.create(2)
+        const a = await listen(0)
+        const { port } = a.address() as net.AddressInfo
+        const b = await listen(port)
+        const servers = [ a, b ]
+        // send every CPU to `slot`, then check only its socket accepts
+        const expectSteeredTo = async (slot: number) => {
+            for (let cpu = 0; cpu < numPossibleCpus(); cpu++)
+                group.steer(cpu, slot)
+            const accepted: number[] = []
+            const onConnection = servers.map((server, i) => (conn: net.Socket) => {
+                accepted.push(i)
+                conn.destroy()
+            })
+            servers.forEach((server, i) => server.on('connection', onConnection[i]))
+            try {
+                for (let n = 0; n < 4; n++) {
+                    const client = net.connect(port, '127.0.0.1')
+                    await once(client, 'connect')
+                    client.destroy()
+                }
+                while (accepted.length < 4)
+                    await new Promise(resolve => setTimeout(resolve, 5))
+            } finally {
+                servers.forEach((server, i) => server.off('connection', onConnection[i]))
+            }
+            expect(accepted).toStrictEqual([ slot, slot, slot, slot ])
+        }
+        try {
+            group.add(0, a).add(1, b)
+            group.attach(a)
+            await expectSteeredTo(1)
+            await expectSteeredTo(0)
+            expect(group.remove(0)).toBe(true)
+        } finally {
+            group.close()
+            a.close()
+            b.close()
+        }
+    })
+
+})
@@ -0,0 +1,73 @@
+import * as net from 'net'
+import { once } from 'events'
+import { loadProgram, ProgramType, AttachType, createSockMap, createSockHash, socketTuple,
+    spliceVerdictProgram, streamParserProgram } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot } from './util'
+
+const connectPair = async () => {
+    const server = net.createServer().listen(0, '127.0.0.1')
+    await once(server, 'listening')
+    const accepted = once(server, 'connection')
+    const client = net.connect((server.address() as net.AddressInfo).port, '127.0.0.1')
+    await once(client, 'connect')
+    const [ peer ] = await accepted as [ net.Socket ]
+    server.close()
+    return [ client, peer ]
+}
+
+describe('sockmap tests', () => {
+
+    it('socketTuple', async () => {
+        const [ client, peer ] = await connectPair()
+        try {
+            const key = socketTuple(client)
+            expect(key.length).toBe(16)
+            expect([...key.subarray(0, 8)]).toStrictEqual([ 127, 0, 0, 1, 127, 0, 0, 1 ])
+            expect(key.readUInt16BE(8)).toBe(client.remotePort)
+            expect(key.readUInt32LE(12)).toBe(client.localPort)
+        } finally {
+            client.destroy()
+            peer.destroy()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.14'), 'sockmap operations', async () => {
+        const map = createSockMap(4)
+        const [ client, peer ] = await connectPair()
+        try {
+            map.set(0, client).set(1, peer)
+            expect(map.delete(1)).toBe(true)
+            expect(map.delete(1)).toBe(false)
+            expect(() => map.set(4, peer)).toThrow()
+            expect(() => map.set(Buffer.alloc(8), peer)).toThrow()
+        } finally {
+            map.ref.close()
+            client.destroy()
+            peer.destroy()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.18'), 'splice connections', async () => {
+        const map = createSockHash(16)
+        const parser = loadProgram({ type: ProgramType.SK_SKB, insns: streamParserProgram(), license: 'GPL' })
+        const verdict = loadProgram({ type: ProgramType.SK_SKB, insns: spliceVerdictProgram(map.ref), license: 'GPL' })
+        const [ client, proxyIn ] = await connectPair()
+        const [ proxyOut, backend ] = await connectPair()
+        try {
+            map.attach(parser, AttachType.SK_SKB_STREAM_PARSER)
+            map.attach(verdict, AttachType.SK_SKB_STREAM_VERDICT)
+            map.splice(proxyIn, proxyOut)
+            const received = once(backend, 'data')
+            client.write('hello')
+            expect((await received)[0].toString()).toBe('hello')
+            map.detach(verdict, AttachType.SK_SKB_STREAM_VERDICT)
+        } finally {
+            for (const socket of [ client, proxyIn, proxyOut, backend ])
+                socket.destroy()
+            parser.close()
+            verdict.close()
+            map.ref.close()
+        }
+    })
+
+})
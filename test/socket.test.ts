@@ -0,0 +1,64 @@
+import * as dgram from 'dgram'
+import * as net from 'net'
+import { once } from 'events'
+import { loadProgram, ProgramType, getSocketFd, attachSocketFilter, detachSocketFilter } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnConstant } from './util'
+
+const bindSocket = async () => {
+    const socket = dgram.createSocket('udp4')
+    socket.bind(0, '127.0.0.1')
+    await once(socket, 'listening')
+    return socket
+}
+
+const receiveWithin = (socket: dgram.Socket, ms: number) =>
+    new Promise<Buffer | undefined>(resolve => {
+        const timeout = setTimeout(() => {
+            socket.removeListener('message', onMessage)
+            resolve(undefined)
+        }, ms)
+        const onMessage = (msg: Buffer) => {
+            clearTimeout(timeout)
+            resolve(msg)
+        }
+        socket.once('message', onMessage)
+    })
+
+describe('socket tests', () => {
+
+    it('getSocketFd', async () => {
+        expect(getSocketFd(42)).toBe(42)
+
+        const socket = dgram.createSocket('udp4')
+        expect(() => getSocketFd(socket)).toThrow()
+        socket.bind(0, '127.0.0.1')
+        await once(socket, 'listening')
+        expect(getSocketFd(socket)).toBeGreaterThanOrEqual(0)
+        socket.close()
+
+        const server = net.createServer().listen(0, '127.0.0.1')
+        await once(server, 'listening')
+        expect(getSocketFd(server)).toBeGreaterThanOrEqual(0)
+        server.close()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('3.19'), 'filter drops datagrams', async () => {
+        const prog = loadProgram({ type: ProgramType.SOCKET_FILTER, insns: returnConstant(0), license: 'GPL' })
+        const receiver = await bindSocket(), sender = await bindSocket()
+        const { port } = receiver.address()
+        try {
+            attachSocketFilter(receiver, prog)
+            prog.close()
+            sender.send('dropped', port, '127.0.0.1')
+            expect(await receiveWithin(receiver, 200)).toBeUndefined()
+
+            detachSocketFilter(receiver)
+            sender.send('received', port, '127.0.0.1')
+            expect((await receiveWithin(receiver, 2000))!.toString()).toBe('received')
+        } finally {
+            receiver.close()
+            sender.close()
+        }
+    })
+
+})
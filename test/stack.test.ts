@@ -0,0 +1,46 @@
+import { createStackTraceMap, createMap, MapType, StackTraceMap } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot } from './util'
+
+describe('stack trace map tests', () => {
+
+    conditionalTest(isRoot && kernelAtLeast('4.6'), 'basic', () => {
+        const map = createStackTraceMap(16, 32)
+        try {
+            expect(map.buildId).toBe(false)
+            expect(map.frameSize).toBe(8)
+            expect(map.maxDepth).toBe(32)
+            expect(map.get(3)).toBeUndefined()
+            expect(() => map.getBuildId(3)).toThrow()
+
+            const batch = map.lookupBatch([ 0, 1, 2 ], { delete: true })
+            expect(batch.count).toBe(3)
+            expect(Array.from(batch.offsets)).toStrictEqual([ 0, 0, 0, 0 ])
+            expect(batch.frames.length).toBe(0)
+            expect(() => map.deleteBatch(new Uint32Array([ 4, 5 ]))).not.toThrow()
+        } finally {
+            map.ref.close()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.17'), 'build ID', () => {
+        const map = createStackTraceMap(16, 8, true)
+        try {
+            expect(map.buildId).toBe(true)
+            expect(map.maxDepth).toBe(8)
+            expect(map.getBuildId(0)).toBeUndefined()
+            expect(map.lookupBatch([ 0 ]).offsets[1]).toBe(0)
+        } finally {
+            map.ref.close()
+        }
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('4.6'), 'wrong type', () => {
+        const ref = createMap({ type: MapType.HASH, keySize: 4, valueSize: 8, maxEntries: 4 })
+        try {
+            expect(() => new StackTraceMap(ref)).toThrow('Expected stack trace map')
+        } finally {
+            ref.close()
+        }
+    })
+
+})
@@ -0,0 +1,133 @@
+import * as fs from 'fs'
+import { mkdtempSync, writeFileSync, rmdirSync, realpathSync } from 'fs'
+import { tmpdir } from 'os'
+import { join } from 'path'
+import { KernelSymbolizer, NO_SYMBOL, formatSymbol, ElfSymbols, UserSymbolizer, readProcessMappings } from '../lib'
+
+const kallsyms = `\
+ffffffff81000000 T _text
+ffffffff81000100 t helper
+ffffffff81000100 T helper_alias
+ffffffff81000200 D some_data
+ffffffff81000300 T do_work
+ffffffff81000400 T _etext
+ffffffffc0000000 t mod_init\t[foo]
+ffffffffc0000080 t mod_work\t[foo]
+`
+const modules = 'foo 16384 0 - Live 0xffffffffc0000000\n'
+
+describe('symbolizer tests', () => {
+    let dir: string
+    beforeEach(() => {
+        dir = mkdtempSync(join(tmpdir(), 'nbpf-'))
+        writeFileSync(join(dir, 'kallsyms'), kallsyms)
+        writeFileSync(join(dir, 'modules'), modules)
+    })
+    afterEach(() => rmdirSync(dir, { recursive: true }))
+
+    const open = () => new KernelSymbolizer({
+        kallsymsPath: join(dir, 'kallsyms'),
+        modulesPath: join(dir, 'modules'),
+    })
+
+    it('resolves addresses', () => {
+        const sym = open()
+        expect(sym.size).toBe(5)
+        const addrs = BigUint64Array.of(
+            BigInt('0xffffffff81000010'),
+            BigInt('0xffffffff81000210'),
+            BigInt('0xffffffffc0000090'),
+            BigInt('0x1000'),
+            BigInt('0xffffffff81000110'),
+            BigInt('0xffffffff81000410'),
+            BigInt('0xffffffffc0004010'),
+        )
+        const { found, indexes, offsets } = sym.resolveBatch(addrs)
+        expect(found).toBe(3)
+        expect(sym.symbol(indexes[0]).name).toBe('_text')
+        expect(offsets[0]).toBe(BigInt(0x10))
+        // data symbols and the end of text/modules bound the previous symbol
+        expect(indexes[1]).toBe(NO_SYMBOL)
+        expect(indexes[5]).toBe(NO_SYMBOL)
+        expect(indexes[6]).toBe(NO_SYMBOL)
+        expect(sym.symbol(indexes[2])).toStrictEqual({
+            name: 'mod_work', address: BigInt('0xffffffffc0000080'), module: 'foo',
+        })
+        expect(indexes[3]).toBe(NO_SYMBOL)
+        // aliases keep the first name
+        expect(sym.symbol(indexes[4]).name).toBe('helper')
+        expect(offsets[4]).toBe(BigInt(0x10))
+
+        const stack = sym.resolveStack(addrs)
+        expect(stack.map((x, i) => formatSymbol(x, addrs[i]))).toStrictEqual([
+            '_text+0x10', '0xffffffff81000210', 'mod_work+0x10 [foo]', '0x1000',
+            'helper+0x10', '0xffffffff81000410', '0xffffffffc0004010',
+        ])
+    })
+
+    it('refreshes module symbols', () => {
+        const sym = open()
+        expect(sym.refresh()).toBe(false)
+        writeFileSync(join(dir, 'kallsyms'), kallsyms + 'ffffffffc0001000 t bar_fn\t[bar]\n')
+        writeFileSync(join(dir, 'modules'), modules + 'bar 16384 0 - Live 0xffffffffc0001000\n')
+        expect(sym.refresh()).toBe(true)
+        expect(sym.size).toBe(6)
+        expect(formatSymbol(sym.resolve(BigInt('0xffffffffc0001004')))).toBe('bar_fn+0x4 [bar]')
+        expect(sym.refresh(true)).toBe(true)
+    })
+
+    it('fails with hidden addresses', () => {
+        writeFileSync(join(dir, 'kallsyms'), '0000000000000000 T _text\n0000000000000000 T do_work\n')
+        expect(open).toThrow()
+    })
+
+    it('loads ELF symbols', () => {
+        const file = new ElfSymbols(process.execPath)
+        expect(file.size).toBeGreaterThan(0)
+        const first = file.symbol(0)
+        expect(typeof first.name).toBe('string')
+        expect(file.resolve(BigInt(0))).toBeUndefined()
+        expect(() => new ElfSymbols('/proc/self/status')).toThrow()
+    })
+
+    it('resolves process addresses', () => {
+        const execPath = realpathSync(process.execPath)
+        const mappings = readProcessMappings(process.pid)
+        expect(mappings.some(m => m.path === execPath)).toBe(true)
+
+        const sym = new UserSymbolizer()
+        expect(sym.resolveStack(process.pid, [ BigInt(0) ])).toStrictEqual([ undefined ])
+        const file = sym.addFile(execPath)
+        expect(file).toBeDefined()
+        expect(sym.addFile(execPath)).toBe(file)
+
+        // a libuv function exported by node, mapped to its runtime address
+        const name = 'uv_default_loop'
+        const found = file!.findSymbol(name)
+        expect(found).toBeDefined()
+        const fileOffset = BigInt(found!.fileOffset)
+        const mapping = mappings.find(m => m.path === execPath &&
+            m.fileOffset <= fileOffset && fileOffset < m.fileOffset + (m.end - m.start))
+        expect(mapping).toBeDefined()
+        const addr = mapping!.start + (fileOffset - mapping!.fileOffset)
+        const [ resolved ] = sym.resolveStack(process.pid, [ addr ])
+        expect(resolved!.file).toBe(file)
+        expect(resolved!.symbol.name).toBe(name)
+        expect(resolved!.offset).toBe(BigInt(0))
+
+        // files are found once per mapping, not once per frame
+        const statSync = jest.spyOn(fs, 'statSync')
+        try {
+            const frames = sym.resolveStack(process.pid, new Array(16).fill(addr))
+            expect(frames.every(x => x!.symbol.name === name)).toBe(true)
+            expect(statSync).not.toHaveBeenCalled()
+        } finally {
+            statSync.mockRestore()
+        }
+        if (file?.buildId)
+            expect(sym.getByBuildId(file.buildId)).toBe(file)
+        expect(sym.resolveBuildIdStack([ { status: 2, ip: BigInt(1) } ])).toStrictEqual([ undefined ])
+        sym.forget(process.pid)
+    })
+
+})
@@ -0,0 +1,54 @@
+import { loadProgram, ProgramType, TcHook, TcAttachPoint, attachTcBulk, ifNameToIndex } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnConstant, withVeth } from './util'
+
+const TC_ACT_OK = 0
+const loadClsProgram = () => loadProgram({
+    type: ProgramType.SCHED_CLS,
+    insns: returnConstant(TC_ACT_OK),
+    license: 'GPL',
+})
+
+describe('TC tests', () => {
+
+    conditionalTest(isRoot && kernelAtLeast('4.5'), 'attach, query, detach', () => withVeth(() => {
+        const ifindex = ifNameToIndex('veth0')
+        const prog1 = loadClsProgram(), prog2 = loadClsProgram()
+        const hook = new TcHook(ifindex, TcAttachPoint.INGRESS).create()
+        expect(() => hook.create(true)).toThrow()
+        const filter = hook.attach(prog1, { handle: 1, priority: 1 })
+        expect(filter).toStrictEqual({ handle: 1, priority: 1, progId: prog1.id })
+        expect(hook.query(filter)).toStrictEqual(filter)
+        expect(hook.query({ handle: 2, priority: 1 })).toBeUndefined()
+
+        expect(() => hook.attach(prog2, { handle: 1, priority: 1 })).toThrow()
+        hook.attach(prog2, { handle: 1, priority: 1, replace: true })
+        expect(hook.query(filter)!.progId).toBe(prog2.id)
+
+        hook.detach(filter)
+        expect(hook.query(filter)).toBeUndefined()
+        new TcHook(ifindex, TcAttachPoint.INGRESS | TcAttachPoint.EGRESS).destroy()
+        prog1.close()
+        prog2.close()
+    }))
+
+    conditionalTest(isRoot && kernelAtLeast('4.5'), 'bulk attach is all-or-nothing', () => withVeth(() => {
+        const [ veth0, veth1 ] = [ ifNameToIndex('veth0'), ifNameToIndex('veth1') ]
+        const prog = loadClsProgram()
+        const options = { handle: 1, priority: 1 }
+        const existing = new TcHook(veth1, TcAttachPoint.EGRESS).create()
+        const other = existing.attach(prog, { handle: 2, priority: 1 })
+
+        expect(() => attachTcBulk([ veth0, veth1, 0x7FFFFFFF ], TcAttachPoint.EGRESS, prog, options)).toThrow()
+        // the qdisc created on veth0 is gone, the one on veth1 is kept as it was
+        expect(() => new TcHook(veth0, TcAttachPoint.EGRESS).create(true)).not.toThrow()
+        new TcHook(veth0, TcAttachPoint.INGRESS | TcAttachPoint.EGRESS).destroy()
+        expect(existing.query(options)).toBeUndefined()
+        expect(existing.query(other)).toStrictEqual(other)
+
+        const result = attachTcBulk([ veth0 ], TcAttachPoint.EGRESS, prog, options)
+        expect(result.length).toBe(1)
+        expect(result[0][1].progId).toBe(prog.id)
+        prog.close()
+    }))
+
+})
@@ -0,0 +1,104 @@
+import { readFileSync } from 'fs'
+import { join } from 'path'
+import { spawnSync } from 'child_process'
+import { parseUsdtArguments, readUsdtProbes, findUsdtProbe, fetchUsdtArgument, attachUsdt, UsdtArgKind, Assembler, Reg, Size, AluOp, JmpOp, Helper, INSN_SIZE,
+    loadProgram, ProgramType, createMap, MapType, RawArrayMap } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot } from './util'
+
+/** See fixtures/usdt.c */
+const fixture = join(__dirname, 'fixtures', 'usdt')
+
+describe('USDT tests', () => {
+
+    it('parses argument specs', () => {
+        const args = parseUsdtArguments('-4@%edi 8@-8(%rbp) 2@(%rax) 1@%r8b 4@$-5 8@$0x10 8@(%rax,%rbx,8)')
+        expect(args.map(x => [ x.kind, x.size, x.signed ])).toStrictEqual([
+            [ UsdtArgKind.REG, 4, true ],
+            [ UsdtArgKind.MEM, 8, false ],
+            [ UsdtArgKind.MEM, 2, false ],
+            [ UsdtArgKind.REG, 1, false ],
+            [ UsdtArgKind.CONST, 4, false ],
+            [ UsdtArgKind.CONST, 8, false ],
+            [ UsdtArgKind.UNSUPPORTED, 8, false ],
+        ])
+        expect(args[0].register).toBe('rdi')
+        expect([ args[1].register, args[1].offset ]).toStrictEqual([ 'rbp', -8 ])
+        expect([ args[2].register, args[2].offset ]).toStrictEqual([ 'rax', 0 ])
+        expect(args[3].register).toBe('r8')
+        expect(args[4].value).toBe(BigInt(-5))
+        expect(args[5].value).toBe(BigInt(16))
+        expect(parseUsdtArguments('')).toStrictEqual([])
+    })
+
+    it('emits argument fetching code', () => {
+        const args = parseUsdtArguments('-4@%edi 8@-8(%rbp) 8@$1 8@(%rax,%rbx,8)')
+        const asm = new Assembler().movReg(Reg.R6, Reg.R1)
+        for (const arg of args.slice(0, 3))
+            fetchUsdtArgument(asm, arg, Reg.R7, Reg.R6)
+        expect(asm.movImm(Reg.R0, 0).exit().build().length % INSN_SIZE).toBe(0)
+        expect(() => fetchUsdtArgument(asm, args[3], Reg.R7, Reg.R6)).toThrow()
+    })
+
+    it('reads probes of ELF files', () => {
+        const probes = readUsdtProbes(fixture)
+        expect(probes).toHaveLength(1)
+        const [ probe ] = probes
+        expect([ probe.provider, probe.name ]).toStrictEqual([ 'test', 'hit' ])
+        expect(probe.address).toBe(BigInt(0x40101a))
+        expect(probe.fileOffset).toBe(0x101a)
+        expect(readFileSync(fixture)[probe.fileOffset]).toBe(0x90) // nop
+        expect(probe.semaphore).toBe(BigInt(0x403000))
+        expect(probe.semaphoreOffset).toBe(0x3000)
+        expect(probe.args.map(x => x.spec)).toStrictEqual([ '-4@%eax', '-8@-8(%rsp)' ])
+        expect(findUsdtProbe(fixture, 'test', 'hit')).toStrictEqual(probe)
+        expect(findUsdtProbe(fixture, 'test', 'miss')).toBeUndefined()
+        expect(() => readUsdtProbes(__filename)).toThrow()
+        expect(() => readUsdtProbes('/nonexistent')).toThrow()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('5.5') && process.arch === 'x64', 'attaches to probes', () => {
+        const probe = findUsdtProbe(fixture, 'test', 'hit')!
+        // the fixture fires the probe only while its semaphore is set, and exits with it
+        expect(spawnSync(fixture).status).toBe(0)
+
+        // counter, then both arguments
+        const ref = createMap({ type: MapType.ARRAY, keySize: 4, valueSize: 24, maxEntries: 1 })
+        const asm = new Assembler().movReg(Reg.R6, Reg.R1)
+        fetchUsdtArgument(asm, probe.args[0], Reg.R7, Reg.R6)
+        fetchUsdtArgument(asm, probe.args[1], Reg.R8, Reg.R6)
+        const insns = asm
+            .stMem(Size.W, Reg.R10, -16, 0)
+            .ldMapFd(Reg.R1, ref.fd)
+            .movReg(Reg.R2, Reg.R10)
+            .aluImm(AluOp.ADD, Reg.R2, -16)
+            .call(Helper.MAP_LOOKUP_ELEM)
+            .jmpImm(JmpOp.JEQ, Reg.R0, 0, 'out')
+            .movImm(Reg.R1, 1)
+            .atomicAdd(Size.DW, Reg.R0, Reg.R1, 0)
+            .stxMem(Size.DW, Reg.R0, Reg.R7, 8)
+            .stxMem(Size.DW, Reg.R0, Reg.R8, 16)
+            .label('out')
+            .movImm(Reg.R0, 0)
+            .exit()
+            .build()
+        const prog = loadProgram({ type: ProgramType.KPROBE, insns, license: 'GPL' })
+        const map = new RawArrayMap(ref)
+        try {
+            const link = attachUsdt(prog, fixture, probe)
+            try {
+                expect(spawnSync(fixture).status).toBe(1)
+            } finally {
+                link.close()
+            }
+            const value = map.get(0)
+            expect(value.readBigUInt64LE(0)).toBe(BigInt(1))
+            expect(value.readBigInt64LE(8)).toBe(BigInt(42))
+            expect(value.readBigInt64LE(16)).toBe(BigInt(-1))
+            expect(spawnSync(fixture).status).toBe(0)
+        } finally {
+            prog.close()
+            ref.close()
+        }
+    })
+
+})
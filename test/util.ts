@@ -1,4 +1,8 @@
-import { versions } from '../lib'
+import { execSync } from 'child_process'
+import { openSync, closeSync } from 'fs'
+import { versions, BtfKind, BtfIntEncoding } from '../lib'
+import { native } from '../lib/util'
+import { checkStatus } from '../lib/exception'
 
 export const sortKeys = (x: Iterable<[number, number]>) => [...x].sort((a, b) => a[0] - b[0])
 export const concat = <T>(...items: T[][]): T[] => ([] as T[]).concat.apply([], items)
@@ -16,3 +20,96 @@ const kernelVersion = parseVersion(versions.kernel)
 export const kernelAtLeast = (version: string) => kernelVersion >= parseVersion(version)
 
 export const isRoot = process.getuid() === 0
+
+/**
+ * Run `fn` inside a throwaway network namespace, so tests can
+ * create interfaces and attach programs without touching the
+ * host's. Only the main thread is moved, which is where netlink
+ * and socket calls happen (as well as `execSync`).
+ */
+export const withNetns = async <T>(fn: () => Promise<T> | T): Promise<T> => {
+    const name = `nbpf_test_${process.pid}`
+    execSync(`ip netns add ${name}`)
+    const host = openSync('/proc/thread-self/ns/net', 'r')
+    try {
+        const ns = openSync(`/run/netns/${name}`, 'r')
+        try {
+            checkStatus('setns', native.setNetns(ns))
+        } finally {
+            closeSync(ns)
+        }
+        try {
+            return await fn()
+        } finally {
+            checkStatus('setns', native.setNetns(host))
+        }
+    } finally {
+        closeSync(host)
+        execSync(`ip netns del ${name}`)
+    }
+}
+
+/**
+ * Like [[withNetns]], with a veth pair (`veth0` and `veth1`, both up)
+ * created in the namespace
+ */
+export const withVeth = <T>(fn: () => Promise<T> | T): Promise<T> => withNetns(() => {
+    execSync('ip link add veth0 type veth peer name veth1')
+    execSync('ip link set veth0 up && ip link set veth1 up')
+    return fn()
+})
+
+/** Bytecode for `r0 = <value>; exit` */
+export const returnConstant = (value: number) => {
+    const insns = Buffer.from('b7000000000000009500000000000000', 'hex')
+    insns.writeInt32LE(value, 4)
+    return insns
+}
+/** Bytecode for `r0 = 0; exit` */
+export const returnZero = returnConstant(0)
+/** Bytecode for `exit` (rejected by the verifier, since R0 isn't set) */
+export const invalidProgram = Buffer.from('9500000000000000', 'hex')
+
+/** `info` word of a BTF type */
+export const btfInfo = (kind: number, vlen: number = 0, kindFlag: boolean = false) =>
+    ((kindFlag ? 1 << 31 : 0) | (kind << 24) | vlen) >>> 0
+
+/**
+ * Build a raw BTF blob from the words of each type (starting at
+ * ID 1), where strings stand for their offset in the string section.
+ */
+export const buildBtf = (types: (number | string)[][]) => {
+    const offsets = new Map<string, number>([ [ '', 0 ] ])
+    let strings = '\0'
+    const words = concat(...types).map(x => {
+        if (typeof x === 'number')
+            return x >>> 0
+        if (!offsets.has(x)) {
+            offsets.set(x, strings.length)
+            strings += x + '\0'
+        }
+        return offsets.get(x)!
+    })
+    const typeSection = Buffer.alloc(4 * words.length)
+    words.forEach((x, i) => typeSection.writeUInt32LE(x, 4 * i))
+    const strSection = Buffer.from(strings)
+    const header = Buffer.alloc(24)
+    header.writeUInt16LE(0xeb9f, 0)
+    header.writeUInt8(1, 2)
+    header.writeUInt32LE(header.length, 4)
+    header.writeUInt32LE(0, 8)
+    header.writeUInt32LE(typeSection.length, 12)
+    header.writeUInt32LE(typeSection.length, 16)
+    header.writeUInt32LE(strSection.length, 20)
+    return Buffer.concat([ header, typeSection, strSection ])
+}
+
+// struct s { int a; int b: 3; union { int c; }; }; typedef struct s s_t;
+// struct t { int x; s_t inner; };
+export const testBtf = buildBtf([
+    /* 1 */ [ 'int', btfInfo(BtfKind.INT), 4, (BtfIntEncoding.SIGNED << 24) | 32 ],
+    /* 2 */ [ '', btfInfo(BtfKind.UNION, 1), 4, 'c', 1, 0 ],
+    /* 3 */ [ 's', btfInfo(BtfKind.STRUCT, 3, true), 12, 'a', 1, 0, 'b', 1, (3 << 24) | 32, '', 2, 64 ],
+    /* 4 */ [ 's_t', btfInfo(BtfKind.TYPEDEF), 3 ],
+    /* 5 */ [ 't', btfInfo(BtfKind.STRUCT, 2), 16, 'x', 1, 0, 'inner', 4, 32 ],
+])
@@ -0,0 +1,64 @@
+import { loadProgram, ProgramType, XdpFlags, XdpAttachMode, attachXdp, detachXdp, getXdpInfo, attachXdpLink, updateLink, ifNameToIndex } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, returnConstant, withVeth } from './util'
+
+const XDP_PASS = 2
+const loadXdpProgram = () => loadProgram({
+    type: ProgramType.XDP,
+    insns: returnConstant(XDP_PASS),
+    license: 'GPL',
+})
+
+describe('XDP tests', () => {
+
+    it('ifNameToIndex', () => {
+        expect(ifNameToIndex('lo')).toBe(1)
+        expect(() => ifNameToIndex('nonexistent0')).toThrow()
+    })
+
+    conditionalTest(isRoot && kernelAtLeast('5.7'), 'netlink attachment', () => withVeth(() => {
+        const ifindex = ifNameToIndex('veth0')
+        const flags = XdpFlags.SKB_MODE
+        const prog1 = loadXdpProgram(), prog2 = loadXdpProgram()
+
+        expect(getXdpInfo(ifindex).attachMode).toBe(XdpAttachMode.NONE)
+        attachXdp(ifindex, prog1, { flags, expected: null })
+        try {
+            const info = getXdpInfo(ifindex)
+            expect(info.attachMode).toBe(XdpAttachMode.SKB)
+            expect(info.skbProgId).toBe(prog1.id)
+            expect(info.progId).toBe(prog1.id)
+
+            // replace-if-expected semantics
+            expect(() => attachXdp(ifindex, prog2, { flags, expected: null })).toThrow()
+            expect(() => attachXdp(ifindex, prog2, { flags, expected: prog2 })).toThrow()
+            attachXdp(ifindex, prog2, { flags, expected: prog1 })
+            expect(getXdpInfo(ifindex).skbProgId).toBe(prog2.id)
+
+            expect(() => detachXdp(ifindex, { flags, expected: prog1 })).toThrow()
+        } finally {
+            detachXdp(ifindex, { flags })
+        }
+        expect(getXdpInfo(ifindex).attachMode).toBe(XdpAttachMode.NONE)
+        prog1.close()
+        prog2.close()
+    }))
+
+    conditionalTest(isRoot && kernelAtLeast('5.9'), 'link attachment', () => withVeth(() => {
+        const ifindex = ifNameToIndex('veth0')
+        const prog1 = loadXdpProgram(), prog2 = loadXdpProgram()
+        const link = attachXdpLink(ifindex, prog1, XdpFlags.SKB_MODE)
+        try {
+            expect(getXdpInfo(ifindex).skbProgId).toBe(prog1.id)
+            // netlink can't replace a link
+            expect(() => attachXdp(ifindex, prog2, { flags: XdpFlags.SKB_MODE })).toThrow()
+            updateLink(link, prog2, { expected: prog1 })
+            expect(getXdpInfo(ifindex).skbProgId).toBe(prog2.id)
+        } finally {
+            link.close()
+        }
+        expect(getXdpInfo(ifindex).attachMode).toBe(XdpAttachMode.NONE)
+        prog1.close()
+        prog2.close()
+    }))
+
+})
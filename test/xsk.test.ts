@@ -0,0 +1,131 @@
+import { XdpSocket, XdpFlags, XskBindFlags } from '../lib'
+import { conditionalTest, kernelAtLeast, isRoot, withVeth } from './util'
+
+const vethA = 'veth0', vethB = 'veth1'
+
+const options = {
+    frameCount: 64,
+    fillSize: 32, compSize: 32, rxSize: 32, txSize: 32,
+    xdpFlags: XdpFlags.SKB_MODE,
+    bindFlags: XskBindFlags.COPY,
+}
+
+const waitFor = (condition: () => boolean, ms: number) => new Promise<void>((resolve, reject) => {
+    const start = Date.now()
+    const check = () => {
+        if (condition()) return resolve()
+        if (Date.now() - start > ms) return reject(new Error('timed out'))
+        setTimeout(check, 5)
+    }
+    check()
+})
+
+describe('AF_XDP tests', () => {
+
+    conditionalTest(isRoot && kernelAtLeast('5.4'), 'transmit and receive over veth', () => withVeth(async () => {
+        const rx = new XdpSocket(vethB, 0, options)
+        const tx = new XdpSocket(vethA, 0, options)
+        try {
+            expect(rx.umem.byteLength).toBe(64 * 4096)
+            expect(rx.fill(Array.from({ length: 32 }, (_, i) => i * rx.frameSize))).toBe(32)
+
+            const received = new Promise<Buffer>(resolve => rx.poll(events => {
+                expect(events.readable).toBe(true)
+                const [ desc ] = rx.receive(1)
+                if (desc) {
+                    rx.stopPoll()
+                    resolve(Buffer.from(rx.frame(desc.addr, desc.len)))
+                }
+            }))
+
+            // broadcast frame with a custom ethertype
+            const packet = Buffer.alloc(64, 0x42)
+            packet.fill(0xff, 0, 6)
+            packet.writeUInt16BE(0x88b5, 12)
+            packet.copy(tx.frame(0))
+            expect(tx.transmit([ { addr: 0, len: packet.length } ])).toBe(1)
+
+            expect(await received).toStrictEqual(packet)
+            await waitFor(() => tx.complete(1).length > 0, 1000)
+            expect(rx.getStatistics().rxDropped).toBe(BigInt(0))
+        } finally {
+            rx.close()
+            tx.close()
+        }
+        expect(() => rx.fd).toThrow()
+    }))
+
+    conditionalTest(isRoot && kernelAtLeast('5.4'), 'partial fill and transmit', () => withVeth(async () => {
+        const socket = new XdpSocket(vethA, 0, options)
+        try {
+            const addrs = Array.from({ length: 48 }, (_, i) => i * socket.frameSize)
+            // invalid elements throw before touching the ring
+            expect(() => socket.fill([ 0, 'x' as any ])).toThrow()
+            expect(socket.fill(addrs)).toBe(32)
+            expect(socket.fill(addrs)).toBe(0)
+
+            expect(() => socket.transmit([ { addr: 0, len: 60 }, {} as any ])).toThrow()
+            const descs = addrs.map(addr => ({ addr, len: 60 }))
+            expect(socket.transmit(descs)).toBe(32)
+        } finally {
+            socket.close()
+        }
+    }))
+
+    conditionalTest(isRoot && kernelAtLeast('5.4'), 'partial batches', () => withVeth(async () => {
+        const socket = new XdpSocket(vethA, 0, options)
+        try {
+            const addrs = Uint32Array.from({ length: 48 }, (_, i) => i * socket.frameSize)
+            expect(socket.fillBatch(addrs, 8)).toBe(8)
+            expect(socket.fillBatch(addrs)).toBe(24)
+            expect(socket.fillBatch(addrs)).toBe(0)
+
+            const descs = new Uint32Array(2 * 48)
+            addrs.forEach((addr, i) => { descs[2*i] = addr; descs[2*i + 1] = 60 })
+            expect(socket.txBatch(descs)).toBe(32)
+        } finally {
+            socket.close()
+        }
+    }))
+
+    conditionalTest(isRoot && kernelAtLeast('5.4'), 'batched operations', () => withVeth(async () => {
+        const rx = new XdpSocket(vethB, 0, options)
+        const tx = new XdpSocket(vethA, 0, options)
+        const n = 16
+        try {
+            const addrs = Uint32Array.from({ length: 32 }, (_, i) => i * rx.frameSize)
+            expect(rx.fillBatch(addrs, 8)).toBe(8)
+            expect(rx.fillBatch(addrs.subarray(8))).toBe(24)
+
+            const descs = new Uint32Array(2 * n)
+            for (let i = 0; i < n; i++) {
+                const frame = tx.frame(i * tx.frameSize, 60)
+                frame.fill(0xff, 0, 6)
+                frame.writeUInt16BE(0x88b5, 12)
+                frame.writeUInt32BE(i, 14)
+                descs[2*i] = i * tx.frameSize
+                descs[2*i + 1] = 60
+            }
+            expect(tx.txBatch(descs)).toBe(n)
+
+            const seen: number[] = []
+            await waitFor(() => {
+                const batch = rx.rxBatch(64)
+                for (let i = 0; i < batch.length; i += 2) {
+                    expect(batch[i + 1]).toBe(60)
+                    seen.push(rx.frame(batch[i], batch[i + 1]).readUInt32BE(14))
+                }
+                return seen.length >= n
+            }, 1000)
+            expect(seen).toStrictEqual(Array.from({ length: n }, (_, i) => i))
+
+            let completed = 0
+            await waitFor(() => (completed += tx.completeBatch(64).length) >= n, 1000)
+            expect(completed).toBe(n)
+        } finally {
+            rx.close()
+            tx.close()
+        }
+    }))
+
+})